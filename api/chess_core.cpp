@@ -0,0 +1,487 @@
+#include "chess_core.h"
+#include "chess.h"
+#include "game.h"
+#include "search.h"
+#include "tt.h"
+#include "zobrist.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+struct chess_context {
+	TranspositionTable tt;
+	bool use_tt{};
+	std::atomic<bool> stop{ false };
+};
+
+// API piece codes 1-6 are pawn to king, the board numbers them the other way
+static const ChessBoard::PieceType api_types[]{ ChessBoard::None, ChessBoard::Pawn, ChessBoard::Knight, ChessBoard::Bishop, ChessBoard::Rook, ChessBoard::Queen, ChessBoard::King };
+static const ChessBoard::PieceType promotion_types[]{ ChessBoard::None, ChessBoard::Knight, ChessBoard::Bishop, ChessBoard::Rook, ChessBoard::Queen };
+
+static uint8_t api_piece(int piece) {
+	int type = piece & ChessBoard::PIECE_BITS;
+	if (type == ChessBoard::None)
+		return CHESS_EMPTY;
+	int code = 0;
+	while (api_types[code] != type)
+		code++;
+	return (uint8_t)(code | ((piece & ChessBoard::COLOR_BIT) ? 0 : 8));
+}
+
+static void from_board(const ChessBoard& brd, int halfmove_clock, int fullmove_number, chess_position& out) {
+	memset(&out, 0, sizeof(out));
+	for (int i = 0; i < 64; i++)
+		out.squares[i] = api_piece(brd.pieces[i]);
+	out.side_to_move = brd.current_turn == ChessBoard::White ? 0 : 1;
+	out.castling =
+		(brd.white_king_side ? CHESS_WHITE_KING_SIDE : 0) |
+		(brd.white_queen_side ? CHESS_WHITE_QUEEN_SIDE : 0) |
+		(brd.black_king_side ? CHESS_BLACK_KING_SIDE : 0) |
+		(brd.black_queen_side ? CHESS_BLACK_QUEEN_SIDE : 0);
+	// The board keeps the square of the pawn that moved, FEN the one behind it
+	out.en_passant = brd.en_passant_target == -1 ? -1 :
+		(int8_t)(brd.en_passant_target + (brd.current_turn == ChessBoard::White ? Down : Up));
+	out.halfmove_clock = (uint16_t)halfmove_clock;
+	out.fullmove_number = (uint16_t)fullmove_number;
+}
+
+// Rejects what the move generator can't handle: unknown pieces, a missing or
+// extra king, pawns on the last ranks and a side not to move that is in
+// check. Castling rights without the king and rook at home are dropped, like
+// an en passant square without a pawn to capture.
+static bool to_board(const chess_position& pos, ChessBoard& brd) {
+	brd = ChessBoard{};
+	int white_kings = 0, black_kings = 0;
+	for (int i = 0; i < 64; i++) {
+		int code = pos.squares[i];
+		if (code == CHESS_EMPTY)
+			continue;
+		int type = code & 7;
+		if (type == 0 || type > 6 || code > 15)
+			return false;
+		if (api_types[type] == ChessBoard::Pawn && (i < 8 || i >= 56))
+			return false;
+		ChessBoard::Color color = (code & 8) ? ChessBoard::Black : ChessBoard::White;
+		brd.pieces[i] = api_types[type] | color;
+		if (api_types[type] == ChessBoard::King) {
+			if (color == ChessBoard::White) {
+				white_kings++;
+				brd.white_king_position = i;
+			}
+			else {
+				black_kings++;
+				brd.black_king_position = i;
+			}
+		}
+	}
+	if (white_kings != 1 || black_kings != 1 || pos.side_to_move > 1)
+		return false;
+	brd.current_turn = pos.side_to_move == 0 ? ChessBoard::White : ChessBoard::Black;
+
+	brd.white_king_side = pos.castling & CHESS_WHITE_KING_SIDE;
+	brd.white_queen_side = pos.castling & CHESS_WHITE_QUEEN_SIDE;
+	brd.black_king_side = pos.castling & CHESS_BLACK_KING_SIDE;
+	brd.black_queen_side = pos.castling & CHESS_BLACK_QUEEN_SIDE;
+
+	if (pos.en_passant != -1) {
+		bool white = brd.current_turn == ChessBoard::White;
+		if (pos.en_passant < 0 || pos.en_passant >= 64 || pos.en_passant / 8 != (white ? 2 : 5))
+			return false;
+		int pawn = pos.en_passant - (white ? Down : Up);
+		if (get_piece(brd, pawn) == (ChessBoard::Pawn | (white ? ChessBoard::Black : ChessBoard::White)))
+			brd.en_passant_target = pawn;
+	}
+
+	return settle_position(brd);
+}
+
+static chess_move api_move(Move mv) {
+	int promotion = 0;
+	while (promotion < 4 && promotion_types[promotion] != mv.promotion)
+		promotion++;
+	return (chess_move)(mv.from | mv.to << 6 | promotion << 12);
+}
+
+// The generator can list an en passant capture twice, callers get it once
+static int legal_moves(const ChessBoard& brd, Move* moves) {
+	int count = get_all_valid_moves(brd, moves);
+	if (brd.en_passant_target == -1)
+		return count;
+	int kept = 0;
+	for (int i = 0; i < count; i++) {
+		bool seen = false;
+		for (int j = 0; j < kept && !seen; j++)
+			seen = moves[j].from == moves[i].from && moves[j].to == moves[i].to && moves[j].promotion == moves[i].promotion;
+		if (!seen)
+			moves[kept++] = moves[i];
+	}
+	return kept;
+}
+
+static bool find_legal(const ChessBoard& brd, chess_move move, Move& out) {
+	int from = move & 63, to = (move >> 6) & 63, promotion = move >> 12;
+	if (promotion > 4)
+		return false;
+	Move moves[MAX_MOVES];
+	int count = legal_moves(brd, moves);
+	for (int i = 0; i < count; i++) {
+		if (moves[i].from == from && moves[i].to == to && moves[i].promotion == promotion_types[promotion]) {
+			out = moves[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+// Plays mv on the game and the counters that go with it
+static void play(Game& game, chess_position& pos, Move mv) {
+	bool black = game.brd.current_turn == ChessBoard::Black;
+	play_move(game, mv);
+	from_board(game.brd, game.halfmove_clock, pos.fullmove_number + (black ? 1 : 0), pos);
+}
+
+static int game_status(const Game& game) {
+	int white_points;
+	const char* reason = game_result(game, white_points);
+	if (!reason)
+		return CHESS_ONGOING;
+	if (strcmp(reason, "checkmate") == 0)
+		return CHESS_CHECKMATE;
+	if (strcmp(reason, "stalemate") == 0)
+		return CHESS_STALEMATE;
+	if (strcmp(reason, "fifty move rule") == 0)
+		return CHESS_FIFTY_MOVES;
+	if (strcmp(reason, "threefold repetition") == 0)
+		return CHESS_REPETITION;
+	return CHESS_INSUFFICIENT_MATERIAL;
+}
+
+static void start_from(Game& game, const ChessBoard& brd, const chess_position& pos) {
+	game.brd = brd;
+	game.halfmove_clock = pos.halfmove_clock;
+	game.history.assign(1, position_hash(brd));
+}
+
+uint32_t chess_api_version(void) {
+	return CHESS_API_VERSION;
+}
+
+chess_context* chess_context_create(size_t hash_mb) {
+	chess_context* ctx = new (std::nothrow) chess_context;
+	if (!ctx)
+		return nullptr;
+	ctx->use_tt = hash_mb > 0;
+	try {
+		if (ctx->use_tt)
+			tt_resize(ctx->tt, hash_mb);
+	}
+	catch (const std::bad_alloc&) {
+		delete ctx;
+		return nullptr;
+	}
+	return ctx;
+}
+
+void chess_context_destroy(chess_context* ctx) {
+	delete ctx;
+}
+
+void chess_context_clear(chess_context* ctx) {
+	if (ctx && ctx->use_tt)
+		tt_clear(ctx->tt);
+}
+
+void chess_context_stop(chess_context* ctx) {
+	if (ctx)
+		ctx->stop = true;
+}
+
+int chess_position_from_fen(const char* fen, chess_position* out) {
+	if (!fen || !out)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	if (!is_valid_fen(fen))
+		return CHESS_ERROR_INVALID_FEN;
+	ChessBoard brd{};
+	init_fen(brd, fen);
+	// The counters after the four fields are optional
+	const char* p = fen;
+	for (int fields = 0; *p && fields < 4; fields++) {
+		while (*p == ' ')
+			p++;
+		while (*p && *p != ' ')
+			p++;
+	}
+	char* end;
+	long halfmove = strtol(p, &end, 10);
+	long fullmove = end != p ? strtol(end, nullptr, 10) : 1;
+	if (halfmove < 0 || halfmove > 65535 || fullmove < 1 || fullmove > 65535)
+		return CHESS_ERROR_INVALID_FEN;
+
+	chess_position pos;
+	from_board(brd, (int)halfmove, (int)fullmove, pos);
+	if (!to_board(pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	from_board(brd, pos.halfmove_clock, pos.fullmove_number, *out);
+	return CHESS_OK;
+}
+
+int chess_position_to_fen(const chess_position* pos, char* fen, size_t size) {
+	if (!pos || !fen)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	if (size < CHESS_MAX_FEN)
+		return CHESS_ERROR_BUFFER_TOO_SMALL;
+	ChessBoard brd;
+	if (!to_board(*pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	board_to_fen(brd, fen);
+	// board_to_fen ends in " 0 1", the board doesn't keep the counters
+	size_t n = strlen(fen) - 4;
+	snprintf(fen + n, size - n, " %u %u", pos->halfmove_clock, pos->fullmove_number);
+	return CHESS_OK;
+}
+
+int chess_move_to_uci(chess_move move, char* buf, size_t size) {
+	if (!buf)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	if (size < 6)
+		return CHESS_ERROR_BUFFER_TOO_SMALL;
+	if ((move >> 12) > 4)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	Move mv;
+	mv.from = (int8_t)(move & 63);
+	mv.to = (int8_t)((move >> 6) & 63);
+	mv.promotion = (uint8_t)promotion_types[move >> 12];
+	move_to_string(mv, buf);
+	return CHESS_OK;
+}
+
+int chess_move_from_uci(const chess_position* pos, const char* uci, chess_move* out) {
+	if (!pos || !uci || !out)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	ChessBoard brd;
+	if (!to_board(*pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	Move moves[MAX_MOVES];
+	int count = legal_moves(brd, moves);
+	for (int i = 0; i < count; i++) {
+		char buf[6];
+		move_to_string(moves[i], buf);
+		if (strcmp(buf, uci) == 0) {
+			*out = api_move(moves[i]);
+			return CHESS_OK;
+		}
+	}
+	return CHESS_ERROR_ILLEGAL_MOVE;
+}
+
+int chess_legal_moves(const chess_position* pos, chess_move* moves, size_t capacity, size_t* count) {
+	if (!pos || !count || (!moves && capacity > 0))
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	ChessBoard brd;
+	if (!to_board(*pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	Move list[MAX_MOVES];
+	int n = legal_moves(brd, list);
+	for (int i = 0; i < n && (size_t)i < capacity; i++)
+		moves[i] = api_move(list[i]);
+	*count = n;
+	return (size_t)n <= capacity ? CHESS_OK : CHESS_ERROR_BUFFER_TOO_SMALL;
+}
+
+int chess_make_move(const chess_position* pos, chess_move move, chess_position* out) {
+	if (!pos || !out)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	ChessBoard brd;
+	if (!to_board(*pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	Move mv;
+	if (!find_legal(brd, move, mv))
+		return CHESS_ERROR_ILLEGAL_MOVE;
+	try {
+		Game game;
+		start_from(game, brd, *pos);
+		chess_position next = *pos;
+		play(game, next, mv);
+		*out = next;
+	}
+	catch (const std::bad_alloc&) {
+		return CHESS_ERROR_OUT_OF_MEMORY;
+	}
+	return CHESS_OK;
+}
+
+int chess_status(const chess_position* pos, int* status) {
+	if (!pos || !status)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	ChessBoard brd;
+	if (!to_board(*pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	try {
+		Game game;
+		start_from(game, brd, *pos);
+		*status = game_status(game);
+	}
+	catch (const std::bad_alloc&) {
+		return CHESS_ERROR_OUT_OF_MEMORY;
+	}
+	return CHESS_OK;
+}
+
+// Leaves the stop flag alone so a stop ends the rest of a batch as well
+static int search_position(chess_context* ctx, const chess_position* pos, const chess_search_limits* limits, chess_search_result* result) {
+	ChessBoard brd;
+	if (!to_board(*pos, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	SearchLimits search_limits{};
+	if (limits) {
+		if (limits->depth > 0 && limits->depth < MAX_PLY)
+			search_limits.depth = limits->depth;
+		search_limits.nodes = limits->nodes;
+	}
+	search_limits.tt = ctx->use_tt ? &ctx->tt : nullptr;
+
+	SearchInfo info;
+	try {
+		info = search(brd, search_limits, ctx->stop);
+	}
+	catch (const std::bad_alloc&) {
+		return CHESS_ERROR_OUT_OF_MEMORY;
+	}
+	memset(result, 0, sizeof(*result));
+	result->pv_length = (uint16_t)info.pv_length;
+	for (int i = 0; i < info.pv_length; i++)
+		result->pv[i] = api_move(info.pv[i]);
+	result->best_move = info.pv_length > 0 ? result->pv[0] : 0;
+	result->depth = info.depth;
+	result->score = info.score;
+	if (is_mate_score(info.score)) {
+		int plies = MATE_SCORE - (info.score < 0 ? -info.score : info.score);
+		result->mate_in = info.score > 0 ? (plies + 1) / 2 : -((plies + 1) / 2);
+	}
+	result->nodes = info.nodes;
+	return CHESS_OK;
+}
+
+int chess_search(chess_context* ctx, const chess_position* pos, const chess_search_limits* limits, chess_search_result* result) {
+	if (!ctx || !pos || !result)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	ctx->stop = false;
+	return search_position(ctx, pos, limits, result);
+}
+
+// Keeps the first failure as the batch result
+static void note_error(int err, int& first, int* errors, size_t i) {
+	if (errors)
+		errors[i] = err;
+	if (first == CHESS_OK)
+		first = err;
+}
+
+int chess_positions_from_fens(const char* const* fens, size_t count, chess_position* out, int* errors) {
+	if ((!fens || !out) && count > 0)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	int first = CHESS_OK;
+	for (size_t i = 0; i < count; i++)
+		note_error(chess_position_from_fen(fens[i], &out[i]), first, errors, i);
+	return first;
+}
+
+int chess_legal_moves_batch(const chess_position* positions, size_t count, chess_move* moves, size_t capacity, size_t* offsets) {
+	if ((!positions && count > 0) || !offsets || (!moves && capacity > 0))
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	int first = CHESS_OK;
+	size_t used = 0;
+	offsets[0] = 0;
+	for (size_t i = 0; i < count; i++) {
+		ChessBoard brd;
+		if (first != CHESS_ERROR_BUFFER_TOO_SMALL && to_board(positions[i], brd)) {
+			Move list[MAX_MOVES];
+			int n = legal_moves(brd, list);
+			if (used + n <= capacity) {
+				for (int j = 0; j < n; j++)
+					moves[used++] = api_move(list[j]);
+			}
+			else
+				first = CHESS_ERROR_BUFFER_TOO_SMALL;
+		}
+		else if (first == CHESS_OK)
+			first = CHESS_ERROR_INVALID_POSITION;
+		offsets[i + 1] = used;
+	}
+	return first;
+}
+
+int chess_make_moves_batch(const chess_position* positions, const chess_move* moves, size_t count, chess_position* out, int* errors) {
+	if ((!positions || !moves || !out) && count > 0)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	int first = CHESS_OK;
+	for (size_t i = 0; i < count; i++) {
+		chess_position next;
+		int err = chess_make_move(&positions[i], moves[i], &next);
+		out[i] = err == CHESS_OK ? next : positions[i];
+		note_error(err, first, errors, i);
+	}
+	return first;
+}
+
+int chess_status_batch(const chess_position* positions, size_t count, int* statuses, int* errors) {
+	if ((!positions || !statuses) && count > 0)
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	int first = CHESS_OK;
+	for (size_t i = 0; i < count; i++) {
+		statuses[i] = CHESS_ONGOING;
+		note_error(chess_status(&positions[i], &statuses[i]), first, errors, i);
+	}
+	return first;
+}
+
+int chess_play_moves(const chess_position* start, const chess_move* moves, size_t count, chess_position* final_position, int* status, size_t* played) {
+	if (!start || (!moves && count > 0))
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	if (played)
+		*played = 0;
+	ChessBoard brd;
+	if (!to_board(*start, brd))
+		return CHESS_ERROR_INVALID_POSITION;
+	int err = CHESS_OK;
+	try {
+		Game game;
+		start_from(game, brd, *start);
+		chess_position pos = *start;
+		size_t i = 0;
+		for (; i < count; i++) {
+			Move mv;
+			if (!find_legal(game.brd, moves[i], mv)) {
+				err = CHESS_ERROR_ILLEGAL_MOVE;
+				break;
+			}
+			play(game, pos, mv);
+		}
+		if (played)
+			*played = i;
+		if (final_position)
+			*final_position = pos;
+		if (status)
+			*status = game_status(game);
+	}
+	catch (const std::bad_alloc&) {
+		return CHESS_ERROR_OUT_OF_MEMORY;
+	}
+	return err;
+}
+
+int chess_search_batch(chess_context* ctx, const chess_position* positions, size_t count, const chess_search_limits* limits, chess_search_result* results, int* errors) {
+	if (!ctx || ((!positions || !results) && count > 0))
+		return CHESS_ERROR_INVALID_ARGUMENT;
+	int first = CHESS_OK;
+	ctx->stop = false;
+	for (size_t i = 0; i < count; i++) {
+		int err = search_position(ctx, &positions[i], limits, &results[i]);
+		if (err != CHESS_OK)
+			memset(&results[i], 0, sizeof(results[i]));
+		note_error(err, first, errors, i);
+	}
+	return first;
+}
@@ -0,0 +1,167 @@
+/* C interface to the rules and the search, for use from other languages.
+ *
+ * Everything is plain data or an opaque context owned by the caller. The
+ * library keeps no global state: functions only touch what they are given,
+ * so any number of threads can call them at once as long as each context is
+ * used by one thread at a time (chess_context_stop is the exception).
+ *
+ * Squares are numbered 0 = a8 to 63 = h1, rank by rank as in FEN. Structs
+ * only ever grow at the reserved fields, and CHESS_API_VERSION goes up when
+ * anything changes. */
+#ifndef CHESS_CORE_H
+#define CHESS_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CHESS_CORE_SHARED)
+#if defined(_WIN32)
+#if defined(CHESS_CORE_BUILD)
+#define CHESS_API __declspec(dllexport)
+#else
+#define CHESS_API __declspec(dllimport)
+#endif
+#else
+#define CHESS_API __attribute__((visibility("default")))
+#endif
+#else
+#define CHESS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHESS_API_VERSION 1
+#define CHESS_MAX_MOVES 256
+#define CHESS_MAX_PV 64
+#define CHESS_MAX_FEN 96
+
+enum chess_error {
+	CHESS_OK = 0,
+	CHESS_ERROR_INVALID_ARGUMENT = -1,
+	CHESS_ERROR_INVALID_FEN = -2,
+	CHESS_ERROR_INVALID_POSITION = -3,
+	CHESS_ERROR_ILLEGAL_MOVE = -4,
+	CHESS_ERROR_BUFFER_TOO_SMALL = -5,
+	CHESS_ERROR_OUT_OF_MEMORY = -6,
+};
+
+/* Piece codes of chess_position.squares */
+enum chess_piece {
+	CHESS_EMPTY = 0,
+	CHESS_WHITE_PAWN = 1, CHESS_WHITE_KNIGHT, CHESS_WHITE_BISHOP, CHESS_WHITE_ROOK, CHESS_WHITE_QUEEN, CHESS_WHITE_KING,
+	CHESS_BLACK_PAWN = 9, CHESS_BLACK_KNIGHT, CHESS_BLACK_BISHOP, CHESS_BLACK_ROOK, CHESS_BLACK_QUEEN, CHESS_BLACK_KING,
+};
+
+/* Bits of chess_position.castling */
+enum chess_castling {
+	CHESS_WHITE_KING_SIDE = 1,
+	CHESS_WHITE_QUEEN_SIDE = 2,
+	CHESS_BLACK_KING_SIDE = 4,
+	CHESS_BLACK_QUEEN_SIDE = 8,
+};
+
+typedef struct chess_position {
+	uint8_t squares[64];
+	/* 0 white, 1 black */
+	uint8_t side_to_move;
+	uint8_t castling;
+	/* Square a pawn can capture en passant onto, as in FEN, or -1 */
+	int8_t en_passant;
+	uint8_t reserved;
+	uint16_t halfmove_clock;
+	uint16_t fullmove_number;
+} chess_position;
+
+/* from | to << 6 | promotion << 12, promotion 0 none, 1 knight, 2 bishop,
+ * 3 rook, 4 queen. 0 is never a legal move. */
+typedef uint16_t chess_move;
+
+enum chess_status {
+	CHESS_ONGOING = 0,
+	CHESS_CHECKMATE,
+	CHESS_STALEMATE,
+	CHESS_FIFTY_MOVES,
+	CHESS_REPETITION,
+	CHESS_INSUFFICIENT_MATERIAL,
+};
+
+typedef struct chess_search_limits {
+	/* Maximum depth in plies, 0 for the deepest the engine goes */
+	int32_t depth;
+	uint32_t reserved;
+	/* Node budget, 0 for no limit */
+	uint64_t nodes;
+} chess_search_limits;
+
+typedef struct chess_search_result {
+	chess_move best_move;
+	uint16_t pv_length;
+	/* Depth of the last completed iteration */
+	int32_t depth;
+	/* Centipawns from the point of view of the side to move */
+	int32_t score;
+	/* Moves to mate, negative when the side to move gets mated, 0 otherwise */
+	int32_t mate_in;
+	uint64_t nodes;
+	chess_move pv[CHESS_MAX_PV];
+} chess_search_result;
+
+/* Search state: the hash table and the stop flag. */
+typedef struct chess_context chess_context;
+
+CHESS_API uint32_t chess_api_version(void);
+
+/* NULL when the table doesn't fit in memory. hash_mb 0 searches without one. */
+CHESS_API chess_context* chess_context_create(size_t hash_mb);
+CHESS_API void chess_context_destroy(chess_context* ctx);
+/* Forgets what earlier searches stored */
+CHESS_API void chess_context_clear(chess_context* ctx);
+/* Ends the running search of ctx early, and the rest of a batch, safe to
+ * call from any thread. The flag is cleared when the next call starts. */
+CHESS_API void chess_context_stop(chess_context* ctx);
+
+/* Reads the four FEN fields and the optional move counters */
+CHESS_API int chess_position_from_fen(const char* fen, chess_position* out);
+/* fen must hold CHESS_MAX_FEN chars */
+CHESS_API int chess_position_to_fen(const chess_position* pos, char* fen, size_t size);
+
+/* Coordinate notation, "e2e4" or "e7e8q". buf must hold 6 chars. */
+CHESS_API int chess_move_to_uci(chess_move move, char* buf, size_t size);
+/* Finds the legal move written in coordinate notation */
+CHESS_API int chess_move_from_uci(const chess_position* pos, const char* uci, chess_move* out);
+
+/* Writes up to capacity legal moves, count is set to the number of legal moves */
+CHESS_API int chess_legal_moves(const chess_position* pos, chess_move* moves, size_t capacity, size_t* count);
+/* Plays a legal move and updates the move counters */
+CHESS_API int chess_make_move(const chess_position* pos, chess_move move, chess_position* out);
+/* Status of the position alone, repetitions need chess_play_moves */
+CHESS_API int chess_status(const chess_position* pos, int* status);
+
+CHESS_API int chess_search(chess_context* ctx, const chess_position* pos, const chess_search_limits* limits, chess_search_result* result);
+
+/* Batch functions. Each returns CHESS_OK when every item succeeded, else the
+ * first error, with the error of every item in errors when it is not NULL. */
+
+CHESS_API int chess_positions_from_fens(const char* const* fens, size_t count, chess_position* out, int* errors);
+/* The moves of position i are moves[offsets[i]] to moves[offsets[i + 1]],
+ * offsets holds count + 1 entries. When capacity runs out the remaining
+ * positions get no moves and CHESS_ERROR_BUFFER_TOO_SMALL is returned. */
+CHESS_API int chess_legal_moves_batch(const chess_position* positions, size_t count, chess_move* moves, size_t capacity, size_t* offsets);
+/* out[i] is positions[i] after moves[i], or positions[i] if that failed */
+CHESS_API int chess_make_moves_batch(const chess_position* positions, const chess_move* moves, size_t count, chess_position* out, int* errors);
+CHESS_API int chess_status_batch(const chess_position* positions, size_t count, int* statuses, int* errors);
+/* Plays a game from start, final and status may be NULL. Repetitions count
+ * from start on. Stops at the first illegal move, played is set to the number
+ * of moves made. */
+CHESS_API int chess_play_moves(const chess_position* start, const chess_move* moves, size_t count, chess_position* final_position, int* status, size_t* played);
+/* Searches the positions one after the other with ctx. Spread a large batch
+ * over threads with one context per thread. */
+CHESS_API int chess_search_batch(chess_context* ctx, const chess_position* positions, size_t count, const chess_search_limits* limits, chess_search_result* results, int* errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,20 +1,253 @@
 -- premake5.lua
+
+-- Writes a file as a C++ byte array so the program doesn't have to find it at runtime
+local function embed_file(input, output, name)
+   local file = assert(io.open(input, "rb"))
+   local data = file:read("*a")
+   file:close()
+   local lines = {
+      "// Generated by premake5.lua from " .. input .. ", do not edit",
+      "#pragma once",
+      "#include <cstdint>",
+      "",
+      "const uint8_t " .. name .. "[]{",
+   }
+   for i = 1, #data, 24 do
+      lines[#lines + 1] = "\t" .. table.concat({ data:byte(i, math.min(i + 23, #data)) }, ",") .. ","
+   end
+   lines[#lines + 1] = "};"
+   os.mkdir(path.getdirectory(output))
+   file = assert(io.open(output, "wb"))
+   file:write(table.concat(lines, "\n") .. "\n")
+   file:close()
+end
+
+-- The piece atlas is compiled into the GUI, rerun premake after changing it
+embed_file("bin/pieces.png", "src/generated/pieces_png.h", "pieces_png")
+
 workspace "chess_gl"
-   configurations { "Debug", "Release" }
+   configurations { "Debug", "Release", "Profile" }
 
-project "chess_gl"
-   kind "ConsoleApp"
    language "C++"
    cppdialect "C++20"
    architecture "x86_64"
    targetdir "bin/%{cfg.buildcfg}"
 
-   files { "src/**.h", "src/**.cpp" }
+   -- Batch kernels are built once per instruction set, batch.cpp picks one at runtime
+   filter { "files:src/batch_avx2.cpp", "action:vs*" }
+      buildoptions { "/arch:AVX2" }
+   filter { "files:src/batch_avx2.cpp", "action:not vs*" }
+      buildoptions { "-mavx2" }
+   filter { "files:src/batch_avx512.cpp", "action:vs*" }
+      buildoptions { "/arch:AVX512" }
+   filter { "files:src/batch_avx512.cpp", "action:not vs*" }
+      buildoptions { "-mavx512f" }
 
+   -- Shared by every project below, which only lists its files, includes and links
    filter "configurations:Debug"
       defines { "DEBUG" }
       symbols "On"
 
    filter "configurations:Release"
       defines { "NDEBUG" }
-      optimize "On"
\ No newline at end of file
+      optimize "On"
+
+   -- Release with the instrumentation from src/profile.h compiled in
+   filter "configurations:Profile"
+      defines { "NDEBUG", "CHESS_PROFILE" }
+      optimize "On"
+      symbols "On"
+
+   filter {}
+
+project "chess_gl"
+   kind "ConsoleApp"
+
+   files { "src/**.h", "src/**.cpp" }
+
+project "diagram"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files { "tools/diagram/**.cpp", "src/chess.h", "src/chess.cpp", "src/profile.h", "src/profile.cpp" }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "bench"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files { "tools/bench/**.cpp", "src/chess.h", "src/chess.cpp", "src/tables.h", "src/batch*.h", "src/batch*.cpp", "src/profile.h", "src/profile.cpp" }
+
+project "validate"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files { "tools/validate/**.h", "tools/validate/**.cpp", "src/chess.h", "src/chess.cpp", "src/tables.h", "src/batch*.h", "src/batch*.cpp", "src/profile.h", "src/profile.cpp" }
+
+project "match"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files {
+      "tools/match/**.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/search.h", "src/search.cpp", "src/eval.h", "src/eval.cpp", "src/eval_params.h",
+      "src/zobrist.h", "src/zobrist.cpp", "src/tt.h", "src/tt.cpp", "src/game.h", "src/game.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "selfplay"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files {
+      "tools/selfplay/**.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/search.h", "src/search.cpp", "src/eval.h", "src/eval.cpp", "src/eval_params.h",
+      "src/zobrist.h", "src/zobrist.cpp", "src/tt.h", "src/tt.cpp", "src/game.h", "src/game.cpp",
+      "src/training_data.h", "src/training_data.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "tune"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files {
+      "tools/tune/**.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h", "src/eval_params.h",
+      "src/training_data.h", "src/training_data.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "explorer"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files {
+      "tools/explorer/**.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/zobrist.h", "src/zobrist.cpp",
+      "src/explorer.h", "src/explorer.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "server"
+   kind "ConsoleApp"
+
+   -- epoll based, the code builds elsewhere but only runs on Linux
+   includedirs { "src" }
+   files {
+      "tools/server/**.h", "tools/server/**.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/game.h", "src/game.cpp", "src/zobrist.h", "src/zobrist.cpp",
+      "src/training_data.h", "src/training_data.cpp",
+      "src/explorer.h", "src/explorer.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "loadtest"
+   kind "ConsoleApp"
+
+   files { "tools/loadtest/**.cpp" }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "mate"
+   kind "ConsoleApp"
+
+   includedirs { "src" }
+   files {
+      "tools/mate/**.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/zobrist.h", "src/zobrist.cpp",
+      "src/mate.h", "src/mate.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "coordinator"
+   kind "ConsoleApp"
+
+   -- poll and BSD sockets, only runs on Linux like the game server
+   includedirs { "src", "tools/cluster" }
+   files {
+      "tools/cluster/cluster.h", "tools/cluster/cluster.cpp", "tools/cluster/coordinator.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/zobrist.h", "src/zobrist.cpp",
+      "src/training_data.h", "src/training_data.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "worker"
+   kind "ConsoleApp"
+
+   includedirs { "src", "tools/cluster" }
+   files {
+      "tools/cluster/cluster.h", "tools/cluster/cluster.cpp", "tools/cluster/worker.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/search.h", "src/search.cpp", "src/eval.h", "src/eval.cpp", "src/eval_params.h",
+      "src/zobrist.h", "src/zobrist.cpp", "src/tt.h", "src/tt.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+-- Rules and search behind the C interface in api/chess_core.h, for other languages
+project "chess_core"
+   kind "StaticLib"
+   pic "On"
+
+   includedirs { "src", "api" }
+   files {
+      "api/chess_core.h", "api/chess_core.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/search.h", "src/search.cpp", "src/eval.h", "src/eval.cpp", "src/eval_params.h",
+      "src/zobrist.h", "src/zobrist.cpp", "src/tt.h", "src/tt.cpp", "src/game.h", "src/game.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
+
+project "chess_core_shared"
+   kind "SharedLib"
+   pic "On"
+
+   defines { "CHESS_CORE_SHARED", "CHESS_CORE_BUILD" }
+   visibility "Hidden"
+   includedirs { "src", "api" }
+   files {
+      "api/chess_core.h", "api/chess_core.cpp",
+      "src/chess.h", "src/chess.cpp", "src/tables.h",
+      "src/search.h", "src/search.cpp", "src/eval.h", "src/eval.cpp", "src/eval_params.h",
+      "src/zobrist.h", "src/zobrist.cpp", "src/tt.h", "src/tt.cpp", "src/game.h", "src/game.cpp",
+      "src/profile.h", "src/profile.cpp",
+   }
+
+   filter "system:linux"
+      links { "pthread" }
@@ -0,0 +1,72 @@
+#include "analysis.h"
+
+static void analysis_worker(Analysis& a) {
+	uint32_t started = 0;
+	for (;;) {
+		ChessBoard pos{};
+		uint32_t gen = 0;
+		{
+			std::unique_lock<std::mutex> lock(a.mutex);
+			a.wake.wait(lock, [&]() { return a.quit || a.requested != started; });
+			if (a.quit)
+				return;
+			pos = a.position;
+			gen = started = a.requested;
+			a.stop = false;
+		}
+		SearchLimits limits{};
+		search(pos, limits, a.stop, [&](const SearchInfo& info) {
+			// A full queue means the consumer is behind, dropping is fine since newer results follow
+			a.results.push({ gen, info });
+			if (a.notify)
+				a.notify();
+		});
+	}
+}
+
+void start_analysis(Analysis& a, void (*notify)()) {
+	a.notify = notify;
+	a.worker = std::thread(analysis_worker, std::ref(a));
+}
+
+void analyse_position(Analysis& a, const ChessBoard& brd) {
+	{
+		std::lock_guard<std::mutex> lock(a.mutex);
+		a.position = brd;
+		a.requested++;
+		a.generation = a.requested;
+		a.stop = true;
+	}
+	a.wake.notify_one();
+}
+
+void stop_analysis(Analysis& a) {
+	std::lock_guard<std::mutex> lock(a.mutex);
+	// Bumping the generation makes results of the cancelled search stale
+	a.generation = a.requested + 1;
+	a.stop = true;
+}
+
+void shutdown_analysis(Analysis& a) {
+	{
+		std::lock_guard<std::mutex> lock(a.mutex);
+		a.quit = true;
+		a.stop = true;
+	}
+	a.wake.notify_one();
+	if (a.worker.joinable())
+		a.worker.join();
+}
+
+bool poll_analysis(Analysis& a, AnalysisResult& latest) {
+	bool found = false;
+	AnalysisResult r{};
+	uint32_t current = a.generation.load();
+	while (a.results.pop(r)) {
+		if (r.generation == current) {
+			latest = r;
+			found = true;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "search.h"
+#include "spsc_queue.h"
+
+struct AnalysisResult {
+	// Which analyse_position call the result belongs to
+	uint32_t generation{};
+	SearchInfo info{};
+};
+
+// Runs the search on a worker thread. Positions are handed over under a
+// mutex, results come back through a lock-free queue so the render loop
+// never waits on the search.
+struct Analysis {
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	// Guarded by mutex
+	ChessBoard position{};
+	uint32_t requested{ 0 };
+	bool quit{ false };
+	// Cancels the running search
+	std::atomic<bool> stop{ false };
+	// Generation of the latest request, read by the consumer to drop stale results
+	std::atomic<uint32_t> generation{ 0 };
+	SpscQueue<AnalysisResult, 64> results;
+	// Called on the worker thread after a result was queued
+	void (*notify)() { nullptr };
+};
+
+void start_analysis(Analysis& a, void (*notify)());
+// Cancels the running search and starts analysing brd
+void analyse_position(Analysis& a, const ChessBoard& brd);
+// Cancels the running search and leaves the worker idle
+void stop_analysis(Analysis& a);
+void shutdown_analysis(Analysis& a);
+// Drains queued results. Returns true and the newest result of the current
+// generation if there was one.
+bool poll_analysis(Analysis& a, AnalysisResult& latest);
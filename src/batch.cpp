@@ -0,0 +1,171 @@
+#include "batch.h"
+#include "batch_kernel.h"
+#include <bit>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// Defined in batch_avx2.cpp and batch_avx512.cpp, which are compiled with those instruction sets
+void compute_attacks_avx2(const BatchView& batch, size_t begin, size_t end);
+void compute_attacks_avx512(const BatchView& batch, size_t begin, size_t end);
+void count_legal_moves_avx2(const BatchView& batch, size_t begin, size_t end);
+void count_legal_moves_avx512(const BatchView& batch, size_t begin, size_t end);
+
+struct ScalarOps {
+	using V = uint64_t;
+	static constexpr int lanes = 1;
+	static V load(const uint64_t* p) { return *p; }
+	static void store(uint64_t* p, V v) { *p = v; }
+	static V set1(uint64_t x) { return x; }
+	static V band(V a, V b) { return a & b; }
+	static V bor(V a, V b) { return a | b; }
+	static V bandnot(V a, V b) { return ~a & b; }
+	template<int N> static V shl(V v) { return v << N; }
+	template<int N> static V shr(V v) { return v >> N; }
+	static V add(V a, V b) { return a + b; }
+	static V sub(V a, V b) { return a - b; }
+	static V nonzero(V v) { return v ? ~0ull : 0; }
+	static V popcount(V v) { return std::popcount(v); }
+};
+
+const char* batch_path_name(BatchPath path) {
+	switch (path) {
+	case BatchScalar: return "scalar";
+	case BatchAVX2: return "avx2";
+	case BatchAVX512: return "avx512";
+	}
+	return "?";
+}
+
+bool batch_path_supported(BatchPath path) {
+	if (path == BatchScalar)
+		return true;
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	// The OS has to save the wide registers too
+	if (!(info[2] & (1 << 27)))
+		return false;
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if (path == BatchAVX2)
+		return (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+	return (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+#else
+	__builtin_cpu_init();
+	if (path == BatchAVX2)
+		return __builtin_cpu_supports("avx2");
+	return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+BatchPath best_batch_path() {
+	static BatchPath best =
+		batch_path_supported(BatchAVX512) ? BatchAVX512 :
+		batch_path_supported(BatchAVX2) ? BatchAVX2 :
+		BatchScalar;
+	return best;
+}
+
+void load_batch(PositionBatch& batch, const ChessBoard* boards, size_t count) {
+	batch.count = count;
+	for (auto& color : batch.pieces) {
+		for (auto& type : color)
+			type.assign(count, 0);
+	}
+	batch.white_to_move.assign(count, 0);
+	batch.castling.assign(count, 0);
+	batch.en_passant.assign(count, 0);
+	for (size_t i = 0; i < count; i++) {
+		const ChessBoard& brd = boards[i];
+		batch.white_to_move[i] = brd.current_turn == ChessBoard::White ? all_squares : 0;
+		batch.castling[i] =
+			(brd.white_king_side ? 1ull << 63 : 0) | (brd.white_queen_side ? 1ull << 56 : 0) |
+			(brd.black_king_side ? 1ull << 7 : 0) | (brd.black_queen_side ? 1ull << 0 : 0);
+		if (in_range(brd.en_passant_target, 0, 64))
+			batch.en_passant[i] = 1ull << brd.en_passant_target;
+		for (int sq = 0; sq < 64; sq++) {
+			int type = get_type(boards[i], sq);
+			if (type == ChessBoard::None)
+				continue;
+			int white = get_color(boards[i], sq) == ChessBoard::White;
+			batch.pieces[white][type][i] |= 1ull << sq;
+			batch.pieces[white][ChessBoard::None][i] |= 1ull << sq;
+		}
+	}
+}
+
+static BatchView make_view(const PositionBatch& batch, BatchResult& out) {
+	BatchView view{};
+	for (int white = 0; white < 2; white++) {
+		for (int type = 0; type < 7; type++)
+			view.pieces[white][type] = batch.pieces[white][type].data();
+		view.attacks[white] = out.attacks[white].data();
+	}
+	view.white_to_move = batch.white_to_move.data();
+	view.castling = batch.castling.data();
+	view.legal_moves = out.legal_moves.data();
+	return view;
+}
+
+void compute_attacks(const PositionBatch& batch, BatchResult& out, BatchPath path) {
+	assert(batch_path_supported(path));
+	size_t count = batch.count;
+	for (int white = 0; white < 2; white++) {
+		out.attacks[white].resize(count);
+		out.in_check[white].resize(count);
+	}
+	BatchView view = make_view(batch, out);
+	// Whole registers go through the SIMD kernel, the rest through the scalar one
+	size_t simd_end = 0;
+	if (path == BatchAVX2) {
+		simd_end = count - count % 4;
+		compute_attacks_avx2(view, 0, simd_end);
+	}
+	else if (path == BatchAVX512) {
+		simd_end = count - count % 8;
+		compute_attacks_avx512(view, 0, simd_end);
+	}
+	attack_kernel<ScalarOps>(view, simd_end, count);
+
+	for (size_t i = 0; i < count; i++) {
+		out.in_check[0][i] = (batch.pieces[0][ChessBoard::King][i] & out.attacks[1][i]) != 0;
+		out.in_check[1][i] = (batch.pieces[1][ChessBoard::King][i] & out.attacks[0][i]) != 0;
+	}
+}
+
+void count_legal_moves(const PositionBatch& batch, const ChessBoard* boards, BatchResult& out, BatchPath path) {
+	assert(batch_path_supported(path));
+	size_t count = batch.count;
+	out.legal_moves.resize(count);
+	BatchView view = make_view(batch, out);
+	size_t simd_end = 0;
+	if (path == BatchAVX2) {
+		simd_end = count - count % 4;
+		count_legal_moves_avx2(view, 0, simd_end);
+	}
+	else if (path == BatchAVX512) {
+		simd_end = count - count % 8;
+		count_legal_moves_avx512(view, 0, simd_end);
+	}
+	legal_move_kernel<ScalarOps>(view, simd_end, count);
+
+	// Legality of en passant, and of a black pawn stepping in front of the pawn
+	// that just moved two, is tried with do_move, which takes that pawn off the
+	// board. Positions with an own pawn on the files around it go through the
+	// rules, as do those without exactly one king to move.
+	for (size_t i = 0; i < count; i++) {
+		int white = batch.white_to_move[i] != 0;
+		uint64_t files = 0;
+		if (batch.en_passant[i]) {
+			files = 0x0101010101010101ull << (std::countr_zero(batch.en_passant[i]) % 8);
+			files |= ((files << 1) & not_a_file) | ((files >> 1) & not_h_file);
+		}
+		if ((batch.pieces[white][ChessBoard::Pawn][i] & files) || std::popcount(batch.pieces[white][ChessBoard::King][i]) != 1) {
+			Move moves[MAX_MOVES];
+			out.legal_moves[i] = (uint16_t)get_all_valid_moves(boards[i], moves);
+		}
+	}
+}
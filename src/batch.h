@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chess.h"
+
+// Bulk queries over many independent positions, for dataset work where the
+// per position overhead of the rules functions dominates. Positions are
+// stored as bitboards (bit n = square n, a8 = 0) in struct of arrays layout
+// so a SIMD register holds the same bitboard of 4 or 8 positions.
+
+struct PositionBatch {
+	size_t count{};
+	// [color == White][type], index None holds every piece of that color
+	std::vector<uint64_t> pieces[2][7];
+	// All ones when white is to move
+	std::vector<uint64_t> white_to_move;
+	// Corner squares of the rooks that may still castle, both colors
+	std::vector<uint64_t> castling;
+	// The pawn that just moved two squares, as ChessBoard::en_passant_target
+	std::vector<uint64_t> en_passant;
+};
+
+struct BatchResult {
+	// Squares attacked by [color == White], including squares holding own pieces
+	std::vector<uint64_t> attacks[2];
+	// Whether the king of [color == White] is attacked, false without a king
+	std::vector<uint8_t> in_check[2];
+	// Number of legal moves for the side to move, each promotion piece counts
+	std::vector<uint16_t> legal_moves;
+};
+
+enum BatchPath {
+	BatchScalar,
+	BatchAVX2,
+	BatchAVX512,
+};
+
+const char* batch_path_name(BatchPath path);
+bool batch_path_supported(BatchPath path);
+// Widest path the CPU supports
+BatchPath best_batch_path();
+
+void load_batch(PositionBatch& batch, const ChessBoard* boards, size_t count);
+// Fills attacks and in_check, asserts if path isn't supported
+void compute_attacks(const PositionBatch& batch, BatchResult& out, BatchPath path);
+// Fills legal_moves, asserts if path isn't supported. boards are the ones the
+// batch was loaded from, positions the kernel can't count go through chess.h.
+void count_legal_moves(const PositionBatch& batch, const ChessBoard* boards, BatchResult& out, BatchPath path);
@@ -0,0 +1,35 @@
+// Built with AVX2 enabled, only called after a runtime check
+#include <immintrin.h>
+#include "batch_kernel.h"
+
+struct Avx2Ops {
+	using V = __m256i;
+	static constexpr int lanes = 4;
+	static V load(const uint64_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static void store(uint64_t* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static V set1(uint64_t x) { return _mm256_set1_epi64x((long long)x); }
+	static V band(V a, V b) { return _mm256_and_si256(a, b); }
+	static V bor(V a, V b) { return _mm256_or_si256(a, b); }
+	static V bandnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+	template<int N> static V shl(V v) { return _mm256_slli_epi64(v, N); }
+	template<int N> static V shr(V v) { return _mm256_srli_epi64(v, N); }
+	static V add(V a, V b) { return _mm256_add_epi64(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_epi64(a, b); }
+	// All ones in lanes that aren't zero
+	static V nonzero(V v) { return _mm256_xor_si256(_mm256_cmpeq_epi64(v, _mm256_setzero_si256()), _mm256_set1_epi64x(-1)); }
+	// Bits of every nibble from a table, then summed per lane
+	static V popcount(V v) {
+		const V table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const V low = _mm256_set1_epi8(0x0f);
+		V bits = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, low)), _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+		return _mm256_sad_epu8(bits, _mm256_setzero_si256());
+	}
+};
+
+void compute_attacks_avx2(const BatchView& batch, size_t begin, size_t end) {
+	attack_kernel<Avx2Ops>(batch, begin, end);
+}
+
+void count_legal_moves_avx2(const BatchView& batch, size_t begin, size_t end) {
+	legal_move_kernel<Avx2Ops>(batch, begin, end);
+}
@@ -0,0 +1,38 @@
+// Built with AVX-512F enabled, only called after a runtime check
+#include <immintrin.h>
+#include "batch_kernel.h"
+
+struct Avx512Ops {
+	using V = __m512i;
+	static constexpr int lanes = 8;
+	static V load(const uint64_t* p) { return _mm512_loadu_si512(p); }
+	static void store(uint64_t* p, V v) { _mm512_storeu_si512(p, v); }
+	static V set1(uint64_t x) { return _mm512_set1_epi64((long long)x); }
+	static V band(V a, V b) { return _mm512_and_si512(a, b); }
+	static V bor(V a, V b) { return _mm512_or_si512(a, b); }
+	static V bandnot(V a, V b) { return _mm512_andnot_si512(a, b); }
+	template<int N> static V shl(V v) { return _mm512_slli_epi64(v, N); }
+	template<int N> static V shr(V v) { return _mm512_srli_epi64(v, N); }
+	static V add(V a, V b) { return _mm512_add_epi64(a, b); }
+	static V sub(V a, V b) { return _mm512_sub_epi64(a, b); }
+	// All ones in lanes that aren't zero
+	static V nonzero(V v) { return _mm512_maskz_mov_epi64(_mm512_test_epi64_mask(v, v), _mm512_set1_epi64(-1)); }
+	// Without VPOPCNTDQ or BW the bits are summed in ever wider fields
+	static V popcount(V v) {
+		v = _mm512_sub_epi64(v, _mm512_and_si512(_mm512_srli_epi64(v, 1), _mm512_set1_epi64(0x5555555555555555ll)));
+		v = _mm512_add_epi64(_mm512_and_si512(v, _mm512_set1_epi64(0x3333333333333333ll)), _mm512_and_si512(_mm512_srli_epi64(v, 2), _mm512_set1_epi64(0x3333333333333333ll)));
+		v = _mm512_and_si512(_mm512_add_epi64(v, _mm512_srli_epi64(v, 4)), _mm512_set1_epi64(0x0f0f0f0f0f0f0f0fll));
+		v = _mm512_add_epi64(v, _mm512_srli_epi64(v, 8));
+		v = _mm512_add_epi64(v, _mm512_srli_epi64(v, 16));
+		v = _mm512_add_epi64(v, _mm512_srli_epi64(v, 32));
+		return _mm512_and_si512(v, _mm512_set1_epi64(0x7f));
+	}
+};
+
+void compute_attacks_avx512(const BatchView& batch, size_t begin, size_t end) {
+	attack_kernel<Avx512Ops>(batch, begin, end);
+}
+
+void count_legal_moves_avx512(const BatchView& batch, size_t begin, size_t end) {
+	legal_move_kernel<Avx512Ops>(batch, begin, end);
+}
@@ -0,0 +1,281 @@
+#pragma once
+#include "batch.h"
+
+// Attack map and legal move kernels shared by the batch paths. Ops wraps one
+// register type (a plain uint64_t or a SIMD register of Ops::lanes bitboards),
+// every translation unit including this instantiates them for its own
+// instruction set.
+
+// Raw pointers into a batch, the SIMD translation units must not instantiate
+// any shared inline code like std::vector members with their wider instruction set
+struct BatchView {
+	const uint64_t* pieces[2][7];
+	const uint64_t* white_to_move;
+	const uint64_t* castling;
+	uint64_t* attacks[2];
+	uint16_t* legal_moves;
+};
+
+constexpr uint64_t not_a_file = 0xfefefefefefefefeull;
+constexpr uint64_t not_h_file = 0x7f7f7f7f7f7f7f7full;
+constexpr uint64_t not_ab_files = 0xfcfcfcfcfcfcfcfcull;
+constexpr uint64_t not_gh_files = 0x3f3f3f3f3f3f3f3full;
+constexpr uint64_t all_squares = ~0ull;
+constexpr uint64_t last_ranks = 0xff000000000000ffull;
+
+// Kogge-Stone occluded fill from gen over empty squares towards higher indices
+// by S, then one more step to include the blocker. wrap drops squares that
+// crossed the edge of the board.
+template<class Ops, int S>
+typename Ops::V fill_up(typename Ops::V gen, typename Ops::V empty, typename Ops::V wrap) {
+	auto pro = Ops::band(empty, wrap);
+	gen = Ops::bor(gen, Ops::band(pro, Ops::template shl<S>(gen)));
+	pro = Ops::band(pro, Ops::template shl<S>(pro));
+	gen = Ops::bor(gen, Ops::band(pro, Ops::template shl<2 * S>(gen)));
+	pro = Ops::band(pro, Ops::template shl<2 * S>(pro));
+	gen = Ops::bor(gen, Ops::band(pro, Ops::template shl<4 * S>(gen)));
+	return Ops::band(Ops::template shl<S>(gen), wrap);
+}
+
+// Same towards lower indices
+template<class Ops, int S>
+typename Ops::V fill_down(typename Ops::V gen, typename Ops::V empty, typename Ops::V wrap) {
+	auto pro = Ops::band(empty, wrap);
+	gen = Ops::bor(gen, Ops::band(pro, Ops::template shr<S>(gen)));
+	pro = Ops::band(pro, Ops::template shr<S>(pro));
+	gen = Ops::bor(gen, Ops::band(pro, Ops::template shr<2 * S>(gen)));
+	pro = Ops::band(pro, Ops::template shr<2 * S>(pro));
+	gen = Ops::bor(gen, Ops::band(pro, Ops::template shr<4 * S>(gen)));
+	return Ops::band(Ops::template shr<S>(gen), wrap);
+}
+
+// Attacks of one side, white pawns move towards lower indices
+template<class Ops>
+typename Ops::V side_attacks(const BatchView& batch, int white, size_t i, typename Ops::V empty) {
+	using V = typename Ops::V;
+	const uint64_t* const* pieces = batch.pieces[white];
+	V a_wrap = Ops::set1(not_a_file), h_wrap = Ops::set1(not_h_file);
+	V ab_wrap = Ops::set1(not_ab_files), gh_wrap = Ops::set1(not_gh_files);
+	V all = Ops::set1(all_squares);
+
+	V pawns = Ops::load(pieces[ChessBoard::Pawn] + i);
+	V att = white ?
+		Ops::bor(Ops::band(Ops::template shr<9>(pawns), h_wrap), Ops::band(Ops::template shr<7>(pawns), a_wrap)) :
+		Ops::bor(Ops::band(Ops::template shl<7>(pawns), h_wrap), Ops::band(Ops::template shl<9>(pawns), a_wrap));
+
+	V n = Ops::load(pieces[ChessBoard::Knight] + i);
+	att = Ops::bor(att, Ops::band(Ops::bor(Ops::template shl<17>(n), Ops::template shr<15>(n)), a_wrap));
+	att = Ops::bor(att, Ops::band(Ops::bor(Ops::template shl<15>(n), Ops::template shr<17>(n)), h_wrap));
+	att = Ops::bor(att, Ops::band(Ops::bor(Ops::template shl<10>(n), Ops::template shr<6>(n)), ab_wrap));
+	att = Ops::bor(att, Ops::band(Ops::bor(Ops::template shl<6>(n), Ops::template shr<10>(n)), gh_wrap));
+
+	V k = Ops::load(pieces[ChessBoard::King] + i);
+	att = Ops::bor(att, Ops::bor(Ops::template shl<8>(k), Ops::template shr<8>(k)));
+	att = Ops::bor(att, Ops::band(Ops::bor(Ops::bor(Ops::template shl<1>(k), Ops::template shl<9>(k)), Ops::template shr<7>(k)), a_wrap));
+	att = Ops::bor(att, Ops::band(Ops::bor(Ops::bor(Ops::template shr<1>(k), Ops::template shr<9>(k)), Ops::template shl<7>(k)), h_wrap));
+
+	V queens = Ops::load(pieces[ChessBoard::Queen] + i);
+	V rooks = Ops::bor(Ops::load(pieces[ChessBoard::Rook] + i), queens);
+	V bishops = Ops::bor(Ops::load(pieces[ChessBoard::Bishop] + i), queens);
+	att = Ops::bor(att, fill_up<Ops, 1>(rooks, empty, a_wrap));
+	att = Ops::bor(att, fill_down<Ops, 1>(rooks, empty, h_wrap));
+	att = Ops::bor(att, fill_up<Ops, 8>(rooks, empty, all));
+	att = Ops::bor(att, fill_down<Ops, 8>(rooks, empty, all));
+	att = Ops::bor(att, fill_up<Ops, 9>(bishops, empty, a_wrap));
+	att = Ops::bor(att, fill_up<Ops, 7>(bishops, empty, h_wrap));
+	att = Ops::bor(att, fill_down<Ops, 7>(bishops, empty, a_wrap));
+	att = Ops::bor(att, fill_down<Ops, 9>(bishops, empty, h_wrap));
+	return att;
+}
+
+// Positions [begin, end), end - begin must be a multiple of Ops::lanes
+template<class Ops>
+void attack_kernel(const BatchView& batch, size_t begin, size_t end) {
+	using V = typename Ops::V;
+	for (size_t i = begin; i < end; i += Ops::lanes) {
+		V occupied = Ops::bor(Ops::load(batch.pieces[0][ChessBoard::None] + i), Ops::load(batch.pieces[1][ChessBoard::None] + i));
+		V empty = Ops::bandnot(occupied, Ops::set1(all_squares));
+		Ops::store(batch.attacks[0] + i, side_attacks<Ops>(batch, 0, i, empty));
+		Ops::store(batch.attacks[1] + i, side_attacks<Ops>(batch, 1, i, empty));
+	}
+}
+
+template<class Ops>
+typename Ops::V select(typename Ops::V mask, typename Ops::V a, typename Ops::V b) {
+	return Ops::bor(Ops::band(mask, a), Ops::bandnot(mask, b));
+}
+
+template<class Ops, int S, bool Up>
+typename Ops::V shift(typename Ops::V v, typename Ops::V wrap) {
+	if constexpr (Up)
+		return Ops::band(Ops::template shl<S>(v), wrap);
+	else
+		return Ops::band(Ops::template shr<S>(v), wrap);
+}
+
+template<class Ops, int S, bool Up>
+typename Ops::V fill(typename Ops::V gen, typename Ops::V empty, typename Ops::V wrap) {
+	if constexpr (Up)
+		return fill_up<Ops, S>(gen, empty, wrap);
+	else
+		return fill_down<Ops, S>(gen, empty, wrap);
+}
+
+// Looks from the king along one direction. The ray up to a checking slider is
+// added to evasions, an own piece with such a slider behind it to pinned.
+template<class Ops, int S, bool Up>
+void king_ray(typename Ops::V king, typename Ops::V own, typename Ops::V sliders, typename Ops::V empty, typename Ops::V wrap,
+		typename Ops::V& evasions, typename Ops::V& pinned) {
+	auto ray = fill<Ops, S, Up>(king, empty, wrap);
+	evasions = Ops::bor(evasions, Ops::band(ray, Ops::nonzero(Ops::band(ray, sliders))));
+	auto blocker = Ops::band(ray, own);
+	auto behind = fill<Ops, S, Up>(blocker, empty, wrap);
+	pinned = Ops::bor(pinned, Ops::band(blocker, Ops::nonzero(Ops::band(behind, sliders))));
+}
+
+// Moves of movers along one direction. No square is reached by two of them,
+// the fill stops at the first, so the count is the number of moves.
+template<class Ops, int S, bool Up>
+typename Ops::V slider_moves(typename Ops::V movers, typename Ops::V empty, typename Ops::V wrap, typename Ops::V targets) {
+	return Ops::popcount(Ops::band(fill<Ops, S, Up>(movers, empty, wrap), targets));
+}
+
+template<class Ops, int S, bool Up>
+typename Ops::V knight_moves(typename Ops::V knights, typename Ops::V wrap, typename Ops::V targets) {
+	return Ops::popcount(Ops::band(shift<Ops, S, Up>(knights, wrap), targets));
+}
+
+// A pawn move onto the last rank counts once per promotion piece
+template<class Ops>
+typename Ops::V pawn_moves(typename Ops::V to) {
+	auto promotions = Ops::popcount(Ops::band(to, Ops::set1(last_ranks)));
+	return Ops::add(Ops::popcount(to), Ops::add(promotions, Ops::add(promotions, promotions)));
+}
+
+// Legal move counts of the side to move by direction wise fills, the way
+// get_all_valid_moves counts them, except for en passant: count_legal_moves
+// hands positions where it could matter to the rules. Needs one own king.
+// Positions [begin, end), end - begin must be a multiple of Ops::lanes.
+template<class Ops>
+void legal_move_kernel(const BatchView& batch, size_t begin, size_t end) {
+	using V = typename Ops::V;
+	V a_wrap = Ops::set1(not_a_file), h_wrap = Ops::set1(not_h_file);
+	V ab_wrap = Ops::set1(not_ab_files), gh_wrap = Ops::set1(not_gh_files);
+	V all = Ops::set1(all_squares), zero = Ops::set1(0);
+	for (size_t i = begin; i < end; i += Ops::lanes) {
+		V white = Ops::load(batch.white_to_move + i);
+		V own[7], enemy[7];
+		for (int type = 0; type < 7; type++) {
+			V w = Ops::load(batch.pieces[1][type] + i), b = Ops::load(batch.pieces[0][type] + i);
+			own[type] = select<Ops>(white, w, b);
+			enemy[type] = select<Ops>(white, b, w);
+		}
+		V occupied = Ops::bor(own[ChessBoard::None], enemy[ChessBoard::None]);
+		V empty = Ops::bandnot(occupied, all);
+		V king = own[ChessBoard::King];
+
+		// Enemy attacks as the board stands decide castling, the king itself
+		// mustn't block them for its other moves
+		V white_king = Ops::load(batch.pieces[1][ChessBoard::King] + i);
+		V black_king = Ops::load(batch.pieces[0][ChessBoard::King] + i);
+		V attacked = select<Ops>(white, side_attacks<Ops>(batch, 0, i, empty), side_attacks<Ops>(batch, 1, i, empty));
+		V attacked_through_king = select<Ops>(white,
+			side_attacks<Ops>(batch, 0, i, Ops::bor(empty, white_king)),
+			side_attacks<Ops>(batch, 1, i, Ops::bor(empty, black_king)));
+
+		// Checks and pins, kept apart by line so a pinned piece can still move along its pin
+		V rooks = Ops::bor(enemy[ChessBoard::Rook], enemy[ChessBoard::Queen]);
+		V bishops = Ops::bor(enemy[ChessBoard::Bishop], enemy[ChessBoard::Queen]);
+		V evasions = zero, pin_rank = zero, pin_file = zero, pin_diag9 = zero, pin_diag7 = zero;
+		king_ray<Ops, 1, true>(king, own[ChessBoard::None], rooks, empty, a_wrap, evasions, pin_rank);
+		king_ray<Ops, 1, false>(king, own[ChessBoard::None], rooks, empty, h_wrap, evasions, pin_rank);
+		king_ray<Ops, 8, true>(king, own[ChessBoard::None], rooks, empty, all, evasions, pin_file);
+		king_ray<Ops, 8, false>(king, own[ChessBoard::None], rooks, empty, all, evasions, pin_file);
+		king_ray<Ops, 9, true>(king, own[ChessBoard::None], bishops, empty, a_wrap, evasions, pin_diag9);
+		king_ray<Ops, 9, false>(king, own[ChessBoard::None], bishops, empty, h_wrap, evasions, pin_diag9);
+		king_ray<Ops, 7, true>(king, own[ChessBoard::None], bishops, empty, h_wrap, evasions, pin_diag7);
+		king_ray<Ops, 7, false>(king, own[ChessBoard::None], bishops, empty, a_wrap, evasions, pin_diag7);
+		V knight_squares =
+			Ops::bor(Ops::bor(shift<Ops, 17, true>(king, a_wrap), shift<Ops, 15, false>(king, a_wrap)),
+			Ops::bor(Ops::bor(shift<Ops, 15, true>(king, h_wrap), shift<Ops, 17, false>(king, h_wrap)),
+			Ops::bor(Ops::bor(shift<Ops, 10, true>(king, ab_wrap), shift<Ops, 6, false>(king, ab_wrap)),
+			Ops::bor(shift<Ops, 6, true>(king, gh_wrap), shift<Ops, 10, false>(king, gh_wrap)))));
+		V pawn_squares = select<Ops>(white,
+			Ops::bor(shift<Ops, 9, false>(king, h_wrap), shift<Ops, 7, false>(king, a_wrap)),
+			Ops::bor(shift<Ops, 7, true>(king, h_wrap), shift<Ops, 9, true>(king, a_wrap)));
+		V checkers = Ops::bor(Ops::band(evasions, enemy[ChessBoard::None]),
+			Ops::bor(Ops::band(knight_squares, enemy[ChessBoard::Knight]), Ops::band(pawn_squares, enemy[ChessBoard::Pawn])));
+		evasions = Ops::bor(evasions, checkers);
+		// Anywhere out of check, nowhere in double check
+		V double_check = Ops::nonzero(Ops::band(checkers, Ops::sub(checkers, Ops::set1(1))));
+		V targets = Ops::bor(Ops::bandnot(Ops::nonzero(checkers), all), evasions);
+		targets = Ops::bandnot(Ops::bor(double_check, own[ChessBoard::None]), targets);
+		V free = Ops::bandnot(Ops::bor(Ops::bor(pin_rank, pin_file), Ops::bor(pin_diag9, pin_diag7)), all);
+
+		V own_rooks = Ops::bor(own[ChessBoard::Rook], own[ChessBoard::Queen]);
+		V own_bishops = Ops::bor(own[ChessBoard::Bishop], own[ChessBoard::Queen]);
+		V movers = Ops::band(own_rooks, Ops::bor(free, pin_rank));
+		V count = slider_moves<Ops, 1, true>(movers, empty, a_wrap, targets);
+		count = Ops::add(count, slider_moves<Ops, 1, false>(movers, empty, h_wrap, targets));
+		movers = Ops::band(own_rooks, Ops::bor(free, pin_file));
+		count = Ops::add(count, slider_moves<Ops, 8, true>(movers, empty, all, targets));
+		count = Ops::add(count, slider_moves<Ops, 8, false>(movers, empty, all, targets));
+		movers = Ops::band(own_bishops, Ops::bor(free, pin_diag9));
+		count = Ops::add(count, slider_moves<Ops, 9, true>(movers, empty, a_wrap, targets));
+		count = Ops::add(count, slider_moves<Ops, 9, false>(movers, empty, h_wrap, targets));
+		movers = Ops::band(own_bishops, Ops::bor(free, pin_diag7));
+		count = Ops::add(count, slider_moves<Ops, 7, true>(movers, empty, h_wrap, targets));
+		count = Ops::add(count, slider_moves<Ops, 7, false>(movers, empty, a_wrap, targets));
+
+		// A pinned knight never stays on its line
+		V knights = Ops::band(own[ChessBoard::Knight], free);
+		count = Ops::add(count, knight_moves<Ops, 17, true>(knights, a_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 15, false>(knights, a_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 15, true>(knights, h_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 17, false>(knights, h_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 10, true>(knights, ab_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 6, false>(knights, ab_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 6, true>(knights, gh_wrap, targets));
+		count = Ops::add(count, knight_moves<Ops, 10, false>(knights, gh_wrap, targets));
+
+		// White pawns move towards lower indices
+		V pawns = Ops::band(own[ChessBoard::Pawn], Ops::bor(free, pin_file));
+		V single = Ops::band(select<Ops>(white, Ops::template shr<8>(pawns), Ops::template shl<8>(pawns)), empty);
+		V third_rank = Ops::band(single, select<Ops>(white, Ops::set1(0xffull << 40), Ops::set1(0xffull << 16)));
+		V double_push = Ops::band(select<Ops>(white, Ops::template shr<8>(third_rank), Ops::template shl<8>(third_rank)), empty);
+		count = Ops::add(count, pawn_moves<Ops>(Ops::band(single, targets)));
+		count = Ops::add(count, Ops::popcount(Ops::band(double_push, targets)));
+		V captures = Ops::band(targets, enemy[ChessBoard::None]);
+		pawns = Ops::band(own[ChessBoard::Pawn], Ops::bor(free, pin_diag9));
+		V to = select<Ops>(white, shift<Ops, 9, false>(pawns, h_wrap), shift<Ops, 9, true>(pawns, a_wrap));
+		count = Ops::add(count, pawn_moves<Ops>(Ops::band(to, captures)));
+		pawns = Ops::band(own[ChessBoard::Pawn], Ops::bor(free, pin_diag7));
+		to = select<Ops>(white, shift<Ops, 7, false>(pawns, a_wrap), shift<Ops, 7, true>(pawns, h_wrap));
+		count = Ops::add(count, pawn_moves<Ops>(Ops::band(to, captures)));
+
+		V king_squares =
+			Ops::bor(Ops::bor(shift<Ops, 1, true>(king, a_wrap), shift<Ops, 1, false>(king, h_wrap)),
+			Ops::bor(Ops::bor(shift<Ops, 8, true>(king, all), shift<Ops, 8, false>(king, all)),
+			Ops::bor(Ops::bor(shift<Ops, 9, true>(king, a_wrap), shift<Ops, 9, false>(king, h_wrap)),
+			Ops::bor(shift<Ops, 7, true>(king, h_wrap), shift<Ops, 7, false>(king, a_wrap)))));
+		count = Ops::add(count, Ops::popcount(Ops::bandnot(Ops::bor(own[ChessBoard::None], attacked_through_king), king_squares)));
+
+		// Like get_king_moves the rook must stand in its corner and only the
+		// square the king lands on must be safe, checks don't prevent castling
+		V castling = Ops::band(Ops::load(batch.castling + i), own[ChessBoard::Rook]);
+		V home = Ops::nonzero(Ops::band(king, select<Ops>(white, Ops::set1(1ull << 60), Ops::set1(1ull << 4))));
+		V to_g = select<Ops>(white, Ops::set1(1ull << 62), Ops::set1(1ull << 6));
+		V king_side = Ops::band(home, Ops::nonzero(Ops::band(castling, select<Ops>(white, Ops::set1(1ull << 63), Ops::set1(1ull << 7)))));
+		king_side = Ops::bandnot(Ops::nonzero(Ops::band(occupied, select<Ops>(white, Ops::set1(0x3ull << 61), Ops::set1(0x3ull << 5)))), king_side);
+		count = Ops::add(count, Ops::popcount(Ops::bandnot(attacked, Ops::band(king_side, to_g))));
+		V to_c = select<Ops>(white, Ops::set1(1ull << 58), Ops::set1(1ull << 2));
+		V queen_side = Ops::band(home, Ops::nonzero(Ops::band(castling, select<Ops>(white, Ops::set1(1ull << 56), Ops::set1(1ull << 0)))));
+		queen_side = Ops::bandnot(Ops::nonzero(Ops::band(occupied, select<Ops>(white, Ops::set1(0x7ull << 57), Ops::set1(0x7ull << 1)))), queen_side);
+		count = Ops::add(count, Ops::popcount(Ops::bandnot(attacked, Ops::band(queen_side, to_c))));
+
+		uint64_t counts[Ops::lanes];
+		Ops::store(counts, count);
+		for (int lane = 0; lane < Ops::lanes; lane++)
+			batch.legal_moves[i + lane] = (uint16_t)counts[lane];
+	}
+}
@@ -0,0 +1,802 @@
+#include "chess.h"
+#include "tables.h"
+#include "profile.h"
+#include <cstring>
+
+ChessBoard::Color get_color(const ChessBoard& brd, Position p) {
+	ChessBoard::Color color = (ChessBoard::Color)(brd.pieces[p.p] & ChessBoard::COLOR_BIT);
+	return color;
+}
+ChessBoard::PieceType get_type(const ChessBoard& brd, Position p) {
+	ChessBoard::PieceType type = (ChessBoard::PieceType)(brd.pieces[p.p] & ChessBoard::PIECE_BITS);
+	return type;
+}
+int get_piece(const ChessBoard& brd, Position p) {
+	return brd.pieces[p.p];
+}
+
+void init_fen(ChessBoard& brd, const char* fen) {
+	PROFILE_SCOPE("init_fen");
+	brd.selected = -1;
+	for (int i = 0; i < 8 * 8; i++) {
+		brd.pieces[i] = ChessBoard::None;
+	}
+	int len = strlen(fen);
+	int i = 0;
+	int cursor = 0;
+	// Board state, up to the space that ends the placement. Squares past h1
+	// are ignored, is_valid_fen rejects such placements.
+	for (; i < len && fen[i] != ' '; i++) {
+		char c = fen[i];
+		if (cursor >= 64) {
+			continue;
+		}
+		// 'PNBRQK'
+		if (c == 'P') {
+			brd.pieces[cursor++] = ChessBoard::Pawn | ChessBoard::White;
+		}
+		else if (c == 'N') {
+			brd.pieces[cursor++] = ChessBoard::Knight | ChessBoard::White;
+		}
+		else if (c == 'B') {
+			brd.pieces[cursor++] = ChessBoard::Bishop | ChessBoard::White;
+		}
+		else if (c == 'R') {
+			brd.pieces[cursor++] = ChessBoard::Rook | ChessBoard::White;
+		}
+		else if (c == 'Q') {
+			brd.pieces[cursor++] = ChessBoard::Queen | ChessBoard::White;
+		}
+		else if (c == 'K') {
+			brd.white_king_position = cursor;
+			brd.pieces[cursor++] = ChessBoard::King | ChessBoard::White;
+		}
+		else if (c == 'p') {
+			brd.pieces[cursor++] = ChessBoard::Pawn | ChessBoard::Black;
+		}
+		else if (c == 'n') {
+			brd.pieces[cursor++] = ChessBoard::Knight | ChessBoard::Black;
+		}
+		else if (c == 'b') {
+			brd.pieces[cursor++] = ChessBoard::Bishop | ChessBoard::Black;
+		}
+		else if (c == 'r') {
+			brd.pieces[cursor++] = ChessBoard::Rook | ChessBoard::Black;
+		}
+		else if (c == 'q') {
+			brd.pieces[cursor++] = ChessBoard::Queen | ChessBoard::Black;
+		}
+		else if (c == 'k') {
+			brd.black_king_position = cursor;
+			brd.pieces[cursor++] = ChessBoard::King | ChessBoard::Black;
+		}
+		else if (c == '/') {
+			cursor = (cursor - cursor % 8);
+		}
+		else {
+			cursor += (c - '0');
+		}
+	}
+	// Turn, i is at the space after the placement
+	char turn = i < len ? fen[i + 1] : '\0';
+	if (turn == 'w') {
+		brd.current_turn = ChessBoard::White;
+	}
+	else if (turn == 'b') {
+		brd.current_turn = ChessBoard::Black;
+	}
+	else {
+		assert(false);
+	}
+	// Castling availability
+	const char* castling = fen + i + 1 + 2;
+	auto parse_castling = [&](char c) {
+		switch (c) {
+		case 'K': brd.white_king_side = true; return true;
+		case 'Q': brd.white_queen_side = true; return true;
+		case 'k': brd.black_king_side = true; return true;
+		case 'q': brd.black_queen_side = true; return true;
+		}
+		assert(false);
+		return false;
+	};
+	brd.black_king_side = false;
+	brd.black_queen_side = false;
+	brd.white_king_side = false;
+	brd.white_queen_side = false;
+
+	const char* en_passant_target = castling + 1;
+	if (castling[0] == '-') { en_passant_target += 1; } // No castling
+	else if(parse_castling(castling[0]) && 
+			castling[1] == ' ') { en_passant_target += 1; }
+	else if(parse_castling(castling[0]) && 
+			parse_castling(castling[1]) && 
+			castling[2] == ' ') { en_passant_target += 2; }
+	else if(parse_castling(castling[0]) && 
+			parse_castling(castling[1]) && 
+			parse_castling(castling[2]) && 
+			castling[3] == ' ') { en_passant_target += 3; }
+	else if(parse_castling(castling[0]) && 
+			parse_castling(castling[1]) && 
+			parse_castling(castling[2]) && 
+			parse_castling(castling[3]) && 
+			castling[4] == ' ') { en_passant_target += 4; }
+	else {
+		assert(false);
+	}
+
+	if (en_passant_target[0] != '-') {
+		// FEN names the square behind the pawn, the board tracks the pawn itself like do_move does
+		char x = en_passant_target[0] - 'a';
+		char y = '8' - en_passant_target[1];
+		brd.en_passant_target = x + y * 8 + (brd.current_turn == ChessBoard::White ? Up : Down);
+	}
+	else {
+		brd.en_passant_target = -1;
+	}
+
+	return;
+}
+
+bool is_valid_fen(const char* fen) {
+	int rank = 0, file = 0, white_kings = 0, black_kings = 0;
+	// Packed positions have room for 16 pieces per side
+	int white_pieces = 0, black_pieces = 0, white_pawns = 0, black_pawns = 0;
+	const char* p = fen;
+	for (; *p && *p != ' '; p++) {
+		if (*p == '/') {
+			if (file != 8)
+				return false;
+			rank++;
+			file = 0;
+		}
+		else if (*p >= '1' && *p <= '8')
+			file += *p - '0';
+		else if (strchr("PNBRQKpnbrqk", *p)) {
+			white_kings += *p == 'K';
+			black_kings += *p == 'k';
+			white_pawns += *p == 'P';
+			black_pawns += *p == 'p';
+			(*p >= 'a' ? black_pieces : white_pieces)++;
+			// Pawns never stand on the first or last rank
+			if ((*p == 'P' || *p == 'p') && (rank == 0 || rank == 7))
+				return false;
+			file++;
+		}
+		else
+			return false;
+		if (file > 8)
+			return false;
+	}
+	if (rank != 7 || file != 8 || white_kings != 1 || black_kings != 1)
+		return false;
+	if (white_pieces > 16 || black_pieces > 16 || white_pawns > 8 || black_pawns > 8)
+		return false;
+	if (p[0] != ' ' || (p[1] != 'w' && p[1] != 'b') || p[2] != ' ')
+		return false;
+	char fen_side = p[1];
+	p += 3;
+	if (*p == '-')
+		p++;
+	else {
+		const char* castling = p;
+		while (*p && strchr("KQkq", *p))
+			p++;
+		if (p == castling || p - castling > 4)
+			return false;
+	}
+	if (*p++ != ' ')
+		return false;
+	if (*p == '-')
+		return true;
+	return p[0] >= 'a' && p[0] <= 'h' && p[1] == (fen_side == 'w' ? '6' : '3');
+}
+
+bool settle_position(ChessBoard& brd) {
+	auto at_home = [&](int sq, int piece) { return get_piece(brd, sq) == piece; };
+	int white_king = ChessBoard::King | ChessBoard::White, white_rook = ChessBoard::Rook | ChessBoard::White;
+	int black_king = ChessBoard::King | ChessBoard::Black, black_rook = ChessBoard::Rook | ChessBoard::Black;
+	brd.white_king_side &= at_home(60, white_king) && at_home(63, white_rook);
+	brd.white_queen_side &= at_home(60, white_king) && at_home(56, white_rook);
+	brd.black_king_side &= at_home(4, black_king) && at_home(7, black_rook);
+	brd.black_queen_side &= at_home(4, black_king) && at_home(0, black_rook);
+	ChessBoard::Color other = brd.current_turn == ChessBoard::White ? ChessBoard::Black : ChessBoard::White;
+	if (is_in_check(brd, other))
+		return false;
+	brd.is_check = is_in_check(brd, brd.current_turn);
+	return true;
+}
+
+void init(ChessBoard& brd) {
+	brd = ChessBoard{};
+	init_fen(brd, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+}
+bool in_range(int val, int min_inc, int max_ex) {
+	return (val >= min_inc) && (val < max_ex);
+}
+
+bool is_empty(const ChessBoard& brd, Position p) {
+	return get_type(brd, p) == ChessBoard::None;
+};
+
+bool is_enemy(const ChessBoard& brd, Position self, Position p) {
+	return get_color(brd, self) != get_color(brd, p) && !is_empty(brd, p);
+};
+
+
+bool is_enemy_or_empty(const ChessBoard& brd, int self, int p) {
+	return is_enemy(brd, self, p) || is_empty(brd, p);
+};
+
+bool is_own(const ChessBoard& brd, int self, int p) {
+	return
+		get_color(brd, self) == get_color(brd, p) &&
+		get_type(brd, self) != ChessBoard::None &&
+		get_type(brd, p) != ChessBoard::None;
+};
+
+bool resolves_check(const ChessBoard& brd, Position pos, Position target) {
+	PROFILE_COUNT("board_copy");
+	ChessBoard copy = brd;
+	do_move(copy, pos, target);
+	return !is_in_check(copy, brd.current_turn);
+};
+
+bool causes_check_on_self(const ChessBoard& brd, Position pos, Position target) {
+	PROFILE_COUNT("board_copy");
+	ChessBoard copy = brd;
+	do_move(copy, pos, target);
+	return is_in_check(copy, brd.current_turn);
+};
+
+void add_move(const ChessBoard& brd, int* move_list, int& move_count, Position pos, int move) {
+	Position targ = pos.offset(move);
+	if (!is_empty(brd, targ) && (get_color(brd, pos) == get_color(brd, targ))) {
+		return;
+	}
+	assert(move_count < 64);
+	move_list[move_count] = targ.p;
+	move_count += 1;
+};
+
+void get_pawn_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	PROFILE_SCOPE("get_pawn_moves");
+	ChessBoard::Color team = get_color(brd, p);
+	int dir = (team == ChessBoard::Black) ? Up : Down;
+	bool can_move = (dir == Up) ? (p.y() != 7) : (p.y() != 0);
+	bool can_double_move = (dir == Up) ? (p.y() == 1) : (p.y() == 6);
+
+	if (!can_move) {
+		return;
+	}
+	if (is_empty(brd, p.offset(dir))) {
+		add_move(brd, move_list, move_count, p, dir);
+		if (can_double_move && is_empty(brd, p.offset(dir * 2))) {
+			add_move(brd, move_list, move_count, p, dir * 2);
+		}
+	}
+	// Captures, and en passant when the target pawn stands beside us. The two are
+	// added independently, so a square can show up twice like it always has.
+	for (SquareMask targets = pawn_attacks[team == ChessBoard::White][p.p]; targets;) {
+		int target = pop_square(targets);
+		if (is_enemy(brd, p, target)) {
+			add_move(brd, move_list, move_count, p, target - p.p);
+		}
+		if (brd.en_passant_target == target - dir) {
+			add_move(brd, move_list, move_count, p, target - p.p);
+		}
+	}
+};
+void get_knight_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	PROFILE_SCOPE("get_knight_moves");
+	for (SquareMask targets = knight_attacks[p.p]; targets;) {
+		int target = pop_square(targets);
+		if (is_enemy_or_empty(brd, p.p, target))
+			add_move(brd, move_list, move_count, p, target - p.p);
+	}
+};
+// Walks the rays in [first_dir, end_dir) until the first piece, which is taken if it's an enemy
+void get_slider_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p, int first_dir, int end_dir) {
+	for (int d = first_dir; d < end_dir; d++) {
+		int target = p.p;
+		for (int dist = edge_distance[p.p][d]; dist > 0; dist--) {
+			target += direction_offset[d];
+			if (is_empty(brd, target)) {
+				add_move(brd, move_list, move_count, p, target - p.p);
+				continue;
+			}
+			if (is_enemy(brd, p, target)) {
+				add_move(brd, move_list, move_count, p, target - p.p);
+			}
+			break;
+		}
+	}
+}
+void get_bishop_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	PROFILE_SCOPE("get_bishop_moves");
+	get_slider_moves(brd, move_list, move_count, p, DirLeftUp, DirLeft);
+};
+void get_queen_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	PROFILE_SCOPE("get_queen_moves");
+	get_slider_moves(brd, move_list, move_count, p, DirLeftUp, DirDown + 1);
+};
+void get_rook_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	PROFILE_SCOPE("get_rook_moves");
+	get_slider_moves(brd, move_list, move_count, p, DirLeft, DirDown + 1);
+};
+bool squares_empty(const ChessBoard& brd, SquareMask squares) {
+	while (squares) {
+		if (!is_empty(brd, pop_square(squares)))
+			return false;
+	}
+	return true;
+}
+void get_king_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	PROFILE_SCOPE("get_king_moves");
+	for (SquareMask targets = king_attacks[p.p]; targets;) {
+		int target = pop_square(targets);
+		if (is_enemy_or_empty(brd, p.p, target))
+			add_move(brd, move_list, move_count, p, target - p.p);
+	}
+
+	ChessBoard::Color team = get_color(brd, p);
+	int king_row = (team == ChessBoard::White) ? 7 : 0;
+
+	bool can_king_side_castle = 
+		((team == ChessBoard::White) ? brd.white_king_side : brd.black_king_side) &&
+		(p.x() == 4) && (p.y() == king_row) &&
+		(get_piece(brd, Position(7, king_row)) == (ChessBoard::Rook | team)) &&
+		squares_empty(brd, between_mask[p.p][Position(7, king_row).p]);
+
+	bool can_queen_side_castle = 
+		((team == ChessBoard::White) ? brd.white_queen_side : brd.black_queen_side) &&
+		(p.x() == 4) && (p.y() == king_row) &&
+		(get_piece(brd, Position(0, king_row)) == (ChessBoard::Rook | team)) &&
+		squares_empty(brd, between_mask[p.p][Position(0, king_row).p]);
+
+	if (can_queen_side_castle) {
+		add_move(brd, move_list, move_count, p, Left * 2);
+	}
+	if (can_king_side_castle) {
+		add_move(brd, move_list, move_count, p, Right * 2);
+	}
+};
+
+void get_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	auto type = get_type(brd, p);
+	if (type == ChessBoard::Pawn)
+		get_pawn_moves(brd, move_list, move_count, p);
+	else if (type == ChessBoard::Knight)
+		get_knight_moves(brd, move_list, move_count, p);
+	else if (type == ChessBoard::Bishop)
+		get_bishop_moves(brd, move_list, move_count, p);
+	else if (type == ChessBoard::Queen)
+		get_queen_moves(brd, move_list, move_count, p);
+	else if (type == ChessBoard::King)
+		get_king_moves(brd, move_list, move_count, p);
+	else if (type == ChessBoard::Rook)
+		get_rook_moves(brd, move_list, move_count, p);
+	else {
+		move_count = 0;
+	}
+};
+
+void get_valid_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
+	move_count = 0;
+	get_moves(brd, move_list, move_count, p);
+	// A piece off every line through its own king can't uncover an attack on it, so
+	// unless the king is already attacked its moves are legal without trying them.
+	// The en passant capture also removes a pawn elsewhere and always gets tried.
+	ChessBoard::Color team = brd.current_turn;
+	int king = (team == ChessBoard::White) ? brd.white_king_position : brd.black_king_position;
+	bool is_pawn = get_type(brd, p) == ChessBoard::Pawn;
+	bool off_king_lines =
+		move_count > 0 &&
+		get_color(brd, p) == team &&
+		get_type(brd, p) != ChessBoard::King &&
+		get_piece(brd, king) == (ChessBoard::King | team) &&
+		line_mask[king][p.p] == 0 &&
+		!is_in_check(brd, team);
+	int valid_move_count = 0;
+	for (int mv_i = 0; mv_i < move_count; mv_i++) {
+		bool valid;
+		if (off_king_lines && !(is_pawn && move_list[mv_i] == brd.en_passant_target + Down)) {
+			valid = true;
+		}
+		else if (brd.is_check) {
+			valid = resolves_check(brd, p, move_list[mv_i]);
+		}
+		else {
+			valid = !causes_check_on_self(brd, p, move_list[mv_i]);
+		}
+		if (valid) {
+			move_list[valid_move_count] = move_list[mv_i];
+			valid_move_count++;
+		}
+	}
+	move_count = valid_move_count;
+}
+
+// Generates every move of `by` and looks for one landing on square
+bool is_targeted(const ChessBoard& brd, int square, ChessBoard::Color by) {
+	for (int i = 0; i < 64; i++) {
+		Position from(i);
+		if (!is_empty(brd, i) && ((get_color(brd, from) == by))) {
+			int piece_move_list[64]{};
+			int piece_move_count = 0;
+			get_moves(brd, piece_move_list, piece_move_count, from);
+			for (int mv_i = 0; mv_i < piece_move_count; mv_i++) {
+				if (piece_move_list[mv_i] == square) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool is_in_check(const ChessBoard& brd, ChessBoard::Color c) {
+	PROFILE_SCOPE("is_in_check");
+	int king = (c == ChessBoard::White) ? brd.white_king_position : brd.black_king_position;
+	ChessBoard::Color opposingColor = (c == ChessBoard::White) ? ChessBoard::Black : ChessBoard::White;
+	// Without a king on the tracked square, fall back to asking every enemy move
+	if (get_piece(brd, king) != (ChessBoard::King | c)) {
+		return is_targeted(brd, king, opposingColor);
+	}
+	// Look outwards from the king for each kind of attacker
+	for (SquareMask from = knight_attacks[king]; from;) {
+		if (get_piece(brd, pop_square(from)) == (ChessBoard::Knight | opposingColor))
+			return true;
+	}
+	for (SquareMask from = pawn_attacks[c == ChessBoard::White][king]; from;) {
+		if (get_piece(brd, pop_square(from)) == (ChessBoard::Pawn | opposingColor))
+			return true;
+	}
+	for (SquareMask from = king_attacks[king]; from;) {
+		if (get_piece(brd, pop_square(from)) == (ChessBoard::King | opposingColor))
+			return true;
+	}
+	for (int d = 0; d < 8; d++) {
+		int slider = (d < DirLeft) ? ChessBoard::Bishop : ChessBoard::Rook;
+		int from = king;
+		for (int dist = edge_distance[king][d]; dist > 0; dist--) {
+			from += direction_offset[d];
+			if (is_empty(brd, from))
+				continue;
+			int piece = get_piece(brd, from);
+			if (piece == (slider | opposingColor) || piece == (ChessBoard::Queen | opposingColor))
+				return true;
+			break;
+		}
+	}
+	return false;
+};
+
+bool is_in_checkmate(const ChessBoard& brd, ChessBoard::Color c) {
+	PROFILE_SCOPE("is_in_checkmate");
+	PROFILE_COUNT("board_copy");
+	ChessBoard copy = brd;
+	Position king_location = (c == ChessBoard::White) ? brd.white_king_position : brd.black_king_position;
+	for (int i = 0; i < 64; i++) {
+		Position from(i);
+		if (!is_empty(copy, i) && ((get_color(copy, from) == c))) {
+			int piece_move_list[64]{};
+			int piece_move_count = 0;
+			get_valid_moves(copy, piece_move_list, piece_move_count, from);
+			if (piece_move_count != 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+};
+
+void do_move(ChessBoard& brd, Position from_pos, Position to_pos) {
+	PROFILE_SCOPE("do_move");
+	if (from_pos.p == to_pos.p)
+		return;
+	// for (int k = 0; k < 64; k++) {
+		// Check if valid move
+		// if (brd.highlights[k] != -1 && brd.highlights[k] == to_pos) {
+			// if (in_range(brd.selected, 0, 64)) {
+				// Was valid so do the move
+	if (get_type(brd, from_pos) == ChessBoard::Pawn) {
+		// Was a pawn
+		int dy = square_distance[from_pos.p][to_pos.p];
+		if (dy == 2) {
+			// Was double move so update en passant target
+			brd.en_passant_target = to_pos.p;
+		}
+		else {
+			// Was single move so check wether it was en passant capture
+			int px = to_pos.x();
+			int dx = from_pos.x() > px ? from_pos.x() - px : px - from_pos.x();
+			if ((brd.en_passant_target + Down * dy == to_pos.p)) {
+				// Was en passant so clear en passant target and capture the pawn there
+				assert(in_range(brd.en_passant_target, 0, 64));
+				brd.pieces[brd.en_passant_target] = 0;
+				brd.en_passant_target = -1;
+			}
+			// Wasn't double move so clear en passant target
+			brd.en_passant_target = -1;
+		}
+		if ((to_pos.y() == 7) || (to_pos.y() == 0)) {
+			brd.to_be_promoted = to_pos.p;
+			brd.wait_for_promotion_selection = true;
+		}
+	}
+	else {
+		brd.en_passant_target = -1;
+	}
+
+	if (get_type(brd, from_pos) == ChessBoard::King) {
+		int dx = to_pos.x() - from_pos.x();
+		ChessBoard::Color team = get_color(brd, from_pos);
+		int king_row = (team == ChessBoard::White) ? 7 : 0;
+		if (dx == 2) {
+			brd.pieces[Position(7, king_row).p] = 0;
+			brd.pieces[Position(5, king_row).p] = ChessBoard::Rook | team;
+			assert(in_range(Position(7, king_row).p, 0, 64));
+			assert(in_range(Position(5, king_row).p, 0, 64));
+		}
+		else if (dx == -2) {
+			brd.pieces[Position(0, king_row).p] = 0;
+			brd.pieces[Position(3, king_row).p] = ChessBoard::Rook | team;
+			assert(in_range(Position(0, king_row).p, 0, 64));
+			assert(in_range(Position(3, king_row).p, 0, 64));
+		}
+
+		// Update king positions if king was moved
+		if(team == ChessBoard::White)
+			brd.white_king_position = to_pos.p;
+		else 
+			brd.black_king_position = to_pos.p;
+	}
+
+	/* if (brd.pieces[from_pos.p] == (ChessBoard::Color::White | ChessBoard::King)) {
+		brd.white_king_position = to_pos.p;
+	}
+	if (brd.pieces[from_pos.p] == (ChessBoard::Color::Black | ChessBoard::King)) {
+		brd.black_king_position = to_pos.p;
+	}*/
+
+	assert(in_range(to_pos.p, 0, 64));
+	assert(in_range(from_pos.p, 0, 64));
+	brd.pieces[to_pos.p] = brd.pieces[from_pos.p];
+	brd.pieces[from_pos.p] = 0;
+
+	if (brd.current_turn == ChessBoard::Color::Black) {
+		brd.current_turn = ChessBoard::Color::White;
+	}
+	else {
+		brd.current_turn = ChessBoard::Color::Black;
+	}
+};
+
+int get_all_valid_moves(const ChessBoard& brd, Move* moves) {
+	int count = 0;
+	for (int i = 0; i < 64; i++) {
+		if (is_empty(brd, i) || get_color(brd, i) != brd.current_turn)
+			continue;
+		int targets[64]{};
+		int target_count = 0;
+		get_valid_moves(brd, targets, target_count, i);
+		bool is_pawn = get_type(brd, i) == ChessBoard::Pawn;
+		for (int t = 0; t < target_count; t++) {
+			int to = targets[t];
+			if (is_pawn && (to / 8 == 0 || to / 8 == 7)) {
+				uint8_t promotion_pieces[]{ ChessBoard::Queen, ChessBoard::Rook, ChessBoard::Bishop, ChessBoard::Knight };
+				for (uint8_t piece : promotion_pieces) {
+					moves[count++] = { (int8_t)i, (int8_t)to, piece };
+				}
+			}
+			else {
+				moves[count++] = { (int8_t)i, (int8_t)to, ChessBoard::None };
+			}
+		}
+	}
+	assert(count <= MAX_MOVES);
+	return count;
+}
+
+void make_move(ChessBoard& brd, Move mv) {
+	ChessBoard::Color team = get_color(brd, mv.from);
+	do_move(brd, mv.from, mv.to);
+	if (brd.wait_for_promotion_selection) {
+		brd.pieces[brd.to_be_promoted] = (mv.promotion != ChessBoard::None ? mv.promotion : ChessBoard::Queen) | team;
+		brd.to_be_promoted = -1;
+		brd.wait_for_promotion_selection = false;
+	}
+	brd.selected = -1;
+	brd.is_check = is_in_check(brd, brd.current_turn);
+}
+
+void move_to_string(Move mv, char* buf) {
+	buf[0] = 'a' + mv.from % 8;
+	buf[1] = '8' - mv.from / 8;
+	buf[2] = 'a' + mv.to % 8;
+	buf[3] = '8' - mv.to / 8;
+	const char promotion_chars[]{ ' ', 'k', 'q', 'b', 'n', 'r', 'p' };
+	int n = 4;
+	if (mv.promotion != ChessBoard::None)
+		buf[n++] = promotion_chars[mv.promotion];
+	buf[n] = 0;
+}
+
+void move_to_san(const ChessBoard& brd, Move mv, char* buf) {
+	const char piece_chars[]{ ' ', 'K', 'Q', 'B', 'N', 'R', 'P' };
+	int type = get_type(brd, mv.from);
+	int n = 0;
+	if (type == ChessBoard::King && (mv.to - mv.from == 2 || mv.to - mv.from == -2)) {
+		const char* castle = mv.to > mv.from ? "O-O" : "O-O-O";
+		while (*castle)
+			buf[n++] = *castle++;
+	}
+	else {
+		bool capture = !is_empty(brd, mv.to) || (type == ChessBoard::Pawn && mv.from % 8 != mv.to % 8);
+		if (type == ChessBoard::Pawn) {
+			if (capture)
+				buf[n++] = 'a' + mv.from % 8;
+		}
+		else {
+			buf[n++] = piece_chars[type];
+			// Name the file, else the rank, else both when another piece of the same kind can go there
+			bool ambiguous = false, same_file = false, same_rank = false;
+			Move moves[MAX_MOVES];
+			int count = get_all_valid_moves(brd, moves);
+			for (int i = 0; i < count; i++) {
+				if (moves[i].to != mv.to || moves[i].from == mv.from || get_piece(brd, moves[i].from) != get_piece(brd, mv.from))
+					continue;
+				ambiguous = true;
+				same_file |= moves[i].from % 8 == mv.from % 8;
+				same_rank |= moves[i].from / 8 == mv.from / 8;
+			}
+			if (ambiguous && (!same_file || same_rank))
+				buf[n++] = 'a' + mv.from % 8;
+			if (ambiguous && same_file)
+				buf[n++] = '8' - mv.from / 8;
+		}
+		if (capture)
+			buf[n++] = 'x';
+		buf[n++] = 'a' + mv.to % 8;
+		buf[n++] = '8' - mv.to / 8;
+		if (mv.promotion != ChessBoard::None) {
+			buf[n++] = '=';
+			buf[n++] = piece_chars[mv.promotion];
+		}
+	}
+	ChessBoard after = brd;
+	make_move(after, mv);
+	if (after.is_check) {
+		Move replies[MAX_MOVES];
+		buf[n++] = get_all_valid_moves(after, replies) == 0 ? '#' : '+';
+	}
+	buf[n] = 0;
+}
+
+bool parse_san(const ChessBoard& brd, const char* san, Move& out) {
+	char buf[MAX_SAN + 8];
+	int n = 0;
+	for (; san[n] && n < (int)sizeof(buf) - 1; n++)
+		buf[n] = san[n];
+	// Check marks and annotations like "!?" don't change the move
+	while (n > 0 && strchr("+#!?", buf[n - 1]))
+		n--;
+	buf[n] = 0;
+	if (n < 2)
+		return false;
+
+	Move moves[MAX_MOVES];
+	int count = get_all_valid_moves(brd, moves);
+	bool castle_long = strcmp(buf, "O-O-O") == 0 || strcmp(buf, "0-0-0") == 0;
+	bool castle_short = strcmp(buf, "O-O") == 0 || strcmp(buf, "0-0") == 0;
+	if (castle_long || castle_short) {
+		for (int i = 0; i < count; i++) {
+			int dx = moves[i].to - moves[i].from;
+			if (get_type(brd, moves[i].from) == ChessBoard::King && dx == (castle_short ? 2 : -2)) {
+				out = moves[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int type = ChessBoard::Pawn, promotion = ChessBoard::None;
+	const char* piece_chars = "KQBNR";
+	int begin = 0;
+	if (strchr(piece_chars, buf[0])) {
+		type = (int)(strchr(piece_chars, buf[0]) - piece_chars) + ChessBoard::King;
+		begin = 1;
+	}
+	// Promotion piece, with or without the '='
+	if (type == ChessBoard::Pawn && strchr("QBNR", buf[n - 1])) {
+		promotion = (int)(strchr(piece_chars, buf[n - 1]) - piece_chars) + ChessBoard::King;
+		n -= buf[n - 2] == '=' ? 2 : 1;
+	}
+	if (n - begin < 2)
+		return false;
+	int to_file = buf[n - 2] - 'a', to_rank = buf[n - 1] - '1';
+	if (!in_range(to_file, 0, 8) || !in_range(to_rank, 0, 8))
+		return false;
+	int to = to_file + (7 - to_rank) * 8;
+	// Whatever is left between the piece and the target narrows down the origin
+	int from_file = -1, from_rank = -1;
+	for (int i = begin; i < n - 2; i++) {
+		if (in_range(buf[i] - 'a', 0, 8))
+			from_file = buf[i] - 'a';
+		else if (in_range(buf[i] - '1', 0, 8))
+			from_rank = buf[i] - '1';
+		else if (buf[i] != 'x' && buf[i] != '-')
+			return false;
+	}
+
+	int found = 0;
+	for (int i = 0; i < count; i++) {
+		const Move& mv = moves[i];
+		if (mv.to != to || mv.promotion != promotion || get_type(brd, mv.from) != type)
+			continue;
+		if ((from_file != -1 && mv.from % 8 != from_file) || (from_rank != -1 && 7 - mv.from / 8 != from_rank))
+			continue;
+		// A capture that is also en passant shows up twice in the move list
+		if (found > 0 && out.from == mv.from)
+			continue;
+		out = mv;
+		found++;
+	}
+	return found == 1;
+}
+
+bool same_position(const ChessBoard& a, const ChessBoard& b) {
+	return
+		memcmp(a.pieces, b.pieces, sizeof(a.pieces)) == 0 &&
+		a.current_turn == b.current_turn &&
+		a.en_passant_target == b.en_passant_target &&
+		a.white_king_side == b.white_king_side &&
+		a.white_queen_side == b.white_queen_side &&
+		a.black_king_side == b.black_king_side &&
+		a.black_queen_side == b.black_queen_side;
+}
+
+void board_to_fen(const ChessBoard& brd, char* fen) {
+	const char piece_chars[]{ ' ', 'k', 'q', 'b', 'n', 'r', 'p' };
+	int n = 0;
+	for (int y = 0; y < 8; y++) {
+		int empty = 0;
+		for (int x = 0; x < 8; x++) {
+			int p = get_piece(brd, Position(x, y));
+			if ((p & ChessBoard::PIECE_BITS) == ChessBoard::None) {
+				empty++;
+				continue;
+			}
+			if (empty)
+				fen[n++] = '0' + empty;
+			empty = 0;
+			char c = piece_chars[p & ChessBoard::PIECE_BITS];
+			fen[n++] = (p & ChessBoard::COLOR_BIT) == ChessBoard::White ? c - 'a' + 'A' : c;
+		}
+		if (empty)
+			fen[n++] = '0' + empty;
+		if (y != 7)
+			fen[n++] = '/';
+	}
+	fen[n++] = ' ';
+	fen[n++] = brd.current_turn == ChessBoard::White ? 'w' : 'b';
+	fen[n++] = ' ';
+	int castling_start = n;
+	if (brd.white_king_side) fen[n++] = 'K';
+	if (brd.white_queen_side) fen[n++] = 'Q';
+	if (brd.black_king_side) fen[n++] = 'k';
+	if (brd.black_queen_side) fen[n++] = 'q';
+	if (n == castling_start) fen[n++] = '-';
+	fen[n++] = ' ';
+	if (brd.en_passant_target != -1) {
+		int target = brd.en_passant_target + (brd.current_turn == ChessBoard::White ? Down : Up);
+		fen[n++] = 'a' + target % 8;
+		fen[n++] = '8' - target / 8;
+	}
+	else {
+		fen[n++] = '-';
+	}
+	// Move counters aren't tracked by the board
+	memcpy(fen + n, " 0 1", 5);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstdint>
+#include <cassert>
+
+struct ChessBoard {
+	enum PieceType {
+		None = 0,
+		King,
+		Queen,
+		Bishop,
+		Knight,
+		Rook,
+		Pawn,
+	};
+	enum Color {
+		Black = 0,
+		White = 1 << 4
+	};
+	constexpr static uint8_t PIECE_BITS = 0b111;
+	constexpr static uint8_t COLOR_BIT = 1 << 4;
+	// Board state
+	uint8_t pieces[8 * 8]{};
+	Color current_turn = Color::White;
+	// Currently selected piece on the board or in the pawn promotion menu
+	int8_t selected{ -1 };
+	// Pawn capture information
+	int en_passant_target{ -1 };
+	// Available moves
+	int move_list[65]{};
+	int move_count = 0;
+	// King information
+	bool is_check{ false }, is_checkmate{ false };
+	int white_king_position{ 0 }, black_king_position{ 0 };
+	// Square hovered by cursor
+	int hovered_square{ -1 };
+	// Set when anything visible changed and the board needs to be redrawn
+	bool dirty{ true };
+	// Pawn promotion info
+	int to_be_promoted{ -1 };
+	bool wait_for_promotion_selection{ false };
+	// Castling availability
+	bool
+		black_king_side{ true },
+		black_queen_side{ true },
+		white_king_side{ true },
+		white_queen_side{ true };
+};
+
+// Directions set to offsets in an array that correspond to movements on the grid
+enum {
+	Up = 8,
+	Down = -8,
+	Left = -1,
+	Right = 1
+};
+
+enum struct IgnoreInvalid { _ };
+
+struct Position {
+	Position(int p) : p(p) { assert(p >= 0); assert(p < 64); }
+	Position(int p, IgnoreInvalid i) : p(p) {}
+	Position(int x, int y) : Position(x + y * 8) {}
+	Position offset(int mv) { return Position(p + mv); }
+	int p{};
+	int x() const { return p % 8; }
+	int y() const { return p / 8; }
+	bool is_valid() { return (x() >= 0) && (x() < 8) && (y() >= 0) && (y() < 8); }
+};
+
+ChessBoard::Color get_color(const ChessBoard& brd, Position p);
+ChessBoard::PieceType get_type(const ChessBoard& brd, Position p);
+int get_piece(const ChessBoard& brd, Position p);
+
+// Parses a FEN string into the board. Game flags (check, promotion) are left untouched.
+void init_fen(ChessBoard& brd, const char* fen);
+// init_fen trusts its input. Checks placement, side to move, castling and en
+// passant fields, and one king per side, for fens from outside the program.
+bool is_valid_fen(const char* fen);
+// For positions from outside the program, once the board is filled in: drops
+// castling rights without king and rook at home and sets is_check. False when
+// the side not to move is in check, its king could be taken.
+bool settle_position(ChessBoard& brd);
+// Resets the board to the starting position
+void init(ChessBoard& brd);
+
+bool in_range(int val, int min_inc, int max_ex);
+
+bool is_empty(const ChessBoard& brd, Position p);
+bool is_enemy(const ChessBoard& brd, Position self, Position p);
+bool is_enemy_or_empty(const ChessBoard& brd, int self, int p);
+bool is_own(const ChessBoard& brd, int self, int p);
+
+bool resolves_check(const ChessBoard& brd, Position pos, Position target);
+bool causes_check_on_self(const ChessBoard& brd, Position pos, Position target);
+
+// Pseudo legal move generation. Targets are appended to move_list.
+void get_pawn_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void get_knight_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void get_bishop_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void get_queen_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void get_rook_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void get_king_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void get_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+
+// Legal moves of the piece on p, moves leaving the own king in check are removed
+void get_valid_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+
+bool is_in_check(const ChessBoard& brd, ChessBoard::Color c);
+bool is_in_checkmate(const ChessBoard& brd, ChessBoard::Color c);
+
+void do_move(ChessBoard& brd, Position from_pos, Position to_pos);
+
+// A full move including the promotion choice, used by the engine and tools
+struct Move {
+	int8_t from{ -1 }, to{ -1 };
+	// ChessBoard::PieceType to promote to, None for other moves
+	uint8_t promotion{ ChessBoard::None };
+};
+
+constexpr int MAX_MOVES = 256;
+
+// All legal moves for the side to move. Pawn moves to the last rank are
+// expanded into one move per promotion piece. Returns the move count.
+int get_all_valid_moves(const ChessBoard& brd, Move* moves);
+
+// Plays a move including the promotion and updates is_check for the side to move
+void make_move(ChessBoard& brd, Move mv);
+
+// Coordinate notation such as "e2e4" or "e7e8q". buf must hold 6 chars.
+void move_to_string(Move mv, char* buf);
+
+constexpr int MAX_SAN = 8;
+
+// Standard algebraic notation such as "Nbd7", "exd6", "O-O" or "e8=Q#" for a
+// legal move in brd. buf must hold MAX_SAN chars.
+void move_to_san(const ChessBoard& brd, Move mv, char* buf);
+
+// Finds the legal move written in standard algebraic notation. Check marks
+// and annotations are ignored, "0-0" is accepted for castling. Returns false
+// for illegal or ambiguous moves.
+bool parse_san(const ChessBoard& brd, const char* san, Move& out);
+
+constexpr int MAX_FEN = 96;
+
+// Writes the position as FEN, fen must hold MAX_FEN chars
+void board_to_fen(const ChessBoard& brd, char* fen);
+
+// Compares the parts of the board that make up the position, ignoring the UI state
+bool same_position(const ChessBoard& a, const ChessBoard& b);
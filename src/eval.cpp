@@ -0,0 +1,17 @@
+#include "eval.h"
+#include "eval_params.h"
+
+int evaluate(const ChessBoard& brd) {
+	int score = 0;
+	for (int i = 0; i < 64; i++) {
+		int type = get_type(brd, i);
+		if (type == ChessBoard::None)
+			continue;
+		// Tables are written for white, black reads them mirrored vertically
+		if (get_color(brd, i) == ChessBoard::White)
+			score += piece_value[type] + piece_square[type][i];
+		else
+			score -= piece_value[type] + piece_square[type][i ^ 56];
+	}
+	return brd.current_turn == ChessBoard::White ? score : -score;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "chess.h"
+
+// Static evaluation in centipawns from the point of view of the side to move
+int evaluate(const ChessBoard& brd);
@@ -0,0 +1,153 @@
+#include "explorer.h"
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+uint16_t pack_explorer_move(Move mv) {
+	return (uint16_t)(mv.from | mv.to << 6 | mv.promotion << 12);
+}
+
+Move unpack_explorer_move(uint16_t move) {
+	Move mv{};
+	mv.from = (int8_t)(move & 63);
+	mv.to = (int8_t)((move >> 6) & 63);
+	mv.promotion = (uint8_t)(move >> 12);
+	return mv;
+}
+
+bool map_file(MappedFile& file, const char* path) {
+	file = MappedFile{};
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size{};
+	GetFileSizeEx(handle, &size);
+	file.handle = handle;
+	file.size = (size_t)size.QuadPart;
+	if (file.size == 0)
+		return true;
+	file.mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (file.mapping)
+		file.data = (const uint8_t*)MapViewOfFile(file.mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st{};
+	fstat(fd, &st);
+	file.size = (size_t)st.st_size;
+	if (file.size > 0) {
+		void* data = mmap(nullptr, file.size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data != MAP_FAILED)
+			file.data = (const uint8_t*)data;
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+	if (file.size == 0)
+		return true;
+#endif
+	if (!file.data) {
+		unmap_file(file);
+		return false;
+	}
+	return true;
+}
+
+void unmap_file(MappedFile& file) {
+#if defined(_WIN32)
+	if (file.data)
+		UnmapViewOfFile(file.data);
+	if (file.mapping)
+		CloseHandle(file.mapping);
+	if (file.handle)
+		CloseHandle(file.handle);
+#else
+	if (file.data)
+		munmap((void*)file.data, file.size);
+#endif
+	file = MappedFile{};
+}
+
+bool open_explorer(ExplorerIndex& index, const char* path) {
+	index = ExplorerIndex{};
+	if (!map_file(index.file, path))
+		return false;
+	const MappedFile& f = index.file;
+	auto fits = [&](uint64_t offset, uint64_t count, size_t item) {
+		return offset <= f.size && count <= (f.size - offset) / item && offset % 8 == 0;
+	};
+	const ExplorerHeader* h = (const ExplorerHeader*)f.data;
+	if (f.size < sizeof(ExplorerHeader) || h->magic != EXPLORER_MAGIC || h->version != EXPLORER_VERSION ||
+		h->bucket_bits > 32 ||
+		!fits(h->entries_offset, h->entry_count, sizeof(ExplorerEntry)) ||
+		!fits(h->postings_offset, h->posting_count, sizeof(uint64_t)) ||
+		!fits(h->buckets_offset, (1ull << h->bucket_bits) + 1, sizeof(uint64_t))) {
+		close_explorer(index);
+		return false;
+	}
+	index.header = h;
+	index.entries = (const ExplorerEntry*)(f.data + h->entries_offset);
+	index.postings = (const uint64_t*)(f.data + h->postings_offset);
+	index.buckets = (const uint64_t*)(f.data + h->buckets_offset);
+	return true;
+}
+
+void close_explorer(ExplorerIndex& index) {
+	unmap_file(index.file);
+	index = ExplorerIndex{};
+}
+
+size_t explorer_lookup(const ExplorerIndex& index, uint64_t key, const ExplorerEntry*& first) {
+	first = nullptr;
+	if (!index.header || index.header->entry_count == 0)
+		return 0;
+	// The directory narrows the search down to one bucket, a handful of entries
+	uint64_t bucket = index.header->bucket_bits ? key >> (64 - index.header->bucket_bits) : 0;
+	uint64_t lo = index.buckets[bucket], hi = index.buckets[bucket + 1];
+	if (hi > index.header->entry_count || lo > hi)
+		return 0;
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (index.entries[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	size_t count = 0;
+	while (lo + count < index.header->entry_count && index.entries[lo + count].key == key)
+		count++;
+	if (count > 0)
+		first = index.entries + lo;
+	return count;
+}
+
+size_t explorer_postings(const ExplorerIndex& index, const ExplorerEntry& entry, const uint64_t*& first) {
+	first = nullptr;
+	if (!index.header)
+		return 0;
+	uint64_t games = (uint64_t)entry.white + entry.draws + entry.black;
+	uint64_t posting_count = index.header->posting_count;
+	if (entry.first_posting > posting_count || games > posting_count - entry.first_posting)
+		return 0;
+	first = index.postings + entry.first_posting;
+	return games;
+}
+
+void format_explorer_entry(const ChessBoard& brd, const ExplorerEntry& entry, char* buf, size_t size) {
+	char san[MAX_SAN];
+	move_to_san(brd, unpack_explorer_move(entry.move), san);
+	uint64_t games = (uint64_t)entry.white + entry.draws + entry.black;
+	double scale = games ? 100.0 / games : 0.0;
+	snprintf(buf, size, "%-8s %10llu  %5.1f%% / %5.1f%% / %5.1f%%", san, (unsigned long long)games,
+		entry.white * scale, entry.draws * scale, entry.black * scale);
+}
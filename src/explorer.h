@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "chess.h"
+
+// Opening explorer index, built by tools/explorer from a PGN archive. The
+// file is memory mapped and used in place: a header, the entries sorted by
+// position hash then move, the game postings of every entry in the same
+// order, and a directory of the first entry per hash bucket.
+constexpr uint32_t EXPLORER_MAGIC = 0x4c505845; // "EXPL"
+constexpr uint32_t EXPLORER_VERSION = 2;
+
+struct ExplorerHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t games;
+	uint64_t entry_count;
+	uint64_t posting_count;
+	// Entries are bucketed by the top bucket_bits bits of the key
+	uint32_t bucket_bits;
+	uint32_t max_ply;
+	uint64_t entries_offset;
+	uint64_t postings_offset;
+	uint64_t buckets_offset;
+};
+
+// One move played from one position
+struct ExplorerEntry {
+	// position_hash before the move
+	uint64_t key;
+	// from | to << 6 | promotion << 12
+	uint16_t move;
+	uint16_t reserved;
+	// Game results after this move, from white's point of view
+	uint32_t white, draws, black;
+	// Index of the first of white + draws + black postings, each the byte
+	// offset of a game in the PGN file, in file order
+	uint64_t first_posting;
+};
+static_assert(sizeof(ExplorerEntry) == 32, "explorer entries are 32 bytes");
+
+uint16_t pack_explorer_move(Move mv);
+Move unpack_explorer_move(uint16_t move);
+
+// Read only view of a whole file
+struct MappedFile {
+	const uint8_t* data{};
+	size_t size{};
+	void* handle{};
+	void* mapping{};
+};
+
+bool map_file(MappedFile& file, const char* path);
+void unmap_file(MappedFile& file);
+
+struct ExplorerIndex {
+	MappedFile file;
+	const ExplorerHeader* header{};
+	const ExplorerEntry* entries{};
+	const uint64_t* postings{};
+	// 2^bucket_bits + 1 entry indices
+	const uint64_t* buckets{};
+};
+
+// Maps the index and checks its layout, false if it isn't a usable index
+bool open_explorer(ExplorerIndex& index, const char* path);
+void close_explorer(ExplorerIndex& index);
+// Entries of the position, one per move played from it. Returns the count
+// and points first at the first of them.
+size_t explorer_lookup(const ExplorerIndex& index, uint64_t key, const ExplorerEntry*& first);
+// Postings of an entry, none when they run past the end of the postings
+size_t explorer_postings(const ExplorerIndex& index, const ExplorerEntry& entry, const uint64_t*& first);
+
+// "Nf3     1234  45.1% / 30.2% / 24.7%" for an entry of brd
+void format_explorer_entry(const ChessBoard& brd, const ExplorerEntry& entry, char* buf, size_t size);
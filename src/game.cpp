@@ -0,0 +1,54 @@
+#include "game.h"
+#include "zobrist.h"
+#include <algorithm>
+
+void start_game(Game& game, const char* fen) {
+	game.brd = ChessBoard{};
+	init_fen(game.brd, fen);
+	game.brd.is_check = is_in_check(game.brd, game.brd.current_turn);
+	game.halfmove_clock = 0;
+	game.history.assign(1, position_hash(game.brd));
+}
+
+void play_move(Game& game, Move mv) {
+	bool irreversible = get_type(game.brd, mv.from) == ChessBoard::Pawn || !is_empty(game.brd, mv.to);
+	make_move(game.brd, mv);
+	game.halfmove_clock = irreversible ? 0 : game.halfmove_clock + 1;
+	if (irreversible)
+		game.history.clear();
+	game.history.push_back(position_hash(game.brd));
+}
+
+const char* game_result(const Game& game, int& white_points) {
+	const ChessBoard& brd = game.brd;
+	Move moves[MAX_MOVES];
+	if (get_all_valid_moves(brd, moves) == 0) {
+		if (brd.is_check) {
+			white_points = brd.current_turn == ChessBoard::White ? 0 : 2;
+			return "checkmate";
+		}
+		white_points = 1;
+		return "stalemate";
+	}
+	white_points = 1;
+	if (game.halfmove_clock >= 100)
+		return "fifty move rule";
+	if (std::count(game.history.begin(), game.history.end(), game.history.back()) >= 3)
+		return "threefold repetition";
+	// Bare kings, a single minor piece, or only bishops all on one square color
+	int knights = 0, bishops = 0, bishop_colors = 0;
+	for (int i = 0; i < 64; i++) {
+		int type = get_type(brd, i);
+		if (type == ChessBoard::Pawn || type == ChessBoard::Rook || type == ChessBoard::Queen)
+			return nullptr;
+		if (type == ChessBoard::Knight)
+			knights++;
+		if (type == ChessBoard::Bishop) {
+			bishops++;
+			bishop_colors |= 1 << ((i % 8 + i / 8) % 2);
+		}
+	}
+	if (knights + bishops <= 1 || (knights == 0 && bishop_colors != 3))
+		return "insufficient material";
+	return nullptr;
+}
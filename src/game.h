@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "chess.h"
+
+// A game in progress, with what the board doesn't track for the draw rules
+struct Game {
+	ChessBoard brd{};
+	int halfmove_clock{};
+	// Position hashes since the last pawn move or capture, current position last
+	std::vector<uint64_t> history;
+};
+
+void start_game(Game& game, const char* fen);
+void play_move(Game& game, Move mv);
+// Why the game ended by the rules, or nullptr while it goes on. white_points
+// is set to 2, 1 or 0 for a white win, draw or loss.
+const char* game_result(const Game& game, int& white_points);
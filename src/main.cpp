@@ -1,217 +1,55 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "generated/pieces_png.h"
+#include "chess.h"
+#include "analysis.h"
+#include "explorer.h"
+#include "zobrist.h"
+#include "profile.h"
+
 struct Vec3 {
 	float x, y, z;
 };
 
-struct ChessBoard {
-	enum PieceType {
-		None = 0,
-		King,
-		Queen,
-		Bishop,
-		Knight,
-		Rook,
-		Pawn,
-	};
-	enum Color {
-		Black = 0,
-		White = 1 << 4
-	};
-	constexpr static uint8_t PIECE_BITS = 0b111;
-	constexpr static uint8_t COLOR_BIT = 1 << 4;
-	// Board state
-	uint8_t pieces[8 * 8]{};
-	Color current_turn = Color::White;
-	// Currently selected piece on the board or in the pawn promotion menu
-	int8_t selected{ -1 };
-	// Pawn capture information
-	int en_passant_target{ -1 };
-	// Available moves
-	int move_list[65]{};
-	int move_count = 0;
-	// King information
-	bool is_check{ false }, is_checkmate{ false };
-	int white_king_position{ 0 }, black_king_position{ 0 };
-	// Square hovered by cursor
-	int hovered_square{ -1 };
-	// Pawn promotion info
-	int to_be_promoted{ -1 };
-	bool wait_for_promotion_selection{ false };
-	// Castling availability
-	bool
-		black_king_side{ true },
-		black_queen_side{ true },
-		white_king_side{ true },
-		white_queen_side{ true };
-};
-
-// Directions set to offsets in an array that correspond to movements on the grid
-enum {
-	Up = 8,
-	Down = -8,
-	Left = -1,
-	Right = 1
+// Time spent in each startup phase, printed with --stats
+struct StartupTimes {
+	std::chrono::steady_clock::time_point last{ std::chrono::steady_clock::now() };
+	std::vector<std::pair<const char*, double>> phases;
 };
 
-enum struct IgnoreInvalid { _ };
-
-struct Position {
-	Position(int p) : p(p) { assert(p >= 0); assert(p < 64); }
-	Position(int p, IgnoreInvalid i) : p(p) {}
-	Position(int x, int y) : Position(x + y * 8) {}
-	Position offset(int mv) { return Position(p + mv); }
-	int p{};
-	int x() const { return p % 8; }
-	int y() const { return p / 8; }
-	bool is_valid() { return (x() >= 0) && (x() < 8) && (y() >= 0) && (y() < 8); }
-};
-
-ChessBoard::Color get_color(const ChessBoard& brd, Position p) {
-	ChessBoard::Color color = (ChessBoard::Color)(brd.pieces[p.p] & ChessBoard::COLOR_BIT);
-	return color;
-}
-ChessBoard::PieceType get_type(const ChessBoard& brd, Position p) {
-	ChessBoard::PieceType type = (ChessBoard::PieceType)(brd.pieces[p.p] & ChessBoard::PIECE_BITS);
-	return type;
+// Ends the current phase
+void startup_phase(StartupTimes& t, const char* name) {
+	auto now = std::chrono::steady_clock::now();
+	t.phases.push_back({ name, std::chrono::duration<double, std::milli>(now - t.last).count() });
+	t.last = now;
 }
-int get_piece(const ChessBoard& brd, Position p) {
-	return brd.pieces[p.p];
-}
-
-void init_fen(ChessBoard& brd, const char* fen) {
-	brd.selected = -1;
-	for (int i = 0; i < 8 * 8; i++) {
-		brd.pieces[i] = ChessBoard::None;
-	}
-	int len = strlen(fen);
-	int i = 0;
-	int cursor = 0;
-	// Board state
-	for (; i < len; i++) {
-		char c = fen[i];
-		// 'PNBRQK'
-		if (i <= 64) {
-			if (c == 'P') {
-				brd.pieces[cursor++] = ChessBoard::Pawn | ChessBoard::White;
-			}
-			else if (c == 'N') {
-				brd.pieces[cursor++] = ChessBoard::Knight | ChessBoard::White;
-			}
-			else if (c == 'B') {
-				brd.pieces[cursor++] = ChessBoard::Bishop | ChessBoard::White;
-			}
-			else if (c == 'R') {
-				brd.pieces[cursor++] = ChessBoard::Rook | ChessBoard::White;
-			}
-			else if (c == 'Q') {
-				brd.pieces[cursor++] = ChessBoard::Queen | ChessBoard::White;
-			}
-			else if (c == 'K') {
-				brd.white_king_position = cursor;
-				brd.pieces[cursor++] = ChessBoard::King | ChessBoard::White;
-			}
-			else if (c == 'p') {
-				brd.pieces[cursor++] = ChessBoard::Pawn | ChessBoard::Black;
-			}
-			else if (c == 'n') {
-				brd.pieces[cursor++] = ChessBoard::Knight | ChessBoard::Black;
-			}
-			else if (c == 'b') {
-				brd.pieces[cursor++] = ChessBoard::Bishop | ChessBoard::Black;
-			}
-			else if (c == 'r') {
-				brd.pieces[cursor++] = ChessBoard::Rook | ChessBoard::Black;
-			}
-			else if (c == 'q') {
-				brd.pieces[cursor++] = ChessBoard::Queen | ChessBoard::Black;
-			}
-			else if (c == 'k') {
-				brd.black_king_position = cursor;
-				brd.pieces[cursor++] = ChessBoard::King | ChessBoard::Black;
-			}
-			else if (c == '/') {
-				cursor = (cursor - cursor % 8);
-			}
-			else if (c == ' ') {
-				break;
-			}
-			else {
-				cursor += (c - '0');
-			}
-			if (cursor >= 64) {
-				break;
-			}
-		}
-	}
-	// Turn
-	char turn = *(fen + i + 2);
-	if (turn == 'w') {
-		brd.current_turn = ChessBoard::White;
-	}
-	else if (turn == 'b') {
-		brd.current_turn = ChessBoard::Black;
-	}
-	else {
-		assert(false);
-	}
-	// Castling availability
-	const char* castling = fen + i + 2 + 2;
-	auto parse_castling = [&](char c) {
-		switch (c) {
-		case 'K': brd.white_king_side = true; return true;
-		case 'Q': brd.white_queen_side = true; return true;
-		case 'k': brd.black_king_side = true; return true;
-		case 'q': brd.black_queen_side = true; return true;
-		}
-		assert(false);
-		return false;
-	};
-	brd.black_king_side = false;
-	brd.black_queen_side = false;
-	brd.white_king_side = false;
-	brd.white_queen_side = false;
-
-	const char* en_passant_target = castling + 1;
-	if (castling[0] == '-') {} // No castling
-	else if(parse_castling(castling[0]) && 
-			castling[1] == ' ') { en_passant_target += 1; }
-	else if(parse_castling(castling[0]) && 
-			parse_castling(castling[1]) && 
-			castling[2] == ' ') { en_passant_target += 2; }
-	else if(parse_castling(castling[0]) && 
-			parse_castling(castling[1]) && 
-			parse_castling(castling[2]) && 
-			castling[3] == ' ') { en_passant_target += 3; }
-	else if(parse_castling(castling[0]) && 
-			parse_castling(castling[1]) && 
-			parse_castling(castling[2]) && 
-			parse_castling(castling[3]) && 
-			castling[4] == ' ') { en_passant_target += 4; }
-	else {
-		assert(false);
-	}
 
-	if (en_passant_target[0] != '-') {
-		char x = en_passant_target[0] - 'a';
-		char y = en_passant_target[1] - '1';
-		brd.en_passant_target = x + y * 8;
-	}
-	else {
-		brd.en_passant_target = -1;
+void print_startup_times(const StartupTimes& t) {
+	double total = 0.0;
+	std::cout << "startup (ms)" << std::endl;
+	for (auto& [name, ms] : t.phases) {
+		char line[96];
+		snprintf(line, sizeof(line), "%-24s %8.2f", name, ms);
+		std::cout << line << std::endl;
+		total += ms;
 	}
-
-	return;
-}
-
-void init(ChessBoard& brd) {
-	brd = ChessBoard{};
-	init_fen(brd, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+	char line[96];
+	snprintf(line, sizeof(line), "%-24s %8.2f", "total", total);
+	std::cout << line << std::endl;
 }
 
 struct Rect {
@@ -244,56 +82,185 @@ Rect create_rect() {
 
 struct Shader {
 	uint32_t prog, vs, fs;
+	// Uniform locations, resolved once after linking
+	int screen, tex;
 };
 
-Shader create_shader() {
+bool check_shader(uint32_t shader, const char* name) {
+	int ok = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[1024]{};
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		std::cout << name << " shader failed to compile: " << log << std::endl;
+	}
+	return ok;
+}
+
+bool check_program(uint32_t prog) {
+	int ok = 0;
+	glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024]{};
+		glGetProgramInfoLog(prog, sizeof(log), nullptr, log);
+		std::cout << "shader program failed to link: " << log << std::endl;
+	}
+	return ok;
+}
+
+// Linked programs are cached in the user's cache directory. The key covers the
+// sources and the driver, a binary from another driver version is not loaded.
+std::filesystem::path shader_cache_path() {
+	const char* dir = nullptr;
+#if defined(_WIN32)
+	dir = getenv("LOCALAPPDATA");
+	if (!dir)
+		return {};
+	return std::filesystem::path(dir) / "chess_gl" / "shaders.bin";
+#else
+	dir = getenv("XDG_CACHE_HOME");
+	if (dir && *dir)
+		return std::filesystem::path(dir) / "chess_gl" / "shaders.bin";
+	dir = getenv("HOME");
+	if (!dir)
+		return {};
+	return std::filesystem::path(dir) / ".cache" / "chess_gl" / "shaders.bin";
+#endif
+}
+
+uint64_t shader_cache_key(const char* vs_src, const char* fs_src) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto add = [&](const char* text) {
+		for (const char* c = text ? text : ""; *c; c++)
+			hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+		hash = (hash ^ 0xff) * 0x100000001b3ull;
+	};
+	add(vs_src);
+	add(fs_src);
+	add((const char*)glGetString(GL_VENDOR));
+	add((const char*)glGetString(GL_RENDERER));
+	add((const char*)glGetString(GL_VERSION));
+	return hash;
+}
+
+// Program binaries need OpenGL 4.1 and a driver that offers at least one format
+bool program_binaries_supported() {
+	int major = 0, minor = 0, formats = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major * 10 + minor < 41)
+		return false;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// Cache file: key, binary format, length, binary
+bool load_program_binary(uint32_t prog, uint64_t key) {
+	std::ifstream file(shader_cache_path(), std::ios::binary);
+	uint64_t file_key = 0;
+	uint32_t format = 0, length = 0;
+	if (!file.read((char*)&file_key, sizeof(file_key)) || file_key != key ||
+		!file.read((char*)&format, sizeof(format)) || !file.read((char*)&length, sizeof(length)))
+		return false;
+	std::vector<char> binary(length);
+	if (!file.read(binary.data(), length))
+		return false;
+	glProgramBinary(prog, format, binary.data(), length);
+	// Drivers may still refuse a binary, then the program is built from source
+	int ok = 0;
+	glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+	return ok;
+}
+
+void save_program_binary(uint32_t prog, uint64_t key) {
+	int length = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(prog, length, nullptr, &format, binary.data());
+	std::filesystem::path path = shader_cache_path();
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+	std::ofstream file(path, std::ios::binary);
+	uint32_t format32 = format, length32 = (uint32_t)length;
+	file.write((const char*)&key, sizeof(key));
+	file.write((const char*)&format32, sizeof(format32));
+	file.write((const char*)&length32, sizeof(length32));
+	file.write(binary.data(), length);
+}
+
+// Loads the program from the binary cache when possible, else compiles it
+// and refreshes the cache. cached tells which of the two happened.
+Shader create_shader(bool& cached) {
 	const char* vs_src = R"GLSL(#version 330 core
 
 layout(location = 0) in vec2 vPos;
+layout(location = 1) in vec4 iRect;
+layout(location = 2) in vec4 iColor;
+layout(location = 3) in vec4 iUV;
+layout(location = 4) in float iAngle;
 
-uniform vec2 pos = vec2(0);
-uniform vec2 scale = vec2(0);
+uniform vec2 screen = vec2(1);
 
 out vec2 fUV;
+out vec4 fColor;
 
 void main(){
-	fUV = vPos;
-	gl_Position = vec4((vPos * scale + pos) * 2 - vec2(1), 0, 1);
+	fUV = vPos * iUV.zw + iUV.xy;
+	fColor = iColor;
+	// Rotate around the center of the rect
+	vec2 local = (vPos - vec2(0.5)) * iRect.zw;
+	vec2 rotated = vec2(local.x * cos(iAngle) - local.y * sin(iAngle), local.x * sin(iAngle) + local.y * cos(iAngle));
+	vec2 p = iRect.xy + iRect.zw * 0.5 + rotated;
+	gl_Position = vec4(p / screen * 2 - vec2(1), 0, 1);
 }
 
 )GLSL";
 	const char* fs_src = R"GLSL(#version 330 core
 
 in vec2 fUV;
-out vec4 fColor;
+in vec4 fColor;
+out vec4 oColor;
 
-uniform vec2 tex_pos = vec2(0); 
-uniform vec2 tex_scale = vec2(1); 
 uniform sampler2D tex;
-uniform vec3 color = vec3(1); 
-uniform float color_fac = 1.0f;
 
 void main(){
-	vec2 uv = fUV * tex_scale + tex_pos;
-	fColor = texture(tex, vec2(uv.x, 1.0 - uv.y)) * (1.0f - color_fac) + color_fac * vec4(color, 1.0);
+	// fColor.a selects between the flat color and the atlas sample
+	oColor = texture(tex, vec2(fUV.x, 1.0 - fUV.y)) * (1.0f - fColor.a) + fColor.a * vec4(fColor.rgb, 1.0);
 }
 
 )GLSL";
 
 	Shader s{};
 	s.prog = glCreateProgram();
+	bool binaries = program_binaries_supported() && !shader_cache_path().empty();
+	uint64_t key = binaries ? shader_cache_key(vs_src, fs_src) : 0;
+	cached = binaries && load_program_binary(s.prog, key);
+	if (!cached) {
+		s.vs = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(s.vs, 1, &vs_src, nullptr);
+		glCompileShader(s.vs);
+		check_shader(s.vs, "vertex");
+		glAttachShader(s.prog, s.vs);
+
+		s.fs = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(s.fs, 1, &fs_src, nullptr);
+		glCompileShader(s.fs);
+		check_shader(s.fs, "fragment");
+		glAttachShader(s.prog, s.fs);
+
+		if (binaries)
+			glProgramParameteri(s.prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(s.prog);
+		if (check_program(s.prog) && binaries)
+			save_program_binary(s.prog, key);
+	}
 
-	s.vs = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(s.vs, 1, &vs_src, nullptr);
-	glCompileShader(s.vs);
-	glAttachShader(s.prog, s.vs);
-
-	s.fs = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(s.fs, 1, &fs_src, nullptr);
-	glCompileShader(s.fs);
-	glAttachShader(s.prog, s.fs);
-
-	glLinkProgram(s.prog);
+	s.screen = glGetUniformLocation(s.prog, "screen");
+	s.tex = glGetUniformLocation(s.prog, "tex");
 
 	return s;
 }
@@ -302,14 +269,23 @@ struct Image {
 	uint32_t tex;
 };
 
-Image create_image() {
+// The atlas is compiled in (src/generated/pieces_png.h, written by premake)
+// so the working directory doesn't matter. It is grey plus alpha, uploaded
+// as two channels and swizzled back to rgba when sampled.
+Image create_image(StartupTimes& startup) {
 	int w{}, h{}, c{};
-	auto data = stbi_load("bin/pieces.png", &w, &h, &c, 4);
+	auto data = stbi_load_from_memory(pieces_png, (int)sizeof(pieces_png), &w, &h, &c, 2);
+	if (!data)
+		std::cout << "Failed to decode the piece atlas" << std::endl;
+	startup_phase(startup, "atlas decode");
 
 	Image img{};
 	glGenTextures(1, &img.tex);
 	glBindTexture(GL_TEXTURE_2D, img.tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, w, h, 0, GL_RG, GL_UNSIGNED_BYTE, data);
+	int swizzle[]{ GL_RED, GL_RED, GL_RED, GL_GREEN };
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
@@ -318,46 +294,121 @@ Image create_image() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
 
 	stbi_image_free(data);
+	startup_phase(startup, "atlas upload");
 
 	return img;
 }
 
-void draw_rect(int x, int y, int w, int h, int sw, int sh, Vec3 col) {
-	static Rect rr = create_rect();
-	static Shader s = create_shader();
-	static Image pt = create_image();
-	glUseProgram(s.prog);
+// One quad on screen. Rects are in pixels, uvs are in atlas space and
+// color_fac = 1 draws the flat color while 0 draws the atlas sprite.
+// angle rotates the quad around its center.
+struct Instance {
+	float x, y, w, h;
+	float r, g, b, color_fac;
+	float u, v, us, vs;
+	float angle;
+};
+
+struct RenderStats {
+	uint32_t draw_calls{};
+	uint32_t instances{};
+	double cpu_frame_ms{};
+};
+
+struct Renderer {
+	Rect rect;
+	Shader shader;
+	Image pieces;
+	uint32_t instance_vbo;
+	// Instances queued for the current frame
+	std::vector<Instance> instances;
+	RenderStats stats;
+};
 
-	glUniform2f(glGetUniformLocation(s.prog, "pos"), (float)x / (float)sw, (float)y / (float)sh);
-	glUniform2f(glGetUniformLocation(s.prog, "scale"), (float)w / (float)sw, (float)h / (float)sh);
+// Creates every GPU resource up front so the first frame doesn't pay for any of it
+Renderer create_renderer(StartupTimes& startup) {
+	Renderer r{};
+	bool cached = false;
+	r.shader = create_shader(cached);
+	startup_phase(startup, cached ? "shaders (cached)" : "shaders (compiled)");
+	r.pieces = create_image(startup);
+	r.rect = create_rect();
+	r.instances.reserve(128);
+
+	// Per instance attributes live in the same vao as the unit quad
+	glBindVertexArray(r.rect.vao);
+	glGenBuffers(1, &r.instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, r.instance_vbo);
+	for (int i = 0; i < 3; i++) {
+		glVertexAttribPointer(1 + i, 4, GL_FLOAT, false, sizeof(Instance), (void*)(sizeof(float) * 4 * i));
+		glVertexAttribDivisor(1 + i, 1);
+		glEnableVertexAttribArray(1 + i);
+	}
+	glVertexAttribPointer(4, 1, GL_FLOAT, false, sizeof(Instance), (void*)(sizeof(float) * 12));
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(4);
+	startup_phase(startup, "buffers");
 
-	glUniform3f(glGetUniformLocation(s.prog, "color"), col.x, col.y, col.z);
-	glUniform1f(glGetUniformLocation(s.prog, "color_fac"), 1.f);
+	return r;
+}
 
-	glBindVertexArray(rr.vao);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+void begin_frame(Renderer& r) {
+	r.instances.clear();
+	r.stats.draw_calls = 0;
+	r.stats.instances = 0;
 }
 
-void draw_piece(int x, int y, int w, int h, int sw, int sh, uint8_t piece) {
-	static Rect rr = create_rect();
-	static Shader s = create_shader();
-	static Image pt = create_image();
-	glUseProgram(s.prog);
+void draw_rect(Renderer& r, int x, int y, int w, int h, Vec3 col) {
+	r.instances.push_back({
+		(float)x, (float)y, (float)w, (float)h,
+		col.x, col.y, col.z, 1.f,
+		0.f, 0.f, 1.f, 1.f,
+		0.f
+	});
+}
 
-	glUniform2f(glGetUniformLocation(s.prog, "pos"), (float)x / (float)sw, (float)y / (float)sh);
-	glUniform2f(glGetUniformLocation(s.prog, "scale"), (float)w / (float)sw, (float)h / (float)sh);
+void draw_line(Renderer& r, float x0, float y0, float x1, float y1, float thickness, Vec3 col) {
+	float dx = x1 - x0, dy = y1 - y0;
+	float len = std::sqrt(dx * dx + dy * dy);
+	float cx = (x0 + x1) * 0.5f, cy = (y0 + y1) * 0.5f;
+	r.instances.push_back({
+		cx - len * 0.5f, cy - thickness * 0.5f, len, thickness,
+		col.x, col.y, col.z, 1.f,
+		0.f, 0.f, 1.f, 1.f,
+		std::atan2(dy, dx)
+	});
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, pt.tex);
-	glUniform1i(glGetUniformLocation(s.prog, "tex"), 0);
+void draw_piece(Renderer& r, int x, int y, int w, int h, uint8_t piece) {
 	float xoff = ((piece & ChessBoard::PIECE_BITS) - 1) * (1.f / 6.f);
 	float yoff = (((piece & ChessBoard::COLOR_BIT)) == ChessBoard::Color::White) * 1.f / 2.f;
-	glUniform2f(glGetUniformLocation(s.prog, "tex_pos"), xoff, yoff);
-	glUniform2f(glGetUniformLocation(s.prog, "tex_scale"), 1.f / 6.f, 1.f / 2.f);
-	glUniform1f(glGetUniformLocation(s.prog, "color_fac"), 0.f);
+	r.instances.push_back({
+		(float)x, (float)y, (float)w, (float)h,
+		0.f, 0.f, 0.f, 0.f,
+		xoff, yoff, 1.f / 6.f, 1.f / 2.f,
+		0.f
+	});
+}
 
-	glBindVertexArray(rr.vao);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+// Uploads everything queued since begin_frame and draws it in a single call.
+// Instances are rasterized in submission order so pieces blend over squares.
+void end_frame(Renderer& r, int sw, int sh) {
+	if (r.instances.empty())
+		return;
+	glUseProgram(r.shader.prog);
+	glUniform2f(r.shader.screen, (float)sw, (float)sh);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, r.pieces.tex);
+	glUniform1i(r.shader.tex, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, r.instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER, r.instances.size() * sizeof(Instance), r.instances.data(), GL_STREAM_DRAW);
+
+	glBindVertexArray(r.rect.vao);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (int)r.instances.size());
+
+	r.stats.draw_calls += 1;
+	r.stats.instances += (uint32_t)r.instances.size();
 }
 
 struct Input {
@@ -374,7 +425,178 @@ bool button_was_released(const Input& current, const Input& prev, int btn) {
 	return current.btns[btn] == false && prev.btns[btn] == true;
 }
 
-void draw_board(const ChessBoard& brd, int offx, int offy, int w, int h, int sw, int sh) {
+// Input as delivered by the glfw callbacks. The main loop replays these
+// into Input snapshots so process_input sees one change at a time.
+struct InputEvent {
+	enum Type {
+		Key,
+		Button,
+		Cursor,
+		Resize,
+		Refresh,
+	};
+	Type type;
+	int code, action;
+	double x, y;
+};
+
+struct InputQueue {
+	std::vector<InputEvent> events;
+};
+
+void apply_event(Input& in, const InputEvent& ev) {
+	if (ev.type == InputEvent::Key) {
+		if (in_range(ev.code, 0, 256))
+			in.keys[ev.code] = ev.action != GLFW_RELEASE;
+	}
+	else if (ev.type == InputEvent::Button) {
+		if (in_range(ev.code, 0, 256))
+			in.btns[ev.code] = ev.action != GLFW_RELEASE;
+	}
+	else if (ev.type == InputEvent::Cursor) {
+		in.x = (int)ev.x;
+		in.y = (int)ev.y;
+	}
+}
+
+void push_event(GLFWwindow* w, InputEvent ev) {
+	((InputQueue*)glfwGetWindowUserPointer(w))->events.push_back(ev);
+}
+
+void install_input_callbacks(GLFWwindow* window, InputQueue* queue) {
+	glfwSetWindowUserPointer(window, queue);
+	glfwSetKeyCallback(window, [](GLFWwindow* w, int key, int scancode, int action, int mods) {
+		if (action != GLFW_REPEAT)
+			push_event(w, { InputEvent::Key, key, action });
+	});
+	glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int button, int action, int mods) {
+		push_event(w, { InputEvent::Button, button, action });
+	});
+	glfwSetCursorPosCallback(window, [](GLFWwindow* w, double x, double y) {
+		push_event(w, { InputEvent::Cursor, 0, 0, x, y });
+	});
+	glfwSetFramebufferSizeCallback(window, [](GLFWwindow* w, int width, int height) {
+		push_event(w, { InputEvent::Resize, 0, 0, (double)width, (double)height });
+	});
+	glfwSetWindowRefreshCallback(window, [](GLFWwindow* w) {
+		push_event(w, { InputEvent::Refresh });
+	});
+}
+
+// Frame time buckets in milliseconds, the last bucket is open ended
+struct FrameHistogram {
+	constexpr static int BUCKETS = 9;
+	constexpr static double bounds[BUCKETS - 1]{ 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.7, 33.3 };
+	uint32_t cpu[BUCKETS]{};
+	uint32_t gpu[BUCKETS]{};
+	double cpu_total{}, gpu_total{};
+	uint32_t cpu_count{}, gpu_count{};
+};
+
+int histogram_bucket(double ms) {
+	int b = 0;
+	while (b < FrameHistogram::BUCKETS - 1 && ms >= FrameHistogram::bounds[b])
+		b++;
+	return b;
+}
+
+void add_cpu_time(FrameHistogram& hist, double ms) {
+	hist.cpu[histogram_bucket(ms)]++;
+	hist.cpu_total += ms;
+	hist.cpu_count++;
+}
+
+void add_gpu_time(FrameHistogram& hist, double ms) {
+	hist.gpu[histogram_bucket(ms)]++;
+	hist.gpu_total += ms;
+	hist.gpu_count++;
+}
+
+void print_histogram(const FrameHistogram& hist) {
+	std::cout << "frame time (ms)      cpu      gpu" << std::endl;
+	for (int b = 0; b < FrameHistogram::BUCKETS; b++) {
+		char label[32];
+		if (b == FrameHistogram::BUCKETS - 1)
+			snprintf(label, sizeof(label), ">= %.2f", FrameHistogram::bounds[b - 1]);
+		else
+			snprintf(label, sizeof(label), "< %.2f", FrameHistogram::bounds[b]);
+		char line[96];
+		snprintf(line, sizeof(line), "%-16s %8u %8u", label, hist.cpu[b], hist.gpu[b]);
+		std::cout << line << std::endl;
+	}
+	std::cout
+		<< "mean cpu: " << (hist.cpu_count ? hist.cpu_total / hist.cpu_count : 0.0)
+		<< " ms, mean gpu: " << (hist.gpu_count ? hist.gpu_total / hist.gpu_count : 0.0)
+		<< " ms" << std::endl;
+}
+
+// Moves played from the position in the explorer database, most played first
+void print_explorer_moves(const ExplorerIndex& index, const ChessBoard& brd) {
+	auto start = std::chrono::steady_clock::now();
+	const ExplorerEntry* first = nullptr;
+	size_t count = explorer_lookup(index, position_hash(brd), first);
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	std::vector<const ExplorerEntry*> sorted;
+	for (size_t i = 0; i < count; i++)
+		sorted.push_back(first + i);
+	auto games = [](const ExplorerEntry* e) { return (uint64_t)e->white + e->draws + e->black; };
+	std::stable_sort(sorted.begin(), sorted.end(), [&](auto a, auto b) { return games(a) > games(b); });
+	char line[128];
+	snprintf(line, sizeof(line), "explorer: %zu moves, lookup %.1f us", count, us);
+	std::cout << line << std::endl;
+	for (auto e : sorted) {
+		format_explorer_entry(brd, *e, line, sizeof(line));
+		std::cout << "  " << line << std::endl;
+	}
+}
+
+// GPU time is measured with timer queries that are read back a few frames
+// later so the cpu never waits on the gpu.
+struct GpuTimer {
+	constexpr static int QUERIES = 4;
+	uint32_t queries[QUERIES]{};
+	bool pending[QUERIES]{};
+	int frame{};
+};
+
+GpuTimer create_gpu_timer() {
+	GpuTimer t{};
+	glGenQueries(GpuTimer::QUERIES, t.queries);
+	return t;
+}
+
+void begin_gpu_timer(GpuTimer& t) {
+	glBeginQuery(GL_TIME_ELAPSED, t.queries[t.frame % GpuTimer::QUERIES]);
+}
+
+void end_gpu_timer(GpuTimer& t, FrameHistogram& hist) {
+	glEndQuery(GL_TIME_ELAPSED);
+	t.pending[t.frame % GpuTimer::QUERIES] = true;
+	t.frame++;
+	for (int i = 0; i < GpuTimer::QUERIES; i++) {
+		if (!t.pending[i])
+			continue;
+		int available = 0;
+		glGetQueryObjectiv(t.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			uint64_t ns = 0;
+			glGetQueryObjectui64v(t.queries[i], GL_QUERY_RESULT, &ns);
+			add_gpu_time(hist, ns / 1e6);
+			t.pending[i] = false;
+		}
+	}
+}
+
+// Engine output shown on top of the board while analysis mode is on
+struct AnalysisOverlay {
+	bool enabled{ false };
+	bool has_result{ false };
+	Move best{};
+	// Centipawns from white's point of view
+	int white_score{};
+};
+
+void draw_board(Renderer& r, const ChessBoard& brd, const AnalysisOverlay& overlay, int offx, int offy, int w, int h) {
 	auto is_light_square = [](int x, int y) {
 		return (x % 2 == 0 && y % 2 == 0) || (x % 2 == 1 && y % 2 == 1);
 	};
@@ -389,13 +611,14 @@ void draw_board(const ChessBoard& brd, int offx, int offy, int w, int h, int sw,
 	auto is_selected = [&](int x, int y) {
 		return x == (brd.selected % 8) && y == (brd.selected / 8);
 	};
+	// Move targets as a square mask so each square is a single bit test
+	uint64_t move_mask = 0;
+	for (int i = 0; i < brd.move_count; i++) {
+		if (in_range(brd.move_list[i], 0, 64))
+			move_mask |= 1ull << brd.move_list[i];
+	}
 	auto is_move = [&](int x, int y) {
-		for (int i = 0; i < brd.move_count; i++) {
-			if (brd.move_list[i] == (x + y * 8)) {
-				return true;
-			}
-		}
-		return false;
+		return (move_mask >> (x + y * 8)) & 1;
 	};
 	auto is_hovered = [&](int x, int y) {
 		return brd.hovered_square == (x + y * 8);
@@ -427,464 +650,66 @@ void draw_board(const ChessBoard& brd, int offx, int offy, int w, int h, int sw,
 		int px = (i % 8) * w + offx;
 		int py = (i / 8) * h + offy;
 		auto col = get_color((i % 8), (i / 8));
-		draw_rect(px, py, w, h, sw, sh, col);
+		draw_rect(r, px, py, w, h, col);
 		if (get_type(brd, i) != 0)
-			draw_piece(px, py, w, h, sw, sh, get_piece(brd, i));
+			draw_piece(r, px, py, w, h, get_piece(brd, i));
+	}
+
+	if (overlay.enabled) {
+		// Eval bar left of the board, white fills from the top like the white pieces
+		int bar_w = w / 4;
+		int bar_x = offx - bar_w - w / 8;
+		if (bar_x < 0)
+			bar_x = 0;
+		float white_share = 0.5f;
+		if (overlay.has_result) {
+			if (is_mate_score(overlay.white_score))
+				white_share = overlay.white_score > 0 ? 1.f : 0.f;
+			else
+				white_share = 1.f / (1.f + std::pow(10.f, -overlay.white_score / 400.f));
+		}
+		int white_h = (int)(white_share * 8 * h);
+		draw_rect(r, bar_x, offy, bar_w, 8 * h - white_h, { 0.1f, 0.1f, 0.1f });
+		draw_rect(r, bar_x, offy + 8 * h - white_h, bar_w, white_h, { 0.95f, 0.95f, 0.95f });
+
+		// Best move arrow
+		if (overlay.has_result && !brd.wait_for_promotion_selection) {
+			float x0 = (overlay.best.from % 8 + 0.5f) * w + offx;
+			float y0 = (overlay.best.from / 8 + 0.5f) * h + offy;
+			float x1 = (overlay.best.to % 8 + 0.5f) * w + offx;
+			float y1 = (overlay.best.to / 8 + 0.5f) * h + offy;
+			float angle = std::atan2(y1 - y0, x1 - x0);
+			float head = w * 0.3f;
+			float thickness = w * 0.12f;
+			Vec3 col{ 0.15f, 0.55f, 0.25f };
+			draw_line(r, x0, y0, x1, y1, thickness, col);
+			for (float side : { -1.f, 1.f }) {
+				float a = angle + side * 2.5f;
+				draw_line(r, x1, y1, x1 + std::cos(a) * head, y1 + std::sin(a) * head, thickness, col);
+			}
+		}
 	}
 
 	if (brd.wait_for_promotion_selection) {
 		// Promotion select bg
-		draw_rect(2 * w + offx, 3.5 * h + offy, w * 4, h, sw, sh, { 0.2f, 0.2f, 0.2f });
+		draw_rect(r, 2 * w + offx, 3.5 * h + offy, w * 4, h, { 0.2f, 0.2f, 0.2f });
 		// Promotion select highlight
 		if (brd.selected != -1) {
 			int selection_highlight = brd.selected;
-			draw_rect((2 + selection_highlight) * w + offx, 3.5 * h + offy, w, h, sw, sh, { 0.4f, 0.2f, 0.2f });
+			draw_rect(r, (2 + selection_highlight) * w + offx, 3.5 * h + offy, w, h, { 0.4f, 0.2f, 0.2f });
 		}
 		int team = brd.current_turn == ChessBoard::White ? ChessBoard::Black : ChessBoard::White;;
 		int protion_pieces[]{ ChessBoard::Queen, ChessBoard::Rook, ChessBoard::Bishop, ChessBoard::Knight };
 		for (int a = 0; a < 4; a++) {
 			int px = (2 + a) * w + offx;
 			int py = 3.5 * h + offy;
-			draw_piece(px, py, w, h, sw, sh, protion_pieces[a] | team);
+			draw_piece(r, px, py, w, h, protion_pieces[a] | team);
 		}
 	}
 }
 
-bool in_range(int val, int min_inc, int max_ex) {
-	return (val >= min_inc) && (val < max_ex);
-}
-
-bool is_empty(const ChessBoard& brd, Position p) {
-	return get_type(brd, p) == ChessBoard::None;
-};
-
-bool is_enemy(const ChessBoard& brd, Position self, Position p) {
-	return get_color(brd, self) != get_color(brd, p) && !is_empty(brd, p);
-};
-
-
-bool is_enemy_or_empty(const ChessBoard& brd, int self, int p) {
-	return is_enemy(brd, self, p) || is_empty(brd, p);
-};
-
-bool is_own(const ChessBoard& brd, int self, int p) {
-	return
-		get_color(brd, self) == get_color(brd, p) &&
-		get_type(brd, self) != ChessBoard::None &&
-		get_type(brd, p) != ChessBoard::None;
-};
-
-bool is_in_check(const ChessBoard& brd, ChessBoard::Color c);
-
-void do_move(ChessBoard& brd, Position from_pos, Position to_pos);
-
-bool resolves_check(const ChessBoard& brd, Position pos, Position target) {
-	ChessBoard copy = brd;
-	do_move(copy, pos, target);
-	return !is_in_check(copy, brd.current_turn);
-};
-
-bool causes_check_on_self(const ChessBoard& brd, Position pos, Position target) {
-	ChessBoard copy = brd;
-	do_move(copy, pos, target);
-	return is_in_check(copy, brd.current_turn);
-};
-
-void add_move(const ChessBoard& brd, int* move_list, int& move_count, Position pos, int move) {
-	Position targ = pos.offset(move);
-	if (!is_empty(brd, targ) && (get_color(brd, pos) == get_color(brd, targ))) {
-		return;
-	}
-	assert(move_count < 64);
-	move_list[move_count] = targ.p;
-	move_count += 1;
-};
-
-bool is_valid(Position p, int move) {
-	auto np = Position(p.p + move, IgnoreInvalid::_);
-	return np.is_valid();
-};
-
-void get_pawn_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	int dir =
-		((brd.pieces[(int)p.p] & ChessBoard::COLOR_BIT) == ChessBoard::Color::Black) ?
-		Up : Down;
-	bool can_move = (dir == Up) ? (p.y() != 7) : (p.y() != 0);
-	bool can_double_move = (dir == Up) ? (p.y() == 1) : (p.y() == 6);
-
-	if (!can_move) {
-		return;
-	}
-	if (is_empty(brd, p.offset(dir))) {
-		add_move(brd, move_list, move_count, p, dir);
-		if (can_double_move && is_empty(brd, p.offset(dir * 2))) {
-			add_move(brd, move_list, move_count, p, dir * 2);
-		}
-	}
-	auto can_enpassant = [&](Position from, bool towards_left) {
-		if (brd.en_passant_target == -1) 
-			return false;
-
-		Position enemy_pawn = from.offset(towards_left ? Left : Right);
-		if (towards_left) {
-			if (enemy_pawn.x() == from.x() - 1) {
-				if (brd.en_passant_target == enemy_pawn.p) {
-					return true;
-				}
-			}
-		}
-		else {
-			if (enemy_pawn.x() == from.x() + 1) {
-				if (brd.en_passant_target == enemy_pawn.p) {
-					return true;
-				}
-			}
-		}
-		return false;
-	};
-	if (p.x() != 0) {
-		if (!is_empty(brd, p.offset(dir + Left)) && is_enemy(brd, p, p.offset(dir + Left))) {
-			add_move(brd, move_list, move_count, p, dir + Left);
-		}
-		if (can_enpassant(p, true)) {
-			add_move(brd, move_list, move_count, p, dir + Left);
-		}
-	}
-	if (p.x() != 7) {
-		if (!is_empty(brd, p.offset(dir + Right)) && is_enemy(brd, p, p.offset(dir + Right))) {
-			add_move(brd, move_list, move_count, p, dir + Right);
-		}
-		if (can_enpassant(p, false)) {
-			add_move(brd, move_list, move_count, p, dir + Right);
-		}
-	}
-};
-void get_knight_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	// return;
-
-	int possible_moves[]{ Left * 2 + Up, Left + 2 * Up, Right + 2 * Up, Right * 2 + Up, Right * 2 + Down, Right + Down * 2, Left + Down * 2, Left * 2 + Down };
-	int move_delta_x[]{ -2, -1,1, 2,2,1,-1,-2 };
-	int move_delta_y[]{ 1,2,2,1,-1,-2,-2, -1 };
-	int possible_move_cnt = 8;
-	for (int i = 0; i < possible_move_cnt; i++) {
-		int dx = move_delta_x[i];
-		int dy = move_delta_y[i];
-		int nx = p.x() + dx;
-		int ny = p.y() + dy;
-
-		// /	Position target(p.p + possible_moves[i], IgnoreInvalid::_);
-		if (!(nx >= 0 && nx < 8 && ny >= 0 && ny < 8))
-			continue;
-		// Check that move is valid
-
-		if (is_valid(p, possible_moves[i])) {
-			if (is_empty(brd, p.offset(possible_moves[i]).p) || (!is_empty(brd, p.offset(possible_moves[i]).p) && is_enemy(brd, p, p.offset(possible_moves[i]))))
-				add_move(brd, move_list, move_count, p, possible_moves[i]);
-		}
-	}
-};
-int min(int a, int b) {
-	return a < b ? a : b;
-};
-void get_bishop_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	int possible_dirs[]{ Left + Up, Right + Up, Right + Down, Left + Down };
-	int possible_dir_count = 4;
-	int max_moves_left = p.x();
-	int max_moves_right = 8 - p.x() - 1;
-	int max_moves_down = p.y();
-	int max_moves_up = 8 - p.y() - 1;
-	int max_moves_dir[]{
-		min(max_moves_left, max_moves_up),
-		min(max_moves_right, max_moves_up),
-		min(max_moves_right, max_moves_down),
-		min(max_moves_left, max_moves_down),
-	};
-	for (int i = 0; i < possible_dir_count; i++) {
-		int max_moves_direction = max_moves_dir[i];
-		if (max_moves_direction > 0) {
-			Position tp = p;
-			for (int dist = 0; dist < max_moves_direction; dist++) {
-				tp = tp.offset(possible_dirs[i]);
-				if (!is_empty(brd, tp.p) && is_enemy(brd, p, tp)) {
-					add_move(brd, move_list, move_count, p, tp.p - p.p);
-					break;
-				}
-				if (is_own(brd, p.p, tp.p)) {
-					break;
-				}
-				add_move(brd, move_list, move_count, p, tp.p - p.p);
-			}
-		}
-	}
-};
-void get_queen_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	int possible_dirs[]{ Left + Up, Right + Up, Right + Down, Left + Down, Left, Up, Right, Down };
-	int possible_dir_count = 8;
-	int max_moves_left = p.x();
-	int max_moves_right = 8 - p.x() - 1;
-	int max_moves_down = p.y();
-	int max_moves_up = 8 - p.y() - 1;
-	int max_moves_dir[]{
-		min(max_moves_left, max_moves_up),
-		min(max_moves_right, max_moves_up),
-		min(max_moves_right, max_moves_down),
-		min(max_moves_left, max_moves_down),
-		max_moves_left,
-		max_moves_up,
-		max_moves_right,
-		max_moves_down
-	};
-	for (int i = 0; i < possible_dir_count; i++) {
-		int max_moves_direction = max_moves_dir[i];
-		if (max_moves_direction > 0) {
-			Position tp = p;
-			for (int dist = 0; dist < max_moves_direction; dist++) {
-				// tp = tp.offset(possible_dirs[i]);
-				if (!is_empty(brd, p.p + possible_dirs[i] * (dist + 1)) && is_enemy(brd, p, p.p + possible_dirs[i] * (dist + 1))) {
-					add_move(brd, move_list, move_count, p, possible_dirs[i] * (dist + 1));
-					break;
-				}
-				if (is_own(brd, p.p, p.p + possible_dirs[i] * (dist + 1))) {
-					break;
-				}
-				add_move(brd, move_list, move_count, p, possible_dirs[i] * (dist + 1));
-			}
-		}
-	}
-};
-void get_rook_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	int possible_dirs[]{ Left, Up, Right, Down };
-	int possible_dir_count = 4;
-	int max_moves_left = p.x();
-	int max_moves_right = 8 - p.x() - 1;
-	int max_moves_down = p.y();
-	int max_moves_up = 8 - p.y() - 1;
-	int max_moves_dir[]{
-		max_moves_left,
-		max_moves_up,
-		max_moves_right,
-		max_moves_down
-	};
-	for (int i = 0; i < possible_dir_count; i++) {
-		int max_moves_direction = max_moves_dir[i];
-		if (max_moves_direction > 0) {
-			Position tp = p;
-			for (int dist = 0; dist < max_moves_direction; dist++) {
-				// tp = tp.offset(possible_dirs[i]);
-				if (!is_empty(brd, p.p + possible_dirs[i] * (dist + 1)) && is_enemy(brd, p, p.p + possible_dirs[i] * (dist + 1))) {
-					add_move(brd, move_list, move_count, p, possible_dirs[i] * (dist + 1));
-					break;
-				}
-				if (is_own(brd, p.p, p.p + possible_dirs[i] * (dist + 1))) {
-					break;
-				}
-				add_move(brd, move_list, move_count, p, possible_dirs[i] * (dist + 1));
-			}
-		}
-	}
-};
-void get_king_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	int possible_dirs[]{ Left + Up, Right + Up, Right + Down, Left + Down, Up, Down, Left, Right };
-	int possible_dir_count = 8;
-	for (int i = 0; i < possible_dir_count; i++) {
-		if (is_valid(p, possible_dirs[i])) {
-			if (is_empty(brd, p.offset(possible_dirs[i]).p) || (!is_empty(brd, p.offset(possible_dirs[i]).p) && is_enemy(brd, p, p.offset(possible_dirs[i])))) {
-				auto target = p.offset(possible_dirs[i]);
-				int dx = target.x() > p.x() ? target.x() - p.x() : p.x() - target.x();
-				int dy = target.y() > p.y() ? target.y() - p.y() : p.y() - target.y();
-				if ((dx == 1 && dy == 0) || (dy == 1 && dx == 0) || (dy == 1 && dx == 1)) {
-					add_move(brd, move_list, move_count, p, possible_dirs[i]);
-				}
-			}
-		}
-	}
-
-	ChessBoard::Color team = get_color(brd, p);
-	int king_row = (team == ChessBoard::White) ? 7 : 0;
-
-	bool can_king_side_castle = 
-		((team == ChessBoard::White) ? brd.white_king_side : brd.black_king_side) &&
-		(p.x() == 4) && (p.y() == king_row) &&
-		(get_piece(brd, Position(7, king_row)) == (ChessBoard::Rook | team)) &&
-		is_empty(brd, Position(5, king_row)) &&
-		is_empty(brd, Position(6, king_row));
-
-	bool can_queen_side_castle = 
-		((team == ChessBoard::White) ? brd.white_queen_side : brd.black_queen_side) &&
-		(p.x() == 4) && (p.y() == king_row) &&
-		(get_piece(brd, Position(0, king_row)) == (ChessBoard::Rook | team)) &&
-		is_empty(brd, Position(1, king_row)) &&
-		is_empty(brd, Position(2, king_row)) &&
-		is_empty(brd, Position(3, king_row));
-
-	if (can_queen_side_castle) {
-		add_move(brd, move_list, move_count, p, Left * 2);
-	}
-	if (can_king_side_castle) {
-		add_move(brd, move_list, move_count, p, Right * 2);
-	}
-};
-
-void get_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	auto type = get_type(brd, p);
-	if (type == ChessBoard::Pawn)
-		get_pawn_moves(brd, move_list, move_count, p);
-	else if (type == ChessBoard::Knight)
-		get_knight_moves(brd, move_list, move_count, p);
-	else if (type == ChessBoard::Bishop)
-		get_bishop_moves(brd, move_list, move_count, p);
-	else if (type == ChessBoard::Queen)
-		get_queen_moves(brd, move_list, move_count, p);
-	else if (type == ChessBoard::King)
-		get_king_moves(brd, move_list, move_count, p);
-	else if (type == ChessBoard::Rook)
-		get_rook_moves(brd, move_list, move_count, p);
-	else {
-		move_count = 0;
-	}
-};
-
-void get_valid_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p) {
-	move_count = 0;
-	get_moves(brd, move_list, move_count, p);
-	int valid_move_count = 0;
-	for (int mv_i = 0; mv_i < move_count; mv_i++) {
-		if (brd.is_check) {
-			if (resolves_check(brd, p, move_list[mv_i])) {
-				move_list[valid_move_count] = move_list[mv_i];
-				valid_move_count++;
-			}
-		}
-		else {
-			if (!causes_check_on_self(brd, p, move_list[mv_i])) {
-				move_list[valid_move_count] = move_list[mv_i];
-				valid_move_count++;
-			}
-		}
-	}
-	move_count = valid_move_count;
-}
-
-bool is_in_check(const ChessBoard& brd, ChessBoard::Color c) {
-	Position king_location = (c == ChessBoard::White) ? brd.white_king_position : brd.black_king_position;
-	ChessBoard::Color opposingColor = (c == ChessBoard::White) ? ChessBoard::Black : ChessBoard::White;
-	for (int i = 0; i < 64; i++) {
-		Position from(i);
-		if (!is_empty(brd, i) && ((get_color(brd, from) == opposingColor))) {
-			int piece_move_list[64]{};
-			int piece_move_count = 0;
-			get_moves(brd, piece_move_list, piece_move_count, from);
-			for (int mv_i = 0; mv_i < piece_move_count; mv_i++) {
-				Position target(piece_move_list[mv_i]);
-				if (target.p == king_location.p) {
-					return true;
-				}
-			}
-		}
-	}
-	return false;
-};
-
-bool is_in_checkmate(const ChessBoard& brd, ChessBoard::Color c) {
-	ChessBoard copy = brd;
-	Position king_location = (c == ChessBoard::White) ? brd.white_king_position : brd.black_king_position;
-	for (int i = 0; i < 64; i++) {
-		Position from(i);
-		if (!is_empty(copy, i) && ((get_color(copy, from) == c))) {
-			int piece_move_list[64]{};
-			int piece_move_count = 0;
-			get_valid_moves(copy, piece_move_list, piece_move_count, from);
-			if (piece_move_count != 0) {
-				return false;
-			}
-		}
-	}
-	return true;
-};
-
-void do_move(ChessBoard& brd, Position from_pos, Position to_pos) {
-	if (from_pos.p == to_pos.p)
-		return;
-	// for (int k = 0; k < 64; k++) {
-		// Check if valid move
-		// if (brd.highlights[k] != -1 && brd.highlights[k] == to_pos) {
-			// if (in_range(brd.selected, 0, 64)) {
-				// Was valid so do the move
-	if (get_type(brd, from_pos) == ChessBoard::Pawn) {
-		// Was a pawn
-		int py = to_pos.y();
-		int dy = from_pos.y() > py ? from_pos.y() - py : py - from_pos.y();
-		if (dy == 2) {
-			// Was double move so update en passant target
-			brd.en_passant_target = to_pos.p;
-		}
-		else {
-			// Was single move so check wether it was en passant capture
-			int px = to_pos.x();
-			int dx = from_pos.x() > px ? from_pos.x() - px : px - from_pos.x();
-			if ((brd.en_passant_target + Down * dy == to_pos.p)) {
-				// Was en passant so clear en passant target and capture the pawn there
-				assert(in_range(brd.en_passant_target, 0, 64));
-				brd.pieces[brd.en_passant_target] = 0;
-				brd.en_passant_target = -1;
-			}
-			// Wasn't double move so clear en passant target
-			brd.en_passant_target = -1;
-		}
-		if ((to_pos.y() == 7) || (to_pos.y() == 0)) {
-			brd.to_be_promoted = to_pos.p;
-			brd.wait_for_promotion_selection = true;
-		}
-	}
-	else {
-		brd.en_passant_target = -1;
-	}
-
-	if (get_type(brd, from_pos) == ChessBoard::King) {
-		int dx = to_pos.x() - from_pos.x();
-		ChessBoard::Color team = get_color(brd, from_pos);
-		int king_row = (team == ChessBoard::White) ? 7 : 0;
-		if (dx == 2) {
-			brd.pieces[Position(7, king_row).p] = 0;
-			brd.pieces[Position(5, king_row).p] = ChessBoard::Rook | team;
-			assert(in_range(Position(7, king_row).p, 0, 64));
-			assert(in_range(Position(5, king_row).p, 0, 64));
-		}
-		else if (dx == -2) {
-			brd.pieces[Position(0, king_row).p] = 0;
-			brd.pieces[Position(3, king_row).p] = ChessBoard::Rook | team;
-			assert(in_range(Position(0, king_row).p, 0, 64));
-			assert(in_range(Position(3, king_row).p, 0, 64));
-		}
-
-		// Update king positions if king was moved
-		if(team == ChessBoard::White)
-			brd.white_king_position = to_pos.p;
-		else 
-			brd.black_king_position = to_pos.p;
-	}
-
-	/* if (brd.pieces[from_pos.p] == (ChessBoard::Color::White | ChessBoard::King)) {
-		brd.white_king_position = to_pos.p;
-	}
-	if (brd.pieces[from_pos.p] == (ChessBoard::Color::Black | ChessBoard::King)) {
-		brd.black_king_position = to_pos.p;
-	}*/
-
-	assert(in_range(to_pos.p, 0, 64));
-	assert(in_range(from_pos.p, 0, 64));
-	brd.pieces[to_pos.p] = brd.pieces[from_pos.p];
-	brd.pieces[from_pos.p] = 0;
-
-	if (brd.current_turn == ChessBoard::Color::Black) {
-		brd.current_turn = ChessBoard::Color::White;
-	}
-	else {
-		brd.current_turn = ChessBoard::Color::Black;
-	}
-};
-
 void process_input(ChessBoard& brd, const Input& cin, const Input& pin, int sw, int sh) {
+	PROFILE_SCOPE("process_input");
 	int h = 0;
 	int w = 0;
 	int offx = 0;
@@ -912,6 +737,9 @@ void process_input(ChessBoard& brd, const Input& cin, const Input& pin, int sw,
 		on_screen = true;
 	}
 
+	int prev_hovered = brd.hovered_square;
+	int prev_selected = brd.selected;
+
 	brd.move_count = 0;
 	for (int i = 0; i < 64; i++)
 		brd.move_list[i] = -1;
@@ -1015,9 +843,17 @@ void process_input(ChessBoard& brd, const Input& cin, const Input& pin, int sw,
 	if (key_was_released(cin, pin, GLFW_KEY_R)) {
 		init(brd);
 	}
+
+	if (button_was_released(cin, pin, GLFW_MOUSE_BUTTON_1) ||
+		key_was_released(cin, pin, GLFW_KEY_R) ||
+		brd.hovered_square != prev_hovered ||
+		brd.selected != prev_selected) {
+		brd.dirty = true;
+	}
 }
 
-void draw(ChessBoard& brd, int sw, int sh) {
+void draw(Renderer& r, ChessBoard& brd, const AnalysisOverlay& overlay, int sw, int sh) {
+	PROFILE_SCOPE("draw");
 	int h = 0;
 	int w = 0;
 	int offx = 0;
@@ -1032,14 +868,55 @@ void draw(ChessBoard& brd, int sw, int sh) {
 		h = w;
 		offy = (sh - h * 8) / 2;
 	}
-	draw_board(brd, offx, offy, w, h, sw, sh);
+	begin_frame(r);
+	draw_board(r, brd, overlay, offx, offy, w, h);
+	end_frame(r, sw, sh);
 }
 
-int main() {
+int main(int argc, char** argv) {
+	// --frames N exits after N frames, --stats prints renderer counters once a second
+	// and a frame time histogram on exit. --continuous redraws every frame instead of
+	// waiting for input. With LIBGL_ALWAYS_SOFTWARE=1 the renderer runs on Mesa without a GPU.
+	// --analyse starts with analysis mode on, it can be toggled with A.
+	// --explorer games.idx prints the moves played from every position reached
+	// in that opening explorer index (see tools/explorer). --stats also prints how
+	// long each startup phase took.
+	StartupTimes startup{};
+	int max_frames = -1;
+	const char* explorer_path = nullptr;
+	bool print_stats = false;
+	bool continuous = false;
+	AnalysisOverlay overlay{};
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			max_frames = atoi(argv[++i]);
+			continuous = true;
+		}
+		else if (strcmp(argv[i], "--stats") == 0)
+			print_stats = true;
+		else if (strcmp(argv[i], "--continuous") == 0)
+			continuous = true;
+		else if (strcmp(argv[i], "--analyse") == 0)
+			overlay.enabled = true;
+		else if (strcmp(argv[i], "--explorer") == 0 && i + 1 < argc)
+			explorer_path = argv[++i];
+	}
+
+	ExplorerIndex explorer{};
+	bool has_explorer = false;
+	if (explorer_path) {
+		has_explorer = open_explorer(explorer, explorer_path);
+		if (!has_explorer)
+			std::cout << "Failed to open explorer index " << explorer_path << std::endl;
+		startup_phase(startup, "explorer index");
+	}
+
 	glfwInit();
+	startup_phase(startup, "glfw init");
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 	GLFWwindow* window = glfwCreateWindow(1280, 720, "Chess", nullptr, nullptr);
 	glfwMakeContextCurrent(window);
+	startup_phase(startup, "window and context");
 	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
 
 	glEnable(GL_DEBUG_OUTPUT);
@@ -1054,36 +931,147 @@ int main() {
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	startup_phase(startup, "gl functions");
+	Renderer renderer = create_renderer(startup);
+	GpuTimer gpu_timer = create_gpu_timer();
+	FrameHistogram histogram{};
+
+	InputQueue queue{};
+	install_input_callbacks(window, &queue);
+
 	Input current{};
 	Input prev{};
 
-	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
+	// The worker wakes the render loop whenever a new iteration finished
+	Analysis analysis{};
+	start_analysis(analysis, []() { glfwPostEmptyEvent(); });
+	startup_phase(startup, "analysis thread");
+	ChessBoard analysed{};
+	bool analysing = false;
+	ChessBoard explored{};
+	bool explored_any = false;
+
+	// Accumulated stats for --stats
+	int frame = 0;
+	int stat_frames = 0;
+	double stat_cpu_ms = 0.0;
+	auto stat_start = std::chrono::steady_clock::now();
+
+	while (!glfwWindowShouldClose(window) && frame != max_frames) {
+		// Sleep until there is input. Other threads wake the loop with glfwPostEmptyEvent.
+		if (continuous || board.dirty)
+			glfwPollEvents();
+		else
+			glfwWaitEvents();
+
+		auto frame_start = std::chrono::steady_clock::now();
 
-		prev = current;
-		for (int i = 0; i < 256; i++) {
-			current.keys[i] = glfwGetKey(window, i);
-			current.btns[i] = glfwGetMouseButton(window, i);
-		}
+		int sw, sh;
+		glfwGetFramebufferSize(window, &sw, &sh);
 
-		double cx{}, cy{};
-		glfwGetCursorPos(window, &cx, &cy);
+		for (const InputEvent& ev : queue.events) {
+			if (ev.type == InputEvent::Resize || ev.type == InputEvent::Refresh) {
+				board.dirty = true;
+				continue;
+			}
+			prev = current;
+			apply_event(current, ev);
+			process_input(board, current, prev, sw, sh);
+			if (key_was_released(current, prev, GLFW_KEY_A)) {
+				overlay.enabled = !overlay.enabled;
+				board.dirty = true;
+			}
+		}
+		queue.events.clear();
+
+		// Restart the analysis whenever the position changed, stale results are dropped by generation
+		bool can_analyse = overlay.enabled && !board.is_checkmate && !board.wait_for_promotion_selection;
+		if (can_analyse && (!analysing || !same_position(board, analysed))) {
+			analysed = board;
+			analysing = true;
+			overlay.has_result = false;
+			analyse_position(analysis, board);
+			board.dirty = true;
+		}
+		else if (!can_analyse && analysing) {
+			analysing = false;
+			overlay.has_result = false;
+			stop_analysis(analysis);
+			board.dirty = true;
+		}
+		AnalysisResult result{};
+		if (analysing && poll_analysis(analysis, result) && result.info.pv_length > 0) {
+			const SearchInfo& info = result.info;
+			overlay.has_result = true;
+			overlay.best = info.pv[0];
+			overlay.white_score = analysed.current_turn == ChessBoard::White ? info.score : -info.score;
+			board.dirty = true;
+
+			char line[512];
+			int n = snprintf(line, sizeof(line), "depth %d score %+.2f nodes %llu nps %.0f pv",
+				info.depth, overlay.white_score / 100.0, (unsigned long long)info.nodes, info.nps);
+			for (int i = 0; i < info.pv_length && n < (int)sizeof(line) - 8; i++) {
+				char mv[8];
+				move_to_string(info.pv[i], mv);
+				n += snprintf(line + n, sizeof(line) - n, " %s", mv);
+			}
+			std::cout << line << std::endl;
+			glfwSetWindowTitle(window, line);
+		}
 
-		current.x = (int)cx;
-		current.y = (int)cy;
+		if (has_explorer && !board.wait_for_promotion_selection && (!explored_any || !same_position(board, explored))) {
+			explored = board;
+			explored_any = true;
+			print_explorer_moves(explorer, board);
+		}
 
-		int sw, sh;
-		glfwGetFramebufferSize(window, &sw, &sh);
+		if (!board.dirty && !continuous)
+			continue;
+		board.dirty = false;
 
 		glViewport(0, 0, sw, sh);
 
+		begin_gpu_timer(gpu_timer);
 		glClearColor(244.f / 255.f, 163.f / 255.f, 132.f / 255.f, 1.f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		process_input(board, current, prev, sw, sh);
-		draw(board, sw, sh);
+		draw(renderer, board, overlay, sw, sh);
+		end_gpu_timer(gpu_timer, histogram);
+
+		auto frame_end = std::chrono::steady_clock::now();
+		renderer.stats.cpu_frame_ms = std::chrono::duration<double, std::milli>(frame_end - frame_start).count();
+		add_cpu_time(histogram, renderer.stats.cpu_frame_ms);
 
 		glfwSwapBuffers(window);
+		frame++;
+		if (frame == 1) {
+			startup_phase(startup, "first frame");
+			if (print_stats)
+				print_startup_times(startup);
+		}
+
+		if (print_stats) {
+			stat_frames++;
+			stat_cpu_ms += renderer.stats.cpu_frame_ms;
+			double elapsed = std::chrono::duration<double>(frame_end - stat_start).count();
+			if (elapsed >= 1.0 || frame == max_frames) {
+				std::cout
+					<< "frames: " << stat_frames
+					<< " draw calls/frame: " << renderer.stats.draw_calls
+					<< " instances/frame: " << renderer.stats.instances
+					<< " cpu ms/frame: " << stat_cpu_ms / stat_frames << std::endl;
+				stat_frames = 0;
+				stat_cpu_ms = 0.0;
+				stat_start = frame_end;
+			}
+		}
 	}
+	if (print_stats) {
+		print_histogram(histogram);
+	}
+	shutdown_analysis(analysis);
+	if (has_explorer)
+		close_explorer(explorer);
+	PROFILE_FLUSH();
 	// OS will do the cleanup on app exit so don't even bother
-}
\ No newline at end of file
+}
@@ -0,0 +1,262 @@
+#include "mate.h"
+#include "zobrist.h"
+#include "profile.h"
+#include <algorithm>
+#include <chrono>
+
+// Proof numbers saturate here, a node with phi or delta INF is decided
+constexpr uint32_t PN_INF = 1u << 30;
+
+struct MateSearch {
+	MateTable* table;
+	const std::atomic<bool>* stop;
+	uint64_t node_limit;
+	uint64_t nodes;
+	bool aborted;
+};
+
+void mate_table_resize(MateTable& table, size_t megabytes) {
+	size_t count = 4;
+	while (count * 2 * sizeof(MateEntry) <= megabytes * 1024 * 1024)
+		count *= 2;
+	table.entries.assign(count, MateEntry{});
+	table.mask = count - 1;
+}
+
+void mate_table_clear(MateTable& table) {
+	table.entries.assign(table.entries.size(), MateEntry{});
+}
+
+// The same position with a different number of plies left is a different node
+static uint64_t node_key(uint64_t hash, int remaining) {
+	return hash ^ (0x9E3779B97F4A7C15ull * (uint64_t)(remaining + 1));
+}
+
+static uint32_t saturate(uint64_t n) {
+	return (uint32_t)std::min<uint64_t>(n, PN_INF);
+}
+
+// Unknown nodes start at 1 / 1
+static void lookup(const MateTable& table, uint64_t key, uint32_t& phi, uint32_t& delta, uint32_t* work = nullptr) {
+	const MateEntry* bucket = &table.entries[key & table.mask & ~3ull];
+	for (int i = 0; i < 4; i++) {
+		if (bucket[i].key == key) {
+			phi = bucket[i].phi;
+			delta = bucket[i].delta;
+			if (work)
+				*work = bucket[i].work;
+			return;
+		}
+	}
+	phi = delta = 1;
+	if (work)
+		*work = 0;
+}
+
+static void store(MateTable& table, uint64_t key, uint32_t phi, uint32_t delta, uint64_t work) {
+	MateEntry* bucket = &table.entries[key & table.mask & ~3ull];
+	MateEntry* slot = bucket;
+	for (int i = 0; i < 4; i++) {
+		if (bucket[i].key == key) {
+			slot = bucket + i;
+			break;
+		}
+		// Decided nodes are worth more than open ones of the same cost
+		auto value = [](const MateEntry& e) { return (uint64_t)e.work + ((e.phi == 0 || e.delta == 0) ? 64 : 0); };
+		if (value(bucket[i]) < value(*slot))
+			slot = bucket + i;
+	}
+	*slot = { key, phi, delta, saturate(work) };
+}
+
+static bool should_stop(MateSearch& ms) {
+	ms.nodes++;
+	if ((ms.nodes & 1023) == 0) {
+		if (ms.stop->load(std::memory_order_relaxed) || (ms.node_limit && ms.nodes >= ms.node_limit))
+			ms.aborted = true;
+	}
+	return ms.aborted;
+}
+
+// Values of a node without moves or plies left. The attacker moves at odd
+// remaining plies, so the defender is to move at even ones and at 0.
+static bool terminal(const ChessBoard& brd, int count, int remaining, uint32_t& phi, uint32_t& delta) {
+	bool attacker = remaining % 2 == 1;
+	if (count == 0) {
+		// Mate or stalemate, either way the side to move has lost the race
+		bool mated = brd.is_check;
+		bool side_to_move_wins = attacker ? false : !mated;
+		phi = side_to_move_wins ? 0 : PN_INF;
+		delta = side_to_move_wins ? PN_INF : 0;
+		return true;
+	}
+	if (remaining == 0) {
+		// The defender survived the last attacking move
+		phi = 0;
+		delta = PN_INF;
+		return true;
+	}
+	return false;
+}
+
+// Multiple iterative deepening (Nagai's df-pn). Expands the most proving child
+// until the node's phi or delta reaches its threshold.
+static void mid(MateSearch& ms, const ChessBoard& brd, uint64_t key, int remaining, uint32_t th_phi, uint32_t th_delta) {
+	if (should_stop(ms))
+		return;
+	uint64_t nodes_before = ms.nodes;
+	Move moves[MAX_MOVES];
+	int count = get_all_valid_moves(brd, moves);
+	uint32_t phi, delta;
+	if (terminal(brd, count, remaining, phi, delta)) {
+		store(*ms.table, key, phi, delta, 1);
+		return;
+	}
+
+	uint64_t child_keys[MAX_MOVES];
+	for (int i = 0; i < count; i++) {
+		PROFILE_COUNT("board_copy");
+		ChessBoard child = brd;
+		make_move(child, moves[i]);
+		child_keys[i] = node_key(position_hash(child), remaining - 1);
+	}
+
+	for (;;) {
+		// phi is the smallest child delta, delta the sum of child phis
+		uint64_t delta_sum = 0;
+		uint32_t min_delta = PN_INF, second_delta = PN_INF, best_phi = PN_INF;
+		int best = 0;
+		for (int i = 0; i < count; i++) {
+			uint32_t c_phi, c_delta;
+			lookup(*ms.table, child_keys[i], c_phi, c_delta);
+			delta_sum += c_phi;
+			if (c_delta < min_delta) {
+				second_delta = min_delta;
+				min_delta = c_delta;
+				best_phi = c_phi;
+				best = i;
+			}
+			else if (c_delta < second_delta)
+				second_delta = c_delta;
+		}
+		phi = min_delta;
+		delta = saturate(delta_sum);
+		if (phi >= th_phi || delta >= th_delta || ms.aborted)
+			break;
+
+		uint32_t child_th_phi = saturate((uint64_t)th_delta + best_phi - delta);
+		uint32_t child_th_delta = std::min<uint32_t>(th_phi, second_delta == PN_INF ? PN_INF : second_delta + 1);
+		ChessBoard child = brd;
+		make_move(child, moves[best]);
+		mid(ms, child, child_keys[best], remaining - 1, child_th_phi, child_th_delta);
+	}
+	if (!ms.aborted)
+		store(*ms.table, key, phi, delta, ms.nodes - nodes_before);
+}
+
+// Searches the node until it is decided, false once the search was stopped
+static bool resolve(MateSearch& ms, const ChessBoard& brd, int remaining, uint32_t& phi, uint32_t& delta) {
+	uint64_t key = node_key(position_hash(brd), remaining);
+	lookup(*ms.table, key, phi, delta);
+	while (phi != 0 && delta != 0 && !ms.aborted) {
+		mid(ms, brd, key, remaining, PN_INF, PN_INF);
+		lookup(*ms.table, key, phi, delta);
+	}
+	return !ms.aborted;
+}
+
+// Picks the move to follow in a proven tree: a proven mating move for the
+// attacker, every defence in turn for the defender. Children that dropped out
+// of the table are searched again.
+static int proven_children(MateSearch& ms, const ChessBoard& brd, int remaining, Move* moves, uint32_t* work) {
+	int count = get_all_valid_moves(brd, moves);
+	bool attacker = remaining % 2 == 1;
+	int kept = 0;
+	for (int i = 0; i < count; i++) {
+		ChessBoard child = brd;
+		make_move(child, moves[i]);
+		uint32_t phi, delta, w;
+		lookup(*ms.table, node_key(position_hash(child), remaining - 1), phi, delta, &w);
+		if (phi != 0 && delta != 0 && !resolve(ms, child, remaining - 1, phi, delta))
+			return 0;
+		lookup(*ms.table, node_key(position_hash(child), remaining - 1), phi, delta, &w);
+		// A proven child of the attacker has delta 0, the defender's children all do
+		if (delta == 0 || !attacker) {
+			moves[kept] = moves[i];
+			work[kept] = w;
+			kept++;
+		}
+		if (attacker && delta == 0)
+			break;
+	}
+	return kept;
+}
+
+static void main_line(MateSearch& ms, ChessBoard brd, int remaining, MateInfo& info) {
+	while (remaining > 0 && info.line_length < MAX_PLY && !ms.aborted) {
+		Move moves[MAX_MOVES];
+		uint32_t work[MAX_MOVES];
+		int count = proven_children(ms, brd, remaining, moves, work);
+		if (count == 0)
+			break;
+		// The defence that took the most work to refute is the most stubborn one
+		int pick = 0;
+		for (int i = 1; i < count; i++) {
+			if (work[i] > work[pick])
+				pick = i;
+		}
+		info.line[info.line_length++] = moves[pick];
+		make_move(brd, moves[pick]);
+		remaining--;
+	}
+}
+
+static uint64_t proof_size(MateSearch& ms, const ChessBoard& brd, int remaining, uint64_t budget) {
+	if (remaining == 0 || budget == 0 || ms.aborted)
+		return 1;
+	Move moves[MAX_MOVES];
+	uint32_t work[MAX_MOVES];
+	int count = proven_children(ms, brd, remaining, moves, work);
+	uint64_t size = 1;
+	for (int i = 0; i < count && size < budget; i++) {
+		ChessBoard child = brd;
+		make_move(child, moves[i]);
+		size += proof_size(ms, child, remaining - 1, budget - size);
+	}
+	return size;
+}
+
+MateInfo solve_mate(const ChessBoard& brd, const MateLimits& limits, MateTable& table, const std::atomic<bool>& stop) {
+	auto start = std::chrono::steady_clock::now();
+	MateSearch ms{ &table, &stop, limits.nodes, 0, false };
+	if (table.entries.empty())
+		mate_table_resize(table, 16);
+
+	ChessBoard root = brd;
+	root.is_check = is_in_check(root, root.current_turn);
+	MateInfo info{};
+	int max_moves = std::clamp(limits.moves, 1, MAX_PLY / 2);
+	PROFILE_SCOPE("solve_mate");
+	for (int moves = 1; moves <= max_moves; moves++) {
+		int remaining = moves * 2 - 1;
+		uint32_t phi, delta;
+		if (!resolve(ms, root, remaining, phi, delta))
+			break;
+		if (phi == 0) {
+			info.result = MateProven;
+			info.mate_in = moves;
+			main_line(ms, root, remaining, info);
+			info.proof_size = proof_size(ms, root, remaining, MAX_PROOF_SIZE);
+			break;
+		}
+		if (moves == max_moves)
+			info.result = MateDisproven;
+	}
+	// An interrupted proof tree walk leaves the result standing but not the line
+	if (ms.aborted && info.result == MateProven && info.line_length == 0)
+		info.result = MateUnknown;
+	info.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	info.nodes = ms.nodes;
+	info.nps = info.seconds > 0 ? ms.nodes / info.seconds : 0.0;
+	return info;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chess.h"
+#include "search.h"
+
+// Proof and disproof numbers stored from the point of view of the side to
+// move at the node (phi / delta), keyed by position and remaining plies
+struct MateEntry {
+	uint64_t key{};
+	uint32_t phi{}, delta{};
+	// Nodes spent below this entry, the replacement keeps the costlier one
+	uint32_t work{};
+};
+
+// Fixed size table in buckets of four entries. Not thread safe, every
+// solver thread owns its own.
+struct MateTable {
+	std::vector<MateEntry> entries;
+	uint64_t mask{};
+};
+
+void mate_table_resize(MateTable& table, size_t megabytes);
+void mate_table_clear(MateTable& table);
+
+enum MateResult {
+	MateUnknown,
+	// The side to move mates in at most the given number of moves
+	MateProven,
+	// No mate within the bound, whatever the side to move plays
+	MateDisproven,
+};
+
+struct MateLimits {
+	// Moves of the side to move, mate in 3 is 5 plies
+	int moves = 3;
+	// Node budget, 0 for no limit
+	uint64_t nodes = 0;
+};
+
+struct MateInfo {
+	MateResult result{ MateUnknown };
+	// Shortest mate found, in moves
+	int mate_in{};
+	// Main line: the mating moves, with the longest defence the table knows
+	Move line[MAX_PLY]{};
+	int line_length{};
+	// Nodes of the proof tree, capped at MAX_PROOF_SIZE
+	uint64_t proof_size{};
+	uint64_t nodes{};
+	double seconds{}, nps{};
+};
+
+constexpr uint64_t MAX_PROOF_SIZE = 1000000;
+
+// Depth first proof number search for a mate in at most limits.moves moves.
+// Bounds are tried from mate in 1 upwards so the mate found is the shortest.
+MateInfo solve_mate(const ChessBoard& brd, const MateLimits& limits, MateTable& table, const std::atomic<bool>& stop);
@@ -0,0 +1,169 @@
+#include "profile.h"
+
+#ifdef CHESS_PROFILE
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+constexpr uint32_t MAX_SITES = 256;
+// Trace events kept per thread, the summary keeps counting past this
+constexpr size_t MAX_EVENTS = 1 << 20;
+
+struct ProfileEvent {
+	uint32_t site;
+	uint64_t start, duration;
+};
+
+struct ProfileThread {
+	uint32_t tid;
+	std::vector<ProfileEvent> events;
+	uint64_t calls[MAX_SITES]{};
+	uint64_t total_ns[MAX_SITES]{};
+	uint64_t max_ns[MAX_SITES]{};
+};
+
+struct Profiler {
+	std::mutex mutex;
+	const char* names[MAX_SITES]{};
+	bool is_counter[MAX_SITES]{};
+	std::atomic<uint32_t> site_count{ 0 };
+	// Thread buffers outlive their threads so they can be flushed at exit
+	std::vector<std::unique_ptr<ProfileThread>> threads;
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+static Profiler& profiler() {
+	static Profiler p;
+	return p;
+}
+
+static uint64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler().epoch).count();
+}
+
+static ProfileThread& this_thread_buffer() {
+	thread_local ProfileThread* buffer = nullptr;
+	if (!buffer) {
+		Profiler& p = profiler();
+		std::lock_guard<std::mutex> lock(p.mutex);
+		p.threads.push_back(std::make_unique<ProfileThread>());
+		buffer = p.threads.back().get();
+		buffer->tid = (uint32_t)p.threads.size();
+		buffer->events.reserve(4096);
+	}
+	return *buffer;
+}
+
+ProfileSite::ProfileSite(const char* name, bool counter) {
+	Profiler& p = profiler();
+	std::lock_guard<std::mutex> lock(p.mutex);
+	uint32_t count = p.site_count.load();
+	// The same name from several call sites shares one entry
+	for (id = 0; id < count; id++) {
+		if (p.names[id] == name || strcmp(p.names[id], name) == 0)
+			return;
+	}
+	id = std::min(count, MAX_SITES - 1);
+	p.names[id] = name;
+	p.is_counter[id] = counter;
+	p.site_count = std::min(count + 1, MAX_SITES);
+}
+
+ProfileScope::ProfileScope(const ProfileSite& site) : id(site.id), start(now_ns()) {}
+
+ProfileScope::~ProfileScope() {
+	uint64_t duration = now_ns() - start;
+	ProfileThread& t = this_thread_buffer();
+	t.calls[id]++;
+	t.total_ns[id] += duration;
+	t.max_ns[id] = std::max(t.max_ns[id], duration);
+	if (t.events.size() < MAX_EVENTS)
+		t.events.push_back({ id, start, duration });
+}
+
+void profile_count(const ProfileSite& site) {
+	this_thread_buffer().calls[site.id]++;
+}
+
+static void write_json_string(FILE* f, const char* s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+void profile_flush() {
+	Profiler& p = profiler();
+	std::lock_guard<std::mutex> lock(p.mutex);
+	uint32_t sites = p.site_count.load();
+
+	const char* path = getenv("CHESS_TRACE");
+	if (!path)
+		path = "chess_trace.json";
+	FILE* f = fopen(path, "w");
+	if (f) {
+		fprintf(f, "{\"traceEvents\":[\n");
+		bool first = true;
+		for (auto& t : p.threads) {
+			for (const ProfileEvent& ev : t->events) {
+				fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+				write_json_string(f, p.names[ev.site]);
+				fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					t->tid, ev.start / 1000.0, ev.duration / 1000.0);
+				first = false;
+			}
+			// Counters are emitted once per thread with their final value
+			uint64_t end = now_ns();
+			for (uint32_t s = 0; s < sites; s++) {
+				if (!p.is_counter[s] || t->calls[s] == 0)
+					continue;
+				fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+				write_json_string(f, p.names[s]);
+				fprintf(f, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"count\":%llu}}",
+					t->tid, end / 1000.0, (unsigned long long)t->calls[s]);
+				first = false;
+			}
+		}
+		fprintf(f, "\n]}\n");
+		fclose(f);
+	}
+
+	// Summary over all threads, slowest total first
+	struct Row {
+		uint32_t site;
+		uint64_t calls, total_ns, max_ns;
+	};
+	std::vector<Row> rows;
+	for (uint32_t s = 0; s < sites; s++) {
+		Row r{ s };
+		for (auto& t : p.threads) {
+			r.calls += t->calls[s];
+			r.total_ns += t->total_ns[s];
+			r.max_ns = std::max(r.max_ns, t->max_ns[s]);
+		}
+		if (r.calls)
+			rows.push_back(r);
+	}
+	std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+		return a.total_ns != b.total_ns ? a.total_ns > b.total_ns : a.calls > b.calls;
+	});
+	printf("%-24s %12s %12s %12s %12s\n", "scope", "calls", "total ms", "mean ns", "max ns");
+	for (const Row& r : rows) {
+		if (p.is_counter[r.site])
+			printf("%-24s %12llu %12s %12s %12s\n", p.names[r.site], (unsigned long long)r.calls, "-", "-", "-");
+		else
+			printf("%-24s %12llu %12.3f %12.0f %12llu\n", p.names[r.site], (unsigned long long)r.calls,
+				r.total_ns / 1e6, (double)r.total_ns / r.calls, (unsigned long long)r.max_ns);
+	}
+	printf("trace written to %s\n", path);
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+// Hot path instrumentation. Everything here compiles to nothing unless
+// CHESS_PROFILE is defined (the Profile configuration).
+//
+//   PROFILE_SCOPE("name")  times the enclosing scope
+//   PROFILE_COUNT("name")  counts how often a line is reached
+//   PROFILE_FLUSH()        writes a Chrome trace (chrome://tracing, Perfetto)
+//                          to $CHESS_TRACE or chess_trace.json and prints a summary
+//
+// Names must be string literals. Each thread records into its own buffer, so
+// flush only after the other instrumented threads have finished.
+
+#ifdef CHESS_PROFILE
+#include <cstdint>
+
+// One instrumented call site, registered once on first use
+struct ProfileSite {
+	explicit ProfileSite(const char* name, bool counter = false);
+	uint32_t id;
+};
+
+struct ProfileScope {
+	explicit ProfileScope(const ProfileSite& site);
+	~ProfileScope();
+	uint32_t id;
+	uint64_t start;
+};
+
+void profile_count(const ProfileSite& site);
+void profile_flush();
+
+#define PROFILE_CAT_(a, b) a##b
+#define PROFILE_CAT(a, b) PROFILE_CAT_(a, b)
+#define PROFILE_SCOPE(name) \
+	static const ProfileSite PROFILE_CAT(profile_site_, __LINE__){ name }; \
+	ProfileScope PROFILE_CAT(profile_scope_, __LINE__){ PROFILE_CAT(profile_site_, __LINE__) }
+#define PROFILE_COUNT(name) \
+	do { static const ProfileSite profile_site{ name, true }; profile_count(profile_site); } while (0)
+#define PROFILE_FLUSH() profile_flush()
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNT(name) do {} while (0)
+#define PROFILE_FLUSH() do {} while (0)
+#endif
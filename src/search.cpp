@@ -0,0 +1,228 @@
+#include "search.h"
+#include "eval.h"
+#include "eval_params.h"
+#include "zobrist.h"
+#include "profile.h"
+#include <chrono>
+#include <memory>
+#include <utility>
+
+struct SearchState {
+	const std::atomic<bool>* stop;
+	uint64_t node_limit;
+	uint64_t nodes;
+	bool aborted;
+	TranspositionTable* tt;
+	// Triangular principal variation table
+	Move pv[MAX_PLY][MAX_PLY];
+	int pv_length[MAX_PLY];
+	// Principal variation of the previous iteration, searched first
+	Move prev_pv[MAX_PLY];
+	int prev_pv_length;
+};
+
+bool is_mate_score(int score) {
+	return score > MATE_SCORE - MAX_PLY || score < -MATE_SCORE + MAX_PLY;
+}
+
+static bool same_move(Move a, Move b) {
+	return a.from == b.from && a.to == b.to && a.promotion == b.promotion;
+}
+
+static bool is_capture(const ChessBoard& brd, Move mv) {
+	if (!is_empty(brd, mv.to))
+		return true;
+	// En passant is the only diagonal pawn move to an empty square
+	return get_type(brd, mv.from) == ChessBoard::Pawn && (mv.from % 8) != (mv.to % 8);
+}
+
+// Mate scores are stored relative to the node so they stay valid at other plies
+static int score_to_tt(int score, int ply) {
+	if (score > MATE_SCORE - MAX_PLY) return score + ply;
+	if (score < -MATE_SCORE + MAX_PLY) return score - ply;
+	return score;
+}
+
+static int score_from_tt(int score, int ply) {
+	if (score > MATE_SCORE - MAX_PLY) return score - ply;
+	if (score < -MATE_SCORE + MAX_PLY) return score + ply;
+	return score;
+}
+
+// Hash move and previous principal variation first, then captures by most valuable victim / least valuable attacker
+static void order_moves(const SearchState& st, const ChessBoard& brd, Move* moves, int count, int ply, Move hash_move = {}) {
+	int scores[MAX_MOVES];
+	for (int i = 0; i < count; i++) {
+		Move mv = moves[i];
+		int s = 0;
+		if (same_move(mv, hash_move))
+			s = 1 << 21;
+		else if (ply < st.prev_pv_length && same_move(mv, st.prev_pv[ply]))
+			s = 1 << 20;
+		else if (is_capture(brd, mv))
+			s = (1 << 16) + piece_value[get_type(brd, mv.to)] * 8 - piece_value[get_type(brd, mv.from)] / 8;
+		if (mv.promotion != ChessBoard::None)
+			s += piece_value[mv.promotion];
+		scores[i] = s;
+	}
+	for (int i = 0; i < count; i++) {
+		int best = i;
+		for (int j = i + 1; j < count; j++) {
+			if (scores[j] > scores[best])
+				best = j;
+		}
+		std::swap(moves[i], moves[best]);
+		std::swap(scores[i], scores[best]);
+	}
+}
+
+static bool should_stop(SearchState& st) {
+	st.nodes++;
+	if ((st.nodes & 1023) == 0) {
+		if (st.stop->load(std::memory_order_relaxed) || (st.node_limit && st.nodes >= st.node_limit))
+			st.aborted = true;
+	}
+	return st.aborted;
+}
+
+static int quiescence(SearchState& st, const ChessBoard& brd, int ply, int alpha, int beta) {
+	if (should_stop(st))
+		return 0;
+	st.pv_length[ply] = 0;
+
+	int stand_pat = evaluate(brd);
+	if (ply >= MAX_PLY - 1)
+		return stand_pat;
+	// In check every evasion is searched, otherwise only captures and promotions
+	if (!brd.is_check) {
+		if (stand_pat >= beta)
+			return beta;
+		if (stand_pat > alpha)
+			alpha = stand_pat;
+	}
+
+	Move moves[MAX_MOVES];
+	int count = get_all_valid_moves(brd, moves);
+	if (count == 0)
+		return brd.is_check ? -MATE_SCORE + ply : 0;
+	order_moves(st, brd, moves, count, ply);
+
+	for (int i = 0; i < count; i++) {
+		if (!brd.is_check && !is_capture(brd, moves[i]) && moves[i].promotion != ChessBoard::Queen)
+			continue;
+		PROFILE_COUNT("board_copy");
+		ChessBoard copy = brd;
+		make_move(copy, moves[i]);
+		int score = -quiescence(st, copy, ply + 1, -beta, -alpha);
+		if (st.aborted)
+			return 0;
+		if (score >= beta)
+			return beta;
+		if (score > alpha)
+			alpha = score;
+	}
+	return alpha;
+}
+
+static int negamax(SearchState& st, const ChessBoard& brd, int depth, int ply, int alpha, int beta) {
+	if (depth <= 0)
+		return quiescence(st, brd, ply, alpha, beta);
+	if (should_stop(st))
+		return 0;
+	st.pv_length[ply] = 0;
+
+	// Bounds from the table cut off, exact scores inside the window are
+	// searched anyway so the principal variation stays complete
+	uint64_t key = 0;
+	Move hash_move{};
+	if (st.tt) {
+		key = position_hash(brd);
+		TTEntry entry;
+		if (tt_probe(*st.tt, key, entry)) {
+			hash_move = entry.move;
+			int score = score_from_tt(entry.score, ply);
+			if (ply > 0 && entry.depth >= depth) {
+				if (entry.bound != BoundUpper && score >= beta)
+					return beta;
+				if (entry.bound != BoundLower && score <= alpha)
+					return alpha;
+			}
+		}
+	}
+
+	Move moves[MAX_MOVES];
+	int count = get_all_valid_moves(brd, moves);
+	if (count == 0)
+		return brd.is_check ? -MATE_SCORE + ply : 0;
+	if (ply >= MAX_PLY - 1)
+		return evaluate(brd);
+	order_moves(st, brd, moves, count, ply, hash_move);
+
+	int alpha_start = alpha;
+	Move best{};
+	for (int i = 0; i < count; i++) {
+		PROFILE_COUNT("board_copy");
+		ChessBoard copy = brd;
+		make_move(copy, moves[i]);
+		int score = -negamax(st, copy, depth - 1, ply + 1, -beta, -alpha);
+		if (st.aborted)
+			return 0;
+		if (score > alpha) {
+			alpha = score;
+			best = moves[i];
+			// Extend the principal variation with the child's line
+			st.pv[ply][0] = moves[i];
+			for (int j = 0; j < st.pv_length[ply + 1]; j++)
+				st.pv[ply][j + 1] = st.pv[ply + 1][j];
+			st.pv_length[ply] = st.pv_length[ply + 1] + 1;
+			if (alpha >= beta)
+				break;
+		}
+	}
+	if (st.tt) {
+		TTBound bound = alpha >= beta ? BoundLower : alpha > alpha_start ? BoundExact : BoundUpper;
+		tt_store(*st.tt, key, best, score_to_tt(alpha, ply), depth, bound);
+	}
+	return alpha;
+}
+
+SearchInfo search(const ChessBoard& brd, const SearchLimits& limits, const std::atomic<bool>& stop, const SearchCallback& on_iteration) {
+	auto start = std::chrono::steady_clock::now();
+	// The state is large because of the pv table, keep it off the stack
+	auto st = std::make_unique<SearchState>();
+	st->stop = &stop;
+	st->node_limit = limits.nodes;
+	st->tt = limits.tt;
+
+	ChessBoard root = brd;
+	root.is_check = is_in_check(root, root.current_turn);
+
+	SearchInfo info{};
+	PROFILE_SCOPE("search");
+	for (int depth = 1; depth <= limits.depth && depth < MAX_PLY; depth++) {
+		int score = negamax(*st, root, depth, 0, -MATE_SCORE - 1, MATE_SCORE + 1);
+		if (st->aborted)
+			break;
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		info.depth = depth;
+		info.score = score;
+		info.nodes = st->nodes;
+		info.nps = seconds > 0 ? st->nodes / seconds : 0.0;
+		info.pv_length = st->pv_length[0];
+		for (int i = 0; i < info.pv_length; i++)
+			info.pv[i] = st->pv[0][i];
+
+		st->prev_pv_length = info.pv_length;
+		for (int i = 0; i < info.pv_length; i++)
+			st->prev_pv[i] = info.pv[i];
+
+		if (on_iteration)
+			on_iteration(info);
+		// No legal moves at the root or a mate that can't get shorter
+		if (info.pv_length == 0 || (is_mate_score(score) && MATE_SCORE - (score < 0 ? -score : score) <= depth))
+			break;
+	}
+	info.nodes = st->nodes;
+	return info;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include "chess.h"
+#include "tt.h"
+
+constexpr int MATE_SCORE = 30000;
+constexpr int MAX_PLY = 64;
+
+struct SearchLimits {
+	int depth = MAX_PLY - 1;
+	// Node budget, 0 for no limit
+	uint64_t nodes = 0;
+	// Optional transposition table, owned by the caller and kept between searches
+	TranspositionTable* tt = nullptr;
+};
+
+struct SearchInfo {
+	int depth{};
+	// Centipawns from the point of view of the side to move
+	int score{};
+	uint64_t nodes{};
+	double nps{};
+	Move pv[MAX_PLY]{};
+	int pv_length{};
+};
+
+// Called after every completed iteration
+using SearchCallback = std::function<void(const SearchInfo&)>;
+
+// Iterative deepening alpha-beta search. Returns the last completed iteration,
+// an iteration interrupted by stop or the node limit is thrown away.
+SearchInfo search(const ChessBoard& brd, const SearchLimits& limits, const std::atomic<bool>& stop, const SearchCallback& on_iteration = {});
+
+bool is_mate_score(int score);
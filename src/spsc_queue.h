@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// N must be a power of two. push fails instead of blocking when full.
+template <typename T, size_t N>
+struct SpscQueue {
+	static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+	bool push(const T& item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N)
+			return false;
+		items[t & (N - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h & (N - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Read index, written only by the consumer
+	alignas(64) std::atomic<size_t> head{ 0 };
+	// Write index, written only by the producer
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	T items[N];
+};
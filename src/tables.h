@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include "chess.h"
+
+// Move generation lookup tables, computed by the compiler so they end up in
+// read-only data with no startup cost. Squares use the board indexing
+// (a8 = 0, h1 = 63), masks have bit n set for square n.
+
+using SquareMask = uint64_t;
+
+// Removes the lowest square from the mask and returns it
+inline int pop_square(SquareMask& mask) {
+	int sq = std::countr_zero(mask);
+	mask &= mask - 1;
+	return sq;
+}
+
+// Slider directions, bishop directions first so queens can use all 8
+enum Direction {
+	DirLeftUp,
+	DirRightUp,
+	DirRightDown,
+	DirLeftDown,
+	DirLeft,
+	DirUp,
+	DirRight,
+	DirDown,
+};
+
+constexpr int direction_offset[8]{ Left + Up, Right + Up, Right + Down, Left + Down, Left, Up, Right, Down };
+constexpr int direction_dx[8]{ -1, 1, 1, -1, -1, 0, 1, 0 };
+constexpr int direction_dy[8]{ 1, 1, -1, -1, 0, 1, 0, -1 };
+
+constexpr bool on_board(int x, int y) {
+	return x >= 0 && x < 8 && y >= 0 && y < 8;
+}
+
+constexpr int abs_diff(int a, int b) {
+	return a > b ? a - b : b - a;
+}
+
+constexpr std::array<SquareMask, 64> make_leaper_attacks(const int (&dx)[8], const int (&dy)[8]) {
+	std::array<SquareMask, 64> attacks{};
+	for (int sq = 0; sq < 64; sq++) {
+		for (int i = 0; i < 8; i++) {
+			int x = sq % 8 + dx[i], y = sq / 8 + dy[i];
+			if (on_board(x, y))
+				attacks[sq] |= 1ull << (x + y * 8);
+		}
+	}
+	return attacks;
+}
+
+constexpr int knight_dx[8]{ -2, -1, 1, 2, 2, 1, -1, -2 };
+constexpr int knight_dy[8]{ 1, 2, 2, 1, -1, -2, -2, -1 };
+inline constexpr std::array<SquareMask, 64> knight_attacks = make_leaper_attacks(knight_dx, knight_dy);
+inline constexpr std::array<SquareMask, 64> king_attacks = make_leaper_attacks(direction_dx, direction_dy);
+
+// Squares attacked by a pawn, indexed by [color == White][square].
+// Black pawns move towards higher indices, white pawns towards lower ones.
+constexpr std::array<std::array<SquareMask, 64>, 2> make_pawn_attacks() {
+	std::array<std::array<SquareMask, 64>, 2> attacks{};
+	for (int white = 0; white < 2; white++) {
+		int dy = white ? -1 : 1;
+		for (int sq = 0; sq < 64; sq++) {
+			for (int dx : { -1, 1 }) {
+				int x = sq % 8 + dx, y = sq / 8 + dy;
+				if (on_board(x, y))
+					attacks[white][sq] |= 1ull << (x + y * 8);
+			}
+		}
+	}
+	return attacks;
+}
+inline constexpr std::array<std::array<SquareMask, 64>, 2> pawn_attacks = make_pawn_attacks();
+
+// Number of squares from sq to the edge of the board in each Direction
+constexpr std::array<std::array<uint8_t, 8>, 64> make_edge_distance() {
+	std::array<std::array<uint8_t, 8>, 64> dist{};
+	for (int sq = 0; sq < 64; sq++) {
+		for (int d = 0; d < 8; d++) {
+			int n = 0;
+			int x = sq % 8 + direction_dx[d], y = sq / 8 + direction_dy[d];
+			for (; on_board(x, y); x += direction_dx[d], y += direction_dy[d])
+				n++;
+			dist[sq][d] = (uint8_t)n;
+		}
+	}
+	return dist;
+}
+inline constexpr std::array<std::array<uint8_t, 8>, 64> edge_distance = make_edge_distance();
+
+// King distance between two squares
+constexpr std::array<std::array<uint8_t, 64>, 64> make_square_distance() {
+	std::array<std::array<uint8_t, 64>, 64> dist{};
+	for (int a = 0; a < 64; a++) {
+		for (int b = 0; b < 64; b++) {
+			int dx = abs_diff(a % 8, b % 8), dy = abs_diff(a / 8, b / 8);
+			dist[a][b] = (uint8_t)(dx > dy ? dx : dy);
+		}
+	}
+	return dist;
+}
+inline constexpr std::array<std::array<uint8_t, 64>, 64> square_distance = make_square_distance();
+
+// between_mask[a][b]: squares strictly between a and b if they share a rank, file or diagonal.
+// line_mask[a][b]: the whole line through a and b, edge to edge, if they share one.
+struct LineTables {
+	std::array<std::array<SquareMask, 64>, 64> between;
+	std::array<std::array<SquareMask, 64>, 64> line;
+};
+
+constexpr LineTables make_line_tables() {
+	LineTables t{};
+	for (int a = 0; a < 64; a++) {
+		for (int d = 0; d < 8; d++) {
+			SquareMask ray = 0;
+			int x = a % 8 + direction_dx[d], y = a / 8 + direction_dy[d];
+			for (; on_board(x, y); x += direction_dx[d], y += direction_dy[d]) {
+				int b = x + y * 8;
+				t.between[a][b] = ray;
+				ray |= 1ull << b;
+			}
+		}
+	}
+	for (int a = 0; a < 64; a++) {
+		for (int d = 0; d < 8; d++) {
+			// Both halves of the line through a
+			SquareMask full = 1ull << a;
+			for (int dir : { d, d ^ 2 }) {
+				int x = a % 8 + direction_dx[dir], y = a / 8 + direction_dy[dir];
+				for (; on_board(x, y); x += direction_dx[dir], y += direction_dy[dir])
+					full |= 1ull << (x + y * 8);
+			}
+			int x = a % 8 + direction_dx[d], y = a / 8 + direction_dy[d];
+			for (; on_board(x, y); x += direction_dx[d], y += direction_dy[d])
+				t.line[a][x + y * 8] = full;
+		}
+	}
+	return t;
+}
+inline constexpr LineTables line_tables = make_line_tables();
+inline constexpr const std::array<std::array<SquareMask, 64>, 64>& between_mask = line_tables.between;
+inline constexpr const std::array<std::array<SquareMask, 64>, 64>& line_mask = line_tables.line;
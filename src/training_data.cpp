@@ -0,0 +1,77 @@
+#include "training_data.h"
+#include <bit>
+#include <cstring>
+
+void pack_sample(const ChessBoard& brd, int white_score, int white_points, int ply, PackedSample& out) {
+	memset(&out, 0, sizeof(out));
+	int n = 0;
+	for (int i = 0; i < 64; i++) {
+		int type = get_type(brd, i);
+		if (type == ChessBoard::None)
+			continue;
+		int nibble = type | (get_color(brd, i) == ChessBoard::White ? 8 : 0);
+		// More pieces than a game can have don't fit, fens from outside go through is_valid_fen
+		assert(n < 32);
+		if (n == 32)
+			break;
+		out.occupancy |= 1ull << i;
+		out.pieces[n / 2] |= nibble << (n % 2 * 4);
+		n++;
+	}
+	out.score = (int16_t)white_score;
+	out.result = (uint8_t)white_points;
+	out.flags =
+		(brd.current_turn == ChessBoard::White ? 1 : 0) |
+		(brd.white_king_side ? 2 : 0) |
+		(brd.white_queen_side ? 4 : 0) |
+		(brd.black_king_side ? 8 : 0) |
+		(brd.black_queen_side ? 16 : 0);
+	out.en_passant = (int8_t)brd.en_passant_target;
+	out.ply = (uint16_t)ply;
+}
+
+bool is_valid_sample(const PackedSample& in) {
+	int n = std::popcount(in.occupancy);
+	if (n > 32 || in.result > 2 || in.en_passant < -1)
+		return false;
+	int white_kings = 0, black_kings = 0;
+	for (int i = 0; i < n; i++) {
+		int nibble = (in.pieces[i / 2] >> (i % 2 * 4)) & 15;
+		int type = nibble & 7;
+		if (type == ChessBoard::None || type > ChessBoard::Pawn)
+			return false;
+		white_kings += nibble == (ChessBoard::King | 8);
+		black_kings += nibble == ChessBoard::King;
+	}
+	return white_kings == 1 && black_kings == 1;
+}
+
+void unpack_sample(const PackedSample& in, ChessBoard& brd) {
+	brd = ChessBoard{};
+	int n = 0;
+	for (int i = 0; i < 64; i++) {
+		if (!(in.occupancy & (1ull << i)))
+			continue;
+		// pieces holds 32 nibbles, records from files go through is_valid_sample
+		assert(n < 32);
+		if (n == 32)
+			break;
+		int nibble = (in.pieces[n / 2] >> (n % 2 * 4)) & 15;
+		ChessBoard::Color color = (nibble & 8) ? ChessBoard::White : ChessBoard::Black;
+		brd.pieces[i] = (nibble & 7) | color;
+		if ((nibble & 7) == ChessBoard::King) {
+			if (color == ChessBoard::White)
+				brd.white_king_position = i;
+			else
+				brd.black_king_position = i;
+		}
+		n++;
+	}
+	brd.current_turn = (in.flags & 1) ? ChessBoard::White : ChessBoard::Black;
+	brd.white_king_side = in.flags & 2;
+	brd.white_queen_side = in.flags & 4;
+	brd.black_king_side = in.flags & 8;
+	brd.black_queen_side = in.flags & 16;
+	brd.en_passant_target = in.en_passant;
+	brd.is_check = is_in_check(brd, brd.current_turn);
+}
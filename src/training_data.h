@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include "chess.h"
+
+// Fixed size training sample as written by the self-play generator and read
+// by the tuner. Files are a plain array of records in host byte order
+// (little endian on every supported platform).
+struct PackedSample {
+	// Bit n set when square n is occupied, a8 = bit 0
+	uint64_t occupancy;
+	// One nibble per occupied square in square order, low nibble first:
+	// piece type, plus 8 for white
+	uint8_t pieces[16];
+	// Search score in centipawns from white's point of view
+	int16_t score;
+	// Game result from white's point of view: 2 win, 1 draw, 0 loss
+	uint8_t result;
+	// Bit 0 white to move, bits 1-4 castling rights KQkq
+	uint8_t flags;
+	// Square of the pawn that just double moved, or -1
+	int8_t en_passant;
+	uint8_t reserved;
+	// Ply in the game the position came from
+	uint16_t ply;
+};
+static_assert(sizeof(PackedSample) == 32, "training records are 32 bytes");
+
+void pack_sample(const ChessBoard& brd, int white_score, int white_points, int ply, PackedSample& out);
+// Whether a record read from a file holds a position unpack_sample can restore:
+// at most 32 pieces, known piece types, one king per side
+bool is_valid_sample(const PackedSample& in);
+// Restores the position, the UI state of the board is left at its defaults
+void unpack_sample(const PackedSample& in, ChessBoard& brd);
@@ -0,0 +1,35 @@
+#include "tt.h"
+
+void tt_resize(TranspositionTable& tt, size_t megabytes) {
+	size_t count = 1;
+	while (count * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024)
+		count *= 2;
+	tt.entries.assign(count, TTEntry{});
+	tt.mask = count - 1;
+}
+
+void tt_clear(TranspositionTable& tt) {
+	tt.entries.assign(tt.entries.size(), TTEntry{});
+}
+
+bool tt_probe(const TranspositionTable& tt, uint64_t key, TTEntry& entry) {
+	if (tt.entries.empty())
+		return false;
+	const TTEntry& e = tt.entries[key & tt.mask];
+	if (e.bound == BoundNone || e.key != key)
+		return false;
+	entry = e;
+	return true;
+}
+
+void tt_store(TranspositionTable& tt, uint64_t key, Move move, int score, int depth, TTBound bound) {
+	if (tt.entries.empty())
+		return;
+	TTEntry& e = tt.entries[key & tt.mask];
+	if (e.key == key && e.depth > depth)
+		return;
+	// A fail low has no best move, keep the one found earlier
+	if (move.from == -1 && e.key == key)
+		move = e.move;
+	e = { key, move, (int16_t)score, (int8_t)depth, (uint8_t)bound };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chess.h"
+
+enum TTBound : uint8_t {
+	BoundNone,
+	// Score is at most the stored value (failed low)
+	BoundUpper,
+	// Score is at least the stored value (failed high)
+	BoundLower,
+	BoundExact,
+};
+
+struct TTEntry {
+	uint64_t key{};
+	Move move{};
+	int16_t score{};
+	int8_t depth{};
+	uint8_t bound{ BoundNone };
+};
+
+// Transposition table for one search at a time. Not thread safe, every game
+// or analysis thread owns its own table.
+struct TranspositionTable {
+	std::vector<TTEntry> entries;
+	uint64_t mask{};
+};
+
+// Resizes to the largest power of two entry count that fits and clears the table
+void tt_resize(TranspositionTable& tt, size_t megabytes);
+void tt_clear(TranspositionTable& tt);
+bool tt_probe(const TranspositionTable& tt, uint64_t key, TTEntry& entry);
+// Keeps a deeper entry of the same position, anything else is replaced
+void tt_store(TranspositionTable& tt, uint64_t key, Move move, int score, int depth, TTBound bound);
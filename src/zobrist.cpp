@@ -0,0 +1,58 @@
+#include "zobrist.h"
+#include <array>
+
+struct ZobristKeys {
+	// Indexed by the piece byte (type | color) and square
+	uint64_t pieces[ChessBoard::COLOR_BIT + ChessBoard::Pawn + 1][64];
+	uint64_t black_to_move;
+	uint64_t castling[4];
+	uint64_t en_passant[64];
+};
+
+constexpr uint64_t splitmix64(uint64_t& state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// Fixed seed so hashes are stable between runs and builds, the opening explorer stores them
+constexpr ZobristKeys make_zobrist_keys() {
+	ZobristKeys keys{};
+	uint64_t state = 0x5DEECE66Dull;
+	for (auto& piece : keys.pieces) {
+		for (uint64_t& key : piece)
+			key = splitmix64(state);
+	}
+	keys.black_to_move = splitmix64(state);
+	for (uint64_t& key : keys.castling)
+		key = splitmix64(state);
+	for (uint64_t& key : keys.en_passant)
+		key = splitmix64(state);
+	return keys;
+}
+constexpr ZobristKeys zobrist = make_zobrist_keys();
+
+uint64_t position_hash(const ChessBoard& brd) {
+	uint64_t hash = 0;
+	for (int i = 0; i < 64; i++) {
+		if (brd.pieces[i] & ChessBoard::PIECE_BITS)
+			hash ^= zobrist.pieces[brd.pieces[i]][i];
+	}
+	if (brd.current_turn == ChessBoard::Black)
+		hash ^= zobrist.black_to_move;
+	if (brd.white_king_side) hash ^= zobrist.castling[0];
+	if (brd.white_queen_side) hash ^= zobrist.castling[1];
+	if (brd.black_king_side) hash ^= zobrist.castling[2];
+	if (brd.black_queen_side) hash ^= zobrist.castling[3];
+	// Only when a pawn stands ready to take it, as in Polyglot, so a double
+	// step that can't be answered doesn't split transpositions
+	int target = brd.en_passant_target;
+	if (target >= 0 && target < 64) {
+		int pawn = ChessBoard::Pawn | brd.current_turn;
+		int file = target % 8;
+		if ((file > 0 && brd.pieces[target - 1] == pawn) || (file < 7 && brd.pieces[target + 1] == pawn))
+			hash ^= zobrist.en_passant[target];
+	}
+	return hash;
+}
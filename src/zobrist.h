@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+#include "chess.h"
+
+// Zobrist hash of the parts of the board compared by same_position, except
+// that the en passant pawn only counts when it can be taken.
+// Computed from scratch, the search copies boards instead of unmaking moves.
+uint64_t position_hash(const ChessBoard& brd);
@@ -0,0 +1,326 @@
+// Microbenchmarks for the rules primitives. Every benchmark replays the same
+// set of calls built from a fixed corpus of positions, so numbers are
+// comparable between commits. One sample is one pass over all calls, median
+// and p99 are taken over the per call average of each sample. The batch_* and
+// legal_* benchmarks time one position each, and are also reported in positions/s.
+//
+//   bench [--json out.json] [--compare old.json] [--filter name] [--samples n]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "chess.h"
+#include "batch.h"
+
+const char* corpus[]{
+	// Opening
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+	"rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+	// Middlegame
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"2r2rk1/pp1bqpp1/2n1p2p/3pP3/3P4/P1PB1N2/5PPP/R2QR1K1 b - - 0 17",
+	// Endgame
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+	"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+	"8/5k2/8/3Q4/8/8/2K5/8 b - - 0 1",
+};
+
+struct BenchResult {
+	std::string name;
+	size_t calls_per_sample{};
+	double median_ns{}, p99_ns{};
+	double median_cycles{};
+};
+
+// Keeps results alive so the optimizer can't drop the calls
+static volatile int sink;
+
+// Runs body (which makes `calls` calls) repeatedly and reports per call times
+BenchResult run_bench(const char* name, size_t calls, int samples, const std::function<int()>& body) {
+	BenchResult r{ name, calls };
+	if (calls == 0)
+		return r;
+	// Warm up caches and branch predictors
+	auto warm_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+	while (std::chrono::steady_clock::now() < warm_end) {
+		sink = body();
+	}
+	std::vector<double> ns(samples), cycles(samples);
+	for (int s = 0; s < samples; s++) {
+		auto t0 = std::chrono::steady_clock::now();
+		uint64_t c0 = __rdtsc();
+		sink = body();
+		uint64_t c1 = __rdtsc();
+		auto t1 = std::chrono::steady_clock::now();
+		ns[s] = std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+		cycles[s] = (double)(c1 - c0) / calls;
+	}
+	std::sort(ns.begin(), ns.end());
+	std::sort(cycles.begin(), cycles.end());
+	r.median_ns = ns[samples / 2];
+	r.p99_ns = ns[std::min(samples - 1, samples * 99 / 100)];
+	r.median_cycles = cycles[samples / 2];
+	return r;
+}
+
+// One benchmark per line so the file is easy to diff and to read back
+void write_json(const char* path, const std::vector<BenchResult>& results) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		std::cout << "Failed to write " << path << std::endl;
+		return;
+	}
+	fprintf(f, "{\"benchmarks\":[\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(f, "{\"name\":\"%s\",\"calls\":%zu,\"median_ns\":%.3f,\"p99_ns\":%.3f,\"median_cycles\":%.2f}%s\n",
+			r.name.c_str(), r.calls_per_sample, r.median_ns, r.p99_ns, r.median_cycles, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "]}\n");
+	fclose(f);
+}
+
+std::vector<BenchResult> read_json(const char* path) {
+	std::vector<BenchResult> results;
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line)) {
+		char name[128]{};
+		BenchResult r{};
+		if (sscanf(line.c_str(), "{\"name\":\"%127[^\"]\",\"calls\":%zu,\"median_ns\":%lf,\"p99_ns\":%lf,\"median_cycles\":%lf",
+			name, &r.calls_per_sample, &r.median_ns, &r.p99_ns, &r.median_cycles) == 5) {
+			r.name = name;
+			results.push_back(r);
+		}
+	}
+	return results;
+}
+
+int main(int argc, char** argv) {
+	const char* json_path = nullptr;
+	const char* compare_path = nullptr;
+	const char* filter = nullptr;
+	int samples = 200;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			json_path = argv[++i];
+		else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+			compare_path = argv[++i];
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+			samples = std::max(1, atoi(argv[++i]));
+	}
+
+	std::vector<ChessBoard> boards;
+	for (const char* fen : corpus) {
+		ChessBoard brd{};
+		init_fen(brd, fen);
+		brd.is_check = is_in_check(brd, brd.current_turn);
+		boards.push_back(brd);
+	}
+
+	// (board, square) pairs per piece type, and every legal move of every board
+	struct PieceCall {
+		const ChessBoard* brd;
+		int square;
+	};
+	std::vector<PieceCall> by_type[7];
+	std::vector<PieceCall> own_pieces;
+	std::vector<std::pair<const ChessBoard*, Move>> legal_moves;
+	for (const ChessBoard& brd : boards) {
+		for (int i = 0; i < 64; i++) {
+			if (is_empty(brd, i))
+				continue;
+			by_type[get_type(brd, i)].push_back({ &brd, i });
+			if (get_color(brd, i) == brd.current_turn)
+				own_pieces.push_back({ &brd, i });
+		}
+		Move moves[MAX_MOVES];
+		int count = get_all_valid_moves(brd, moves);
+		for (int m = 0; m < count; m++)
+			legal_moves.push_back({ &brd, moves[m] });
+	}
+
+	std::vector<BenchResult> results;
+	auto add = [&](const char* name, size_t calls, const std::function<int()>& body) {
+		if (filter && !strstr(name, filter))
+			return;
+		results.push_back(run_bench(name, calls, samples, body));
+	};
+	auto piece_bench = [&](const char* name, int type, void (*gen)(const ChessBoard&, int*, int&, Position)) {
+		const auto& calls = by_type[type];
+		add(name, calls.size(), [&calls, gen]() {
+			int total = 0;
+			for (const PieceCall& c : calls) {
+				int moves[64];
+				int count = 0;
+				gen(*c.brd, moves, count, c.square);
+				total += count;
+			}
+			return total;
+		});
+	};
+	piece_bench("get_pawn_moves", ChessBoard::Pawn, get_pawn_moves);
+	piece_bench("get_knight_moves", ChessBoard::Knight, get_knight_moves);
+	piece_bench("get_bishop_moves", ChessBoard::Bishop, get_bishop_moves);
+	piece_bench("get_rook_moves", ChessBoard::Rook, get_rook_moves);
+	piece_bench("get_queen_moves", ChessBoard::Queen, get_queen_moves);
+	piece_bench("get_king_moves", ChessBoard::King, get_king_moves);
+
+	add("is_in_check", boards.size() * 2, [&]() {
+		int total = 0;
+		for (const ChessBoard& brd : boards)
+			total += is_in_check(brd, ChessBoard::White) + is_in_check(brd, ChessBoard::Black);
+		return total;
+	});
+	add("get_valid_moves", own_pieces.size(), [&]() {
+		int total = 0;
+		for (const PieceCall& c : own_pieces) {
+			int moves[64];
+			int count = 0;
+			get_valid_moves(*c.brd, moves, count, c.square);
+			total += count;
+		}
+		return total;
+	});
+	// do_move needs a fresh board per call, board_copy is the copy alone for reference
+	add("board_copy", legal_moves.size(), [&]() {
+		int total = 0;
+		for (auto& lm : legal_moves) {
+			ChessBoard copy = *lm.first;
+			total += copy.pieces[lm.second.to];
+		}
+		return total;
+	});
+	add("do_move", legal_moves.size(), [&]() {
+		int total = 0;
+		for (auto& lm : legal_moves) {
+			ChessBoard copy = *lm.first;
+			do_move(copy, lm.second.from, lm.second.to);
+			total += copy.pieces[lm.second.to];
+		}
+		return total;
+	});
+	add("init_fen", std::size(corpus), [&]() {
+		int total = 0;
+		for (const char* fen : corpus) {
+			ChessBoard brd{};
+			init_fen(brd, fen);
+			total += brd.white_king_position;
+		}
+		return total;
+	});
+
+	// Batch queries over the corpus and every position one move away from it.
+	// check_rules is the same check status through is_in_check for comparison.
+	std::vector<ChessBoard> batch_boards(boards);
+	for (auto& lm : legal_moves) {
+		ChessBoard child = *lm.first;
+		make_move(child, lm.second);
+		batch_boards.push_back(child);
+	}
+	PositionBatch batch;
+	load_batch(batch, batch_boards.data(), batch_boards.size());
+	BatchResult batch_result;
+	add("check_rules", batch_boards.size(), [&]() {
+		int total = 0;
+		for (const ChessBoard& brd : batch_boards)
+			total += is_in_check(brd, ChessBoard::White) + is_in_check(brd, ChessBoard::Black);
+		return total;
+	});
+	for (BatchPath path : { BatchScalar, BatchAVX2, BatchAVX512 }) {
+		if (!batch_path_supported(path))
+			continue;
+		std::string name = std::string("batch_") + batch_path_name(path);
+		add(name.c_str(), batch.count, [&, path]() {
+			compute_attacks(batch, batch_result, path);
+			return (int)batch_result.in_check[0][0];
+		});
+	}
+	add("legal_rules", batch_boards.size(), [&]() {
+		int total = 0;
+		for (const ChessBoard& brd : batch_boards) {
+			Move moves[MAX_MOVES];
+			total += get_all_valid_moves(brd, moves);
+		}
+		return total;
+	});
+	for (BatchPath path : { BatchScalar, BatchAVX2, BatchAVX512 }) {
+		if (!batch_path_supported(path))
+			continue;
+		std::string name = std::string("legal_") + batch_path_name(path);
+		add(name.c_str(), batch.count, [&, path]() {
+			count_legal_moves(batch, batch_boards.data(), batch_result, path);
+			return (int)batch_result.legal_moves[0];
+		});
+	}
+
+	std::vector<BenchResult> baseline;
+	if (compare_path)
+		baseline = read_json(compare_path);
+
+	printf("%-20s %10s %12s %12s %14s", "benchmark", "calls", "median ns", "p99 ns", "median cycles");
+	if (compare_path)
+		printf(" %10s", "vs base");
+	printf("\n");
+	for (const BenchResult& r : results) {
+		printf("%-20s %10zu %12.1f %12.1f %14.1f", r.name.c_str(), r.calls_per_sample, r.median_ns, r.p99_ns, r.median_cycles);
+		if (compare_path) {
+			auto it = std::find_if(baseline.begin(), baseline.end(), [&](const BenchResult& b) { return b.name == r.name; });
+			if (it != baseline.end() && it->median_ns > 0)
+				printf(" %+9.1f%%", (r.median_ns / it->median_ns - 1.0) * 100.0);
+			else
+				printf(" %10s", "new");
+		}
+		printf("\n");
+	}
+
+	// Batch throughput relative to the scalar batch path
+	auto find_result = [&](const char* name) -> const BenchResult* {
+		for (const BenchResult& r : results) {
+			if (r.name == name && r.median_ns > 0)
+				return &r;
+		}
+		return nullptr;
+	};
+	const char* groups[2][4]{
+		{ "check_rules", "batch_scalar", "batch_avx2", "batch_avx512" },
+		{ "legal_rules", "legal_scalar", "legal_avx2", "legal_avx512" },
+	};
+	for (auto& group : groups) {
+		const BenchResult* scalar = find_result(group[1]);
+		for (const char* name : group) {
+			const BenchResult* r = find_result(name);
+			if (!r)
+				continue;
+			printf("%-20s %8.1fM positions/s", name, 1e3 / r->median_ns);
+			if (scalar)
+				printf("  x%.2f vs scalar", scalar->median_ns / r->median_ns);
+			printf("\n");
+		}
+	}
+
+	if (json_path)
+		write_json(json_path, results);
+	return 0;
+}
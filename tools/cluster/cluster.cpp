@@ -0,0 +1,97 @@
+#include "cluster.h"
+#include <chrono>
+#include <cstring>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+bool take_line(std::string& buffer, std::string& line) {
+	size_t end = buffer.find('\n');
+	if (end == std::string::npos)
+		return false;
+	line.assign(buffer, 0, end);
+	buffer.erase(0, end + 1);
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+	return true;
+}
+
+bool read_line(LineReader& reader, std::string& line) {
+	while (!take_line(reader.buffer, line)) {
+		char buf[16384];
+		ssize_t n = read(reader.fd, buf, sizeof(buf));
+		if (n > 0)
+			reader.buffer.append(buf, n);
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else
+			return false;
+	}
+	return true;
+}
+
+bool send_all(int fd, const std::string& data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+		if (n > 0)
+			sent += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else
+			return false;
+	}
+	return true;
+}
+
+int listen_tcp(const char* host, int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int connect_tcp(const char* host, int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void close_socket(int fd) {
+	if (fd >= 0)
+		close(fd);
+}
+
+#endif
+
+int64_t now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double seconds_since(int64_t start_us) {
+	return (now_us() - start_us) / 1e6;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// Line protocol between coordinator and workers, one TCP connection per worker.
+//
+//   worker       hello <threads>
+//   coordinator  unit <id> search|perft <depth> <count>, then <count> fen lines
+//   worker       result <id> <busy_us>, then one line per position in unit order:
+//                  search  <move> <score> <depth> <nodes>
+//                  perft   <leaves>
+//   worker       alive                  at least every second while connected
+//   coordinator  done                   no work left, the worker exits
+//
+// A worker that disconnects or stays silent for the timeout loses its units
+// to the queue.
+
+enum UnitMode {
+	UnitSearch,
+	UnitPerft,
+};
+
+// Blocking reads of whole lines from a socket
+struct LineReader {
+	int fd{ -1 };
+	std::string buffer;
+};
+
+// Reads the next line without its newline, false once the connection is closed
+bool read_line(LineReader& reader, std::string& line);
+// Takes the next complete line out of buffer, false if there is none yet
+bool take_line(std::string& buffer, std::string& line);
+bool send_all(int fd, const std::string& data);
+
+int listen_tcp(const char* host, int port);
+int connect_tcp(const char* host, int port);
+void close_socket(int fd);
+
+double seconds_since(int64_t start_us);
+int64_t now_us();
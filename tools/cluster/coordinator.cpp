@@ -0,0 +1,416 @@
+// Analysis coordinator. Splits a position file into units of --unit positions
+// and hands them to worker processes (tools/cluster/worker.cpp) connecting
+// over TCP, --inflight units per worker so none waits for its next unit.
+// Units of a worker that disconnects or stays silent for --timeout seconds go
+// back to the queue, and a unit that took down --attempts workers is written
+// as failed. Positions that are not valid FENs are written as invalid without
+// going to a worker. Results are written in input order as soon as all
+// earlier ones are in. Prints throughput and the utilisation of every worker
+// at the end.
+//
+// The input is an EPD/FEN file, or self-play samples when it ends in ".bin".
+//
+//   coordinator positions.epd [--depth n | --perft n] [--out file] [--port n]
+//               [--host address] [--unit n] [--inflight n] [--timeout s] [--attempts n]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "training_data.h"
+#include "cluster.h"
+
+#if defined(__linux__)
+#include <csignal>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+struct CoordinatorConfig {
+	const char* host{ "127.0.0.1" };
+	int port{ 7100 };
+	UnitMode mode{ UnitSearch };
+	int depth{ 6 };
+	int unit_size{ 64 };
+	int inflight{ 2 };
+	double timeout{ 10 };
+	int attempts{ 3 };
+};
+
+// Positions pending[first] to pending[first + count - 1]
+struct Unit {
+	size_t first{}, count{};
+	int attempts{};
+	bool done{};
+};
+
+struct WorkerConn {
+	int fd{ -1 };
+	std::string address;
+	std::string in;
+	int threads{};
+	// Units sent and not answered yet, oldest first
+	std::deque<uint32_t> units;
+	// Unit whose result lines are being read, -1 between results
+	int64_t reading{ -1 };
+	std::vector<std::string> lines;
+	int64_t connected_us{}, last_heard_us{}, gone_us{};
+	const char* end_reason{ "" };
+	uint64_t busy_us{}, units_done{}, positions{}, nodes{};
+};
+
+struct Coordinator {
+	CoordinatorConfig cfg;
+	std::vector<std::string> fens;
+	std::vector<std::string> results;
+	std::vector<uint8_t> known;
+	// Indices of the fens that go to workers
+	std::vector<size_t> pending;
+	std::vector<Unit> units;
+	std::deque<uint32_t> queue;
+	std::vector<WorkerConn> workers;
+	size_t units_done{}, written{}, requeued{}, failed{}, invalid{};
+	uint64_t nodes{};
+	FILE* out{};
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static bool is_valid_position(const std::string& fen) {
+	if (!is_valid_fen(fen.c_str()))
+		return false;
+	ChessBoard brd{};
+	init_fen(brd, fen.c_str());
+	return settle_position(brd);
+}
+
+static bool load_positions(const char* path, std::vector<std::string>& fens) {
+	size_t len = strlen(path);
+	if (len > 4 && strcmp(path + len - 4, ".bin") == 0) {
+		FILE* f = fopen(path, "rb");
+		if (!f)
+			return false;
+		PackedSample s;
+		while (fread(&s, sizeof(s), 1, f) == 1) {
+			ChessBoard brd{};
+			unpack_sample(s, brd);
+			char fen[MAX_FEN];
+			board_to_fen(brd, fen);
+			fens.push_back(fen);
+		}
+		fclose(f);
+		return true;
+	}
+	std::ifstream in(path);
+	if (!in)
+		return false;
+	std::string line;
+	while (std::getline(in, line)) {
+		// Placement, side, castling and en passant; EPD operations are dropped
+		std::istringstream words(line);
+		std::string field, fen;
+		int fields = 0;
+		while (fields < 4 && words >> field)
+			fen += (fields++ ? " " : "") + field;
+		if (fields == 4 && line[0] != '#')
+			fens.push_back(fen);
+	}
+	return true;
+}
+
+// Writes the results that are complete up to the first missing one
+static void flush_results(Coordinator& c) {
+	while (c.written < c.fens.size() && c.known[c.written]) {
+		fprintf(c.out, "%s ; %s\n", c.fens[c.written].c_str(), c.results[c.written].c_str());
+		c.written++;
+	}
+	fflush(c.out);
+}
+
+static void finish_unit(Coordinator& c, uint32_t index, const std::vector<std::string>* lines) {
+	Unit& unit = c.units[index];
+	unit.done = true;
+	for (size_t i = 0; i < unit.count; i++) {
+		size_t position = c.pending[unit.first + i];
+		c.results[position] = lines ? (*lines)[i] : "failed";
+		c.known[position] = 1;
+	}
+	c.units_done++;
+	flush_results(c);
+}
+
+static void drop_worker(Coordinator& c, WorkerConn& w, const char* reason) {
+	close_socket(w.fd);
+	w.fd = -1;
+	w.gone_us = now_us();
+	w.end_reason = reason;
+	// Requeued at the front so the ordered output is not held up for long
+	for (auto it = w.units.rbegin(); it != w.units.rend(); ++it) {
+		Unit& unit = c.units[*it];
+		if (++unit.attempts >= c.cfg.attempts) {
+			c.failed++;
+			finish_unit(c, *it, nullptr);
+		}
+		else {
+			c.requeued++;
+			c.queue.push_front(*it);
+		}
+	}
+	if (!w.units.empty())
+		printf("worker %s %s, %d units back in the queue\n", w.address.c_str(), reason, (int)w.units.size());
+	w.units.clear();
+}
+
+static void complete_result(Coordinator& c, WorkerConn& w) {
+	uint32_t index = (uint32_t)w.reading;
+	w.units.erase(std::find(w.units.begin(), w.units.end(), index));
+	w.reading = -1;
+	Unit& unit = c.units[index];
+	uint64_t nodes = 0;
+	for (auto& line : w.lines) {
+		// Searches report their nodes last, perft only the leaves
+		size_t space = line.rfind(' ');
+		nodes += strtoull(line.c_str() + (space == std::string::npos ? 0 : space + 1), nullptr, 10);
+	}
+	w.units_done++;
+	w.positions += unit.count;
+	w.nodes += nodes;
+	c.nodes += nodes;
+	finish_unit(c, index, &w.lines);
+	w.lines.clear();
+}
+
+// Handles every complete line from the worker, false on a protocol error
+static bool handle_input(Coordinator& c, WorkerConn& w) {
+	std::string line;
+	while (take_line(w.in, line)) {
+		if (w.reading >= 0) {
+			w.lines.push_back(line);
+			if (w.lines.size() == c.units[w.reading].count)
+				complete_result(c, w);
+			continue;
+		}
+		std::istringstream words(line);
+		std::string word;
+		words >> word;
+		if (word == "alive")
+			continue;
+		if (word == "hello") {
+			words >> w.threads;
+			continue;
+		}
+		uint32_t index;
+		uint64_t busy_us;
+		if (word != "result" || !(words >> index >> busy_us) || std::find(w.units.begin(), w.units.end(), index) == w.units.end())
+			return false;
+		w.busy_us += busy_us;
+		w.reading = index;
+		w.lines.clear();
+	}
+	return w.in.size() <= 1 << 20;
+}
+
+static bool send_unit(Coordinator& c, WorkerConn& w, uint32_t index) {
+	const Unit& unit = c.units[index];
+	std::string text = "unit " + std::to_string(index) + (c.cfg.mode == UnitPerft ? " perft " : " search ")
+		+ std::to_string(c.cfg.depth) + " " + std::to_string(unit.count) + "\n";
+	for (size_t i = 0; i < unit.count; i++)
+		text += c.fens[c.pending[unit.first + i]] + "\n";
+	w.units.push_back(index);
+	return send_all(w.fd, text);
+}
+
+static void dispatch(Coordinator& c) {
+	for (auto& w : c.workers) {
+		while (w.fd >= 0 && w.threads > 0 && (int)w.units.size() < c.cfg.inflight && !c.queue.empty()) {
+			uint32_t index = c.queue.front();
+			c.queue.pop_front();
+			if (!send_unit(c, w, index))
+				drop_worker(c, w, "failed to send");
+		}
+	}
+}
+
+static void accept_worker(Coordinator& c, int listen_fd) {
+	sockaddr_in addr{};
+	socklen_t len = sizeof(addr);
+	int fd = accept(listen_fd, (sockaddr*)&addr, &len);
+	if (fd < 0)
+		return;
+	char ip[INET_ADDRSTRLEN] = "?";
+	inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+	WorkerConn w;
+	w.fd = fd;
+	w.address = std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+	w.connected_us = w.last_heard_us = now_us();
+	printf("worker %s connected\n", w.address.c_str());
+	c.workers.push_back(std::move(w));
+}
+
+static void print_summary(const Coordinator& c, double seconds) {
+	printf("%llu positions in %.1f s, %.1f positions/s, %.0f nodes/s, %llu units requeued, %llu failed\n",
+		(unsigned long long)c.written, seconds, c.written / seconds, c.nodes / seconds,
+		(unsigned long long)c.requeued, (unsigned long long)c.failed);
+	int64_t end = now_us();
+	for (auto& w : c.workers) {
+		double connected = ((w.gone_us ? w.gone_us : end) - w.connected_us) / 1e6;
+		printf("  %-21s %2d threads %6llu units %8llu positions %10.0f nodes/s  busy %5.1f%%  %s\n",
+			w.address.c_str(), w.threads, (unsigned long long)w.units_done, (unsigned long long)w.positions,
+			connected > 0 ? w.nodes / connected : 0.0, connected > 0 ? 100.0 * w.busy_us / 1e6 / connected : 0.0,
+			w.end_reason);
+	}
+}
+
+int main(int argc, char** argv) {
+	Coordinator c;
+	const char* input = nullptr;
+	const char* out_path = "results.txt";
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+			c.cfg.mode = UnitSearch;
+			c.cfg.depth = std::clamp(atoi(argv[++i]), 1, 63);
+		}
+		else if (strcmp(argv[i], "--perft") == 0 && i + 1 < argc) {
+			c.cfg.mode = UnitPerft;
+			c.cfg.depth = std::clamp(atoi(argv[++i]), 1, 10);
+		}
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_path = argv[++i];
+		else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			c.cfg.port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+			c.cfg.host = argv[++i];
+		else if (strcmp(argv[i], "--unit") == 0 && i + 1 < argc)
+			c.cfg.unit_size = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--inflight") == 0 && i + 1 < argc)
+			c.cfg.inflight = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+			c.cfg.timeout = atof(argv[++i]);
+		else if (strcmp(argv[i], "--attempts") == 0 && i + 1 < argc)
+			c.cfg.attempts = std::max(1, atoi(argv[++i]));
+		else if (argv[i][0] != '-')
+			input = argv[i];
+	}
+	if (!input) {
+		std::cout << "Usage: coordinator positions.epd|samples.bin [--depth n | --perft n] [--out file] [--port n]" << std::endl;
+		return 1;
+	}
+	if (!load_positions(input, c.fens) || c.fens.empty()) {
+		std::cout << "No positions in " << input << std::endl;
+		return 1;
+	}
+	c.results.resize(c.fens.size());
+	c.known.resize(c.fens.size());
+	for (size_t i = 0; i < c.fens.size(); i++) {
+		if (is_valid_position(c.fens[i]))
+			c.pending.push_back(i);
+		else {
+			// A bad fen would take down every worker it is sent to
+			c.results[i] = "invalid";
+			c.known[i] = 1;
+			c.invalid++;
+		}
+	}
+	for (size_t first = 0; first < c.pending.size(); first += c.cfg.unit_size) {
+		c.queue.push_back((uint32_t)c.units.size());
+		c.units.push_back({ first, std::min<size_t>(c.cfg.unit_size, c.pending.size() - first) });
+	}
+	c.out = fopen(out_path, "w");
+	if (!c.out) {
+		std::cout << "Failed to open " << out_path << std::endl;
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, [](int) { interrupted = 1; });
+
+	int listen_fd = listen_tcp(c.cfg.host, c.cfg.port);
+	if (listen_fd < 0) {
+		std::cout << "Failed to listen on " << c.cfg.host << ":" << c.cfg.port << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+	flush_results(c);
+	printf("%zu positions in %zu units, %zu invalid, %s depth %d, listening on %s:%d\n", c.pending.size(), c.units.size(), c.invalid,
+		c.cfg.mode == UnitPerft ? "perft" : "search", c.cfg.depth, c.cfg.host, c.cfg.port);
+	fflush(stdout);
+
+	int64_t start = now_us(), last_report = start;
+	std::vector<pollfd> fds;
+	std::vector<size_t> owners;
+	while (c.units_done < c.units.size() && !interrupted) {
+		fds.assign(1, { listen_fd, POLLIN, 0 });
+		owners.clear();
+		for (size_t i = 0; i < c.workers.size(); i++) {
+			if (c.workers[i].fd >= 0) {
+				fds.push_back({ c.workers[i].fd, POLLIN, 0 });
+				owners.push_back(i);
+			}
+		}
+		if (poll(fds.data(), fds.size(), 200) < 0 && errno != EINTR)
+			break;
+		if (fds[0].revents & POLLIN)
+			accept_worker(c, listen_fd);
+
+		int64_t now = now_us();
+		for (size_t i = 1; i < fds.size(); i++) {
+			WorkerConn& w = c.workers[owners[i - 1]];
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				char buf[65536];
+				ssize_t n = read(w.fd, buf, sizeof(buf));
+				if (n <= 0) {
+					if (n < 0 && errno == EINTR)
+						continue;
+					drop_worker(c, w, "disconnected");
+					continue;
+				}
+				w.in.append(buf, n);
+				w.last_heard_us = now;
+				if (!handle_input(c, w))
+					drop_worker(c, w, "sent garbage");
+			}
+			else if (now - w.last_heard_us > c.cfg.timeout * 1e6)
+				drop_worker(c, w, "timed out");
+		}
+		dispatch(c);
+
+		if (now - last_report >= 5000000) {
+			last_report = now;
+			int alive = (int)std::count_if(c.workers.begin(), c.workers.end(), [](const WorkerConn& w) { return w.fd >= 0; });
+			printf("%zu/%zu units, %zu positions written, %d workers, %.1f positions/s\n", c.units_done, c.units.size(),
+				c.written, alive, c.written / seconds_since(start));
+			fflush(stdout);
+		}
+	}
+
+	for (auto& w : c.workers) {
+		if (w.fd >= 0) {
+			send_all(w.fd, "done\n");
+			close_socket(w.fd);
+			w.fd = -1;
+			w.gone_us = now_us();
+			w.end_reason = "finished";
+		}
+	}
+	close_socket(listen_fd);
+	fclose(c.out);
+	print_summary(c, seconds_since(start));
+	return c.units_done == c.units.size() ? 0 : 1;
+}
+
+#else
+
+int main(int argc, char** argv) {
+	std::cout << "The analysis coordinator only runs on Linux" << std::endl;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,193 @@
+// Analysis worker. Connects to a coordinator (tools/cluster/coordinator.cpp),
+// takes units of positions and runs a fixed depth search or perft on each,
+// spread over --threads threads. Every thread owns its hash table, which is
+// cleared before each position so results do not depend on which worker got
+// the unit. Exits when the coordinator has no work left or goes away.
+//
+//   worker [--host address] [--port n] [--threads n] [--hash mb] [--retry seconds]
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "search.h"
+#include "tt.h"
+#include "cluster.h"
+
+#if defined(__linux__)
+#include <csignal>
+#include <sys/socket.h>
+
+struct WorkUnit {
+	uint64_t id{};
+	UnitMode mode{};
+	int depth{};
+	std::vector<std::string> fens;
+};
+
+static uint64_t perft(const ChessBoard& brd, int depth) {
+	if (depth == 0)
+		return 1;
+	Move moves[MAX_MOVES];
+	int count = get_all_valid_moves(brd, moves);
+	if (depth == 1)
+		return count;
+	uint64_t leaves = 0;
+	for (int i = 0; i < count; i++) {
+		ChessBoard child = brd;
+		make_move(child, moves[i]);
+		leaves += perft(child, depth - 1);
+	}
+	return leaves;
+}
+
+static std::string analyse(const std::string& fen, UnitMode mode, int depth, TranspositionTable& tt) {
+	ChessBoard brd{};
+	init_fen(brd, fen.c_str());
+	char buf[96];
+	if (mode == UnitPerft) {
+		snprintf(buf, sizeof(buf), "%llu", (unsigned long long)perft(brd, depth));
+		return buf;
+	}
+	static const std::atomic<bool> never_stop{ false };
+	tt_clear(tt);
+	SearchLimits limits{};
+	limits.depth = depth;
+	limits.tt = &tt;
+	SearchInfo info = search(brd, limits, never_stop);
+	char move[6] = "none";
+	if (info.pv_length > 0)
+		move_to_string(info.pv[0], move);
+	snprintf(buf, sizeof(buf), "%s %d %d %llu", move, info.score, info.depth, (unsigned long long)info.nodes);
+	return buf;
+}
+
+// Positions of the unit are handed out to the threads one at a time
+static std::string run_unit(const WorkUnit& unit, std::vector<TranspositionTable>& tables) {
+	std::vector<std::string> results(unit.fens.size());
+	std::atomic<size_t> next{ 0 };
+	auto work = [&](TranspositionTable& tt) {
+		for (size_t i = next++; i < unit.fens.size(); i = next++)
+			results[i] = analyse(unit.fens[i], unit.mode, unit.depth, tt);
+	};
+	std::vector<std::thread> pool;
+	for (size_t t = 1; t < tables.size() && t < unit.fens.size(); t++)
+		pool.emplace_back(work, std::ref(tables[t]));
+	work(tables[0]);
+	for (auto& t : pool)
+		t.join();
+	std::string text;
+	for (auto& r : results)
+		text += r + "\n";
+	return text;
+}
+
+int main(int argc, char** argv) {
+	const char* host = "127.0.0.1";
+	int port = 7100;
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+	int hash_mb = 16;
+	double retry = 10;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+			host = argv[++i];
+		else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+			hash_mb = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--retry") == 0 && i + 1 < argc)
+			retry = atof(argv[++i]);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	// The coordinator may still be starting up
+	int64_t start = now_us();
+	int fd;
+	while ((fd = connect_tcp(host, port)) < 0) {
+		if (seconds_since(start) >= retry) {
+			std::cout << "Failed to connect to " << host << ":" << port << std::endl;
+			return 1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+
+	std::mutex write_mutex;
+	std::atomic<bool> connected{ true };
+	auto send = [&](const std::string& text) {
+		std::lock_guard<std::mutex> lock(write_mutex);
+		if (!send_all(fd, text))
+			connected = false;
+	};
+	send("hello " + std::to_string(threads) + "\n");
+	std::thread heartbeat([&]() {
+		while (connected) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			send("alive\n");
+		}
+	});
+
+	std::vector<TranspositionTable> tables(threads);
+	for (auto& tt : tables)
+		tt_resize(tt, hash_mb);
+
+	LineReader reader{ fd };
+	std::string line;
+	uint64_t units = 0, positions = 0;
+	double busy = 0;
+	while (connected && read_line(reader, line)) {
+		if (line == "done")
+			break;
+		std::istringstream header(line);
+		std::string word, mode;
+		WorkUnit unit;
+		size_t count = 0;
+		if (!(header >> word >> unit.id >> mode >> unit.depth >> count) || word != "unit") {
+			std::cout << "Unexpected line from the coordinator: " << line << std::endl;
+			break;
+		}
+		unit.mode = mode == "perft" ? UnitPerft : UnitSearch;
+		unit.fens.resize(count);
+		for (auto& fen : unit.fens) {
+			if (!read_line(reader, fen))
+				connected = false;
+		}
+		if (!connected)
+			break;
+
+		int64_t unit_start = now_us();
+		std::string results = run_unit(unit, tables);
+		int64_t busy_us = now_us() - unit_start;
+		send("result " + std::to_string(unit.id) + " " + std::to_string(busy_us) + "\n" + results);
+		units++;
+		positions += count;
+		busy += busy_us / 1e6;
+	}
+	connected = false;
+	// Ends the connection before waiting for the heartbeat thread
+	shutdown(fd, SHUT_RDWR);
+	heartbeat.join();
+	close_socket(fd);
+	double seconds = seconds_since(start);
+	printf("%llu units, %llu positions, busy %.1f of %.1f s\n", (unsigned long long)units, (unsigned long long)positions, busy, seconds);
+	return 0;
+}
+
+#else
+
+int main(int argc, char** argv) {
+	std::cout << "The analysis worker only runs on Linux" << std::endl;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,413 @@
+// Headless board diagram renderer. Reads FEN lines and writes one PNG per line
+// without touching OpenGL, so it can run on servers without a display.
+//
+// Input lines look like
+//   <fen> [; arrow e2e4 g1f3] [; highlight e4 d5]
+// and the n:th line is written to <out>/<n>.png. Lines with an invalid FEN
+// count as failed.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DIAGRAM_SSE2 1
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "chess.h"
+
+// Premultiplied RGBA, 8 bits per channel
+struct Pixel {
+	uint8_t r, g, b, a;
+};
+
+struct Canvas {
+	int w{}, h{};
+	std::vector<Pixel> px;
+};
+
+// Piece sprites scaled to the square size once at startup
+struct Sprites {
+	int size{};
+	// Indexed by [white][type - 1]
+	std::vector<Pixel> sprite[2][6];
+};
+
+struct DiagramStyle {
+	int square = 64;
+	bool labels = true;
+	Pixel light{ 230, 235, 237, 255 };
+	Pixel dark{ 128, 133, 153, 255 };
+	Pixel highlight{ 180, 170, 30, 140 };
+	Pixel arrow{ 20, 120, 50, 190 };
+};
+
+struct DiagramJob {
+	// Line number in the input, from 1
+	size_t line;
+	std::string fen;
+	std::vector<std::pair<int, int>> arrows;
+	std::vector<int> highlights;
+};
+
+Pixel premultiply(Pixel p) {
+	return {
+		(uint8_t)((p.r * p.a + 127) / 255),
+		(uint8_t)((p.g * p.a + 127) / 255),
+		(uint8_t)((p.b * p.a + 127) / 255),
+		p.a
+	};
+}
+
+// Box filters one 1/6 x 1/2 cell of the atlas down to size x size
+std::vector<Pixel> scale_sprite(const uint8_t* atlas, int aw, int ah, int cx, int cy, int size) {
+	int cw = aw / 6;
+	int ch = ah / 2;
+	std::vector<Pixel> out(size * size);
+	for (int y = 0; y < size; y++) {
+		int sy0 = cy * ch + y * ch / size;
+		int sy1 = cy * ch + ((y + 1) * ch + size - 1) / size;
+		for (int x = 0; x < size; x++) {
+			int sx0 = cx * cw + x * cw / size;
+			int sx1 = cx * cw + ((x + 1) * cw + size - 1) / size;
+			uint32_t acc[4]{};
+			uint32_t n = 0;
+			for (int sy = sy0; sy < sy1; sy++) {
+				for (int sx = sx0; sx < sx1; sx++) {
+					const uint8_t* s = atlas + (sy * aw + sx) * 4;
+					acc[0] += s[0] * s[3];
+					acc[1] += s[1] * s[3];
+					acc[2] += s[2] * s[3];
+					acc[3] += s[3];
+					n++;
+				}
+			}
+			out[y * size + x] = {
+				(uint8_t)(acc[0] / (255 * n)),
+				(uint8_t)(acc[1] / (255 * n)),
+				(uint8_t)(acc[2] / (255 * n)),
+				(uint8_t)(acc[3] / n)
+			};
+		}
+	}
+	return out;
+}
+
+bool load_sprites(Sprites& sprites, const char* path, int size) {
+	int w{}, h{}, c{};
+	uint8_t* data = stbi_load(path, &w, &h, &c, 4);
+	if (!data) {
+		return false;
+	}
+	sprites.size = size;
+	// Top row of the atlas holds the white pieces, columns follow PieceType
+	for (int white = 0; white < 2; white++) {
+		for (int type = 0; type < 6; type++) {
+			sprites.sprite[white][type] = scale_sprite(data, w, h, type, white ? 0 : 1, size);
+		}
+	}
+	stbi_image_free(data);
+	return true;
+}
+
+// dst = src + dst * (1 - src.a) for n premultiplied pixels
+void blend_span(Pixel* dst, const Pixel* src, int n) {
+	int i = 0;
+#ifdef DIAGRAM_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+	auto blend_half = [&](__m128i d, __m128i s) {
+		// Broadcast alpha to all four channels of each pixel
+		__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+		__m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(c255, a)), c128);
+		// Exact division by 255 for values in [0, 255 * 255]
+		t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		return _mm_add_epi16(t, s);
+	};
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i lo = blend_half(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+		__m128i hi = blend_half(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (; i < n; i++) {
+		uint32_t ia = 255 - src[i].a;
+		auto mix = [&](uint8_t d, uint8_t s) {
+			uint32_t t = d * ia + 128;
+			return (uint8_t)(s + ((t + (t >> 8)) >> 8));
+		};
+		dst[i] = { mix(dst[i].r, src[i].r), mix(dst[i].g, src[i].g), mix(dst[i].b, src[i].b), mix(dst[i].a, src[i].a) };
+	}
+}
+
+void fill_rect(Canvas& cv, int x, int y, int w, int h, Pixel col) {
+	for (int j = y; j < y + h; j++) {
+		Pixel* row = &cv.px[j * cv.w + x];
+		for (int i = 0; i < w; i++) {
+			row[i] = col;
+		}
+	}
+}
+
+void blend_rect(Canvas& cv, int x, int y, int w, int h, Pixel col) {
+	Pixel pm = premultiply(col);
+	std::vector<Pixel> span(w, pm);
+	for (int j = y; j < y + h; j++) {
+		blend_span(&cv.px[j * cv.w + x], span.data(), w);
+	}
+}
+
+void blend_sprite(Canvas& cv, int x, int y, const std::vector<Pixel>& sprite, int size) {
+	for (int j = 0; j < size; j++) {
+		blend_span(&cv.px[(y + j) * cv.w + x], &sprite[j * size], size);
+	}
+}
+
+// 5x7 glyphs for the board coordinates, one row per byte, msb on the left
+const uint8_t label_glyphs[16][7]{
+	{ 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F }, // a
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E }, // b
+	{ 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E }, // c
+	{ 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F }, // d
+	{ 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E }, // e
+	{ 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 }, // f
+	{ 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // g
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 }, // h
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+};
+
+void draw_glyph(Canvas& cv, int x, int y, int scale, int glyph, Pixel col) {
+	for (int row = 0; row < 7; row++) {
+		for (int bit = 0; bit < 5; bit++) {
+			if (label_glyphs[glyph][row] & (0x10 >> bit)) {
+				fill_rect(cv, x + bit * scale, y + row * scale, scale, scale, col);
+			}
+		}
+	}
+}
+
+// Arrow from the center of one square to another, anti aliased by distance to the shaft
+void draw_arrow(Canvas& cv, int sq, int from, int to, Pixel col) {
+	float x0 = (from % 8 + 0.5f) * sq, y0 = (from / 8 + 0.5f) * sq;
+	float x1 = (to % 8 + 0.5f) * sq, y1 = (to / 8 + 0.5f) * sq;
+	float dx = x1 - x0, dy = y1 - y0;
+	float len = std::sqrt(dx * dx + dy * dy);
+	if (len < 1.f)
+		return;
+	dx /= len;
+	dy /= len;
+	float shaft = sq * 0.09f;
+	float head_len = sq * 0.45f;
+	float head_w = sq * 0.3f;
+	float shaft_len = len - head_len;
+
+	int minx = (int)std::max(0.f, std::min(x0, x1) - sq * 0.5f);
+	int maxx = (int)std::min((float)cv.w, std::max(x0, x1) + sq * 0.5f);
+	int miny = (int)std::max(0.f, std::min(y0, y1) - sq * 0.5f);
+	int maxy = (int)std::min((float)cv.h, std::max(y0, y1) + sq * 0.5f);
+	for (int y = miny; y < maxy; y++) {
+		for (int x = minx; x < maxx; x++) {
+			float px = x + 0.5f - x0, py = y + 0.5f - y0;
+			// Coordinates along and across the arrow
+			float u = px * dx + py * dy;
+			float v = std::fabs(-px * dy + py * dx);
+			float coverage = 0.f;
+			if (u >= 0.f && u <= shaft_len) {
+				coverage = std::clamp(shaft - v + 0.5f, 0.f, 1.f);
+			}
+			else if (u > shaft_len && u <= len) {
+				float half = head_w * (len - u) / head_len;
+				coverage = std::clamp(half - v + 0.5f, 0.f, 1.f) * std::clamp(len - u + 0.5f, 0.f, 1.f);
+			}
+			if (coverage > 0.f) {
+				Pixel src = premultiply({ col.r, col.g, col.b, (uint8_t)(col.a * coverage) });
+				blend_span(&cv.px[y * cv.w + x], &src, 1);
+			}
+		}
+	}
+}
+
+void render_diagram(Canvas& cv, const Sprites& sprites, const DiagramStyle& style, const ChessBoard& brd, const DiagramJob& job) {
+	int sq = style.square;
+	cv.w = sq * 8;
+	cv.h = sq * 8;
+	cv.px.resize(cv.w * cv.h);
+
+	// Squares, index 0 is a8 in the top left corner
+	for (int i = 0; i < 64; i++) {
+		int x = i % 8, y = i / 8;
+		fill_rect(cv, x * sq, y * sq, sq, sq, ((x + y) % 2 == 0) ? style.light : style.dark);
+	}
+	for (int h : job.highlights) {
+		blend_rect(cv, (h % 8) * sq, (h / 8) * sq, sq, sq, style.highlight);
+	}
+	if (style.labels) {
+		int scale = std::max(1, sq / 40);
+		int margin = std::max(1, sq / 24);
+		for (int i = 0; i < 8; i++) {
+			// Files along the bottom edge, ranks along the left edge, drawn in the opposite square color
+			Pixel file_col = ((i + 7) % 2 == 0) ? style.dark : style.light;
+			draw_glyph(cv, i * sq + sq - 5 * scale - margin, 8 * sq - 7 * scale - margin, scale, i, file_col);
+			Pixel rank_col = (i % 2 == 0) ? style.dark : style.light;
+			draw_glyph(cv, margin, i * sq + margin, scale, 8 + (7 - i), rank_col);
+		}
+	}
+	for (int i = 0; i < 64; i++) {
+		int type = get_type(brd, i);
+		if (type == ChessBoard::None)
+			continue;
+		bool white = get_color(brd, i) == ChessBoard::White;
+		blend_sprite(cv, (i % 8) * sq, (i / 8) * sq, sprites.sprite[white][type - 1], sq);
+	}
+	for (auto& a : job.arrows) {
+		draw_arrow(cv, sq, a.first, a.second, style.arrow);
+	}
+}
+
+int parse_square(const std::string& s) {
+	if (s.size() < 2 || s[0] < 'a' || s[0] > 'h' || s[1] < '1' || s[1] > '8')
+		return -1;
+	return (s[0] - 'a') + ('8' - s[1]) * 8;
+}
+
+bool parse_job(const std::string& line, DiagramJob& job) {
+	std::stringstream parts(line);
+	std::string part;
+	bool first = true;
+	while (std::getline(parts, part, ';')) {
+		if (first) {
+			size_t b = part.find_first_not_of(" \t");
+			size_t e = part.find_last_not_of(" \t\r");
+			if (b == std::string::npos)
+				return false;
+			job.fen = part.substr(b, e - b + 1);
+			first = false;
+			continue;
+		}
+		std::stringstream words(part);
+		std::string kind, word;
+		words >> kind;
+		while (words >> word) {
+			if (kind == "arrow" && word.size() >= 4) {
+				int from = parse_square(word.substr(0, 2));
+				int to = parse_square(word.substr(2, 2));
+				if (from != -1 && to != -1)
+					job.arrows.push_back({ from, to });
+			}
+			else if (kind == "highlight") {
+				int sq = parse_square(word);
+				if (sq != -1)
+					job.highlights.push_back(sq);
+			}
+		}
+	}
+	return !first;
+}
+
+int main(int argc, char** argv) {
+	const char* fen_path = nullptr;
+	const char* out_dir = ".";
+	const char* atlas_path = "bin/pieces.png";
+	int threads = (int)std::thread::hardware_concurrency();
+	DiagramStyle style{};
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--fens") == 0 && i + 1 < argc)
+			fen_path = argv[++i];
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_dir = argv[++i];
+		else if (strcmp(argv[i], "--atlas") == 0 && i + 1 < argc)
+			atlas_path = argv[++i];
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			style.square = std::max(8, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc)
+			stbi_write_png_compression_level = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--no-labels") == 0)
+			style.labels = false;
+	}
+	if (!fen_path) {
+		std::cout << "usage: diagram --fens <file> [--out <dir>] [--atlas <png>] [--size <px>] [--threads <n>] [--level <0-9>] [--no-labels]" << std::endl;
+		return 1;
+	}
+	threads = std::max(1, threads);
+
+	Sprites sprites{};
+	if (!load_sprites(sprites, atlas_path, style.square)) {
+		std::cout << "Failed to load " << atlas_path << std::endl;
+		return 1;
+	}
+
+	std::vector<DiagramJob> jobs;
+	std::ifstream in(fen_path);
+	std::string line;
+	std::atomic<size_t> failed{ 0 };
+	for (size_t line_number = 1; std::getline(in, line); line_number++) {
+		DiagramJob job{};
+		job.line = line_number;
+		if (!parse_job(line, job))
+			continue;
+		if (is_valid_fen(job.fen.c_str()))
+			jobs.push_back(std::move(job));
+		else
+			failed++;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next{ 0 };
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&]() {
+			// Each worker reuses its own canvas between diagrams
+			Canvas cv{};
+			ChessBoard brd{};
+			std::string path;
+			for (size_t i = next++; i < jobs.size(); i = next++) {
+				brd = ChessBoard{};
+				init_fen(brd, jobs[i].fen.c_str());
+				render_diagram(cv, sprites, style, brd, jobs[i]);
+				path = std::string(out_dir) + "/" + std::to_string(jobs[i].line) + ".png";
+				if (!stbi_write_png(path.c_str(), cv.w, cv.h, 4, cv.px.data(), cv.w * 4))
+					failed++;
+			}
+		});
+	}
+	for (auto& t : pool) {
+		t.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout
+		<< jobs.size() << " diagrams in " << seconds << " s ("
+		<< (seconds > 0 ? jobs.size() / seconds : 0.0) << " diagrams/s, "
+		<< threads << " threads)" << std::endl;
+	if (failed) {
+		std::cout << failed << " diagrams could not be written" << std::endl;
+		return 1;
+	}
+	return 0;
+}
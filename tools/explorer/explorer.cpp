@@ -0,0 +1,537 @@
+// Opening explorer. "build" replays every game of a PGN archive and writes a
+// position index (explorer.h): for each position in the first --max-ply
+// plies, the moves played from it with their results and the games that
+// played them. "query" looks a position up and lists the moves.
+//
+// The build is an external sort. Threads parse chunks of the archive and
+// emit one record per position and move, sorting and spilling them to run
+// files whenever their share of --memory is full. The runs are then merged
+// into the index in a single pass.
+//
+//   explorer build games.pgn [--out games.idx] [--threads n] [--max-ply n] [--memory mb]
+//   explorer query games.idx [--fen fen] [--moves "e4 e5 Nf3"] [--pgn games.pgn] [--games n]
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <queue>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "zobrist.h"
+#include "explorer.h"
+
+const char* start_fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+struct BuildRecord {
+	uint64_t key;
+	// Byte offset of the game in the PGN file
+	uint64_t offset;
+	uint16_t move;
+	// White's result, 2 = win, 1 = draw, 0 = loss
+	uint8_t result;
+};
+
+static bool record_less(const BuildRecord& a, const BuildRecord& b) {
+	if (a.key != b.key)
+		return a.key < b.key;
+	if (a.move != b.move)
+		return a.move < b.move;
+	return a.offset < b.offset;
+}
+
+struct BuildConfig {
+	int threads{ 1 };
+	int max_ply{ 30 };
+	// Records a thread keeps in memory before spilling a run
+	size_t run_records{};
+	std::string run_prefix;
+};
+
+struct BuildState {
+	const MappedFile* pgn{};
+	std::atomic<size_t> next_chunk{ 0 };
+	size_t chunk_size{};
+	std::mutex mutex;
+	// Guarded by mutex
+	std::vector<std::string> runs;
+	uint64_t records{};
+	bool failed{ false };
+	std::atomic<uint64_t> games{ 0 };
+	std::atomic<uint64_t> skipped{ 0 };
+};
+
+static bool starts_with(const char* p, const char* end, const char* prefix) {
+	size_t n = strlen(prefix);
+	return (size_t)(end - p) >= n && memcmp(p, prefix, n) == 0;
+}
+
+static const char* next_line(const char* p, const char* end) {
+	const char* nl = (const char*)memchr(p, '\n', end - p);
+	return nl ? nl + 1 : end;
+}
+
+// First game starting at or after p, games start with a tag line at the beginning of a line
+static const char* find_game(const char* data, const char* p, const char* end) {
+	if (p > data && p[-1] != '\n')
+		p = next_line(p, end);
+	while (p < end && !starts_with(p, end, "[Event "))
+		p = next_line(p, end);
+	return p;
+}
+
+// Value of a tag line like [Result "1-0"]
+static std::string tag_value(const char* line, const char* end) {
+	const char* open = (const char*)memchr(line, '"', end - line);
+	if (!open)
+		return {};
+	const char* close = (const char*)memchr(open + 1, '"', end - open - 1);
+	return close ? std::string(open + 1, close) : std::string();
+}
+
+// Replays the movetext in [p, end), appending a record per ply. Comments,
+// variations, NAGs and move numbers are skipped. False on an illegal move.
+static bool replay_game(const char* p, const char* end, ChessBoard& brd, uint64_t offset, int result, int max_ply, std::vector<BuildRecord>& out) {
+	int ply = 0, depth = 0;
+	while (p < end && ply < max_ply) {
+		char c = *p;
+		if (c == '{') {
+			const char* close = (const char*)memchr(p, '}', end - p);
+			p = close ? close + 1 : end;
+		}
+		else if (c == ';') {
+			p = next_line(p, end);
+		}
+		else if (c == '(' || c == ')') {
+			depth += c == '(' ? 1 : -1;
+			p++;
+		}
+		else if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '.') {
+			p++;
+		}
+		else {
+			const char* token = p;
+			if (c >= '0' && c <= '9' && !starts_with(p, end, "0-0")) {
+				// Move number, the move may follow without a space as in "12...Nf6"
+				while (p < end && *p >= '0' && *p <= '9')
+					p++;
+				if (p < end && *p == '.')
+					continue;
+			}
+			while (p < end && !strchr(" \n\r\t{}();", *p))
+				p++;
+			// Variations, NAGs and the game result
+			if (depth > 0 || *token == '$' || *token == '*' || (*token >= '0' && *token <= '9' && !starts_with(token, p, "0-0")))
+				continue;
+			char san[16];
+			size_t len = std::min((size_t)(p - token), sizeof(san) - 1);
+			memcpy(san, token, len);
+			san[len] = 0;
+			Move mv;
+			if (!parse_san(brd, san, mv))
+				return false;
+			out.push_back({ position_hash(brd), offset, pack_explorer_move(mv), (uint8_t)result });
+			make_move(brd, mv);
+			ply++;
+		}
+	}
+	return true;
+}
+
+static bool write_run(std::vector<BuildRecord>& records, const BuildConfig& cfg, BuildState& state) {
+	std::sort(records.begin(), records.end(), record_less);
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		path = cfg.run_prefix + std::to_string(state.runs.size());
+		state.runs.push_back(path);
+		state.records += records.size();
+	}
+	FILE* f = fopen(path.c_str(), "wb");
+	bool ok = f && fwrite(records.data(), sizeof(BuildRecord), records.size(), f) == records.size();
+	if (f)
+		ok &= fclose(f) == 0;
+	records.clear();
+	return ok;
+}
+
+static void parse_chunks(const BuildConfig& cfg, BuildState& state) {
+	const char* data = (const char*)state.pgn->data;
+	const char* file_end = data + state.pgn->size;
+	std::vector<BuildRecord> records;
+	records.reserve(cfg.run_records);
+	bool ok = true;
+	for (;;) {
+		size_t chunk = state.next_chunk++;
+		if (chunk * state.chunk_size >= state.pgn->size)
+			break;
+		// The chunk owns the games that start inside it
+		const char* chunk_end = data + std::min(state.pgn->size, (chunk + 1) * state.chunk_size);
+		const char* p = find_game(data, data + chunk * state.chunk_size, file_end);
+		while (p < chunk_end) {
+			const char* game_start = p;
+			std::string result, fen;
+			p = next_line(p, file_end);
+			while (p < file_end && *p == '[') {
+				const char* line_end = next_line(p, file_end);
+				if (starts_with(p, line_end, "[Result "))
+					result = tag_value(p, line_end);
+				else if (starts_with(p, line_end, "[FEN "))
+					fen = tag_value(p, line_end);
+				p = line_end;
+			}
+			const char* game_end = find_game(data, p, file_end);
+			int white_points = result == "1-0" ? 2 : result == "1/2-1/2" ? 1 : result == "0-1" ? 0 : -1;
+			const char* start = fen.empty() ? start_fen : fen.c_str();
+			ChessBoard brd{};
+			// Unfinished games have no result to count, X-FEN and Chess960 tags are skipped too
+			bool valid = white_points >= 0 && is_valid_fen(start);
+			if (valid) {
+				init_fen(brd, start);
+				valid = settle_position(brd);
+			}
+			size_t before = records.size();
+			if (!valid || !replay_game(p, game_end, brd, game_start - data, white_points, cfg.max_ply, records)) {
+				records.resize(before);
+				state.skipped++;
+			}
+			else
+				state.games++;
+			p = game_end;
+			if (records.size() + cfg.max_ply > cfg.run_records)
+				ok &= write_run(records, cfg, state);
+		}
+	}
+	if (!records.empty())
+		ok &= write_run(records, cfg, state);
+	if (!ok) {
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.failed = true;
+	}
+}
+
+// Buffered reader over one sorted run
+struct RunReader {
+	FILE* file{};
+	std::vector<BuildRecord> buffer;
+	size_t pos{}, size{};
+};
+
+static bool next_record(RunReader& r, BuildRecord& out) {
+	if (r.pos == r.size) {
+		r.size = fread(r.buffer.data(), sizeof(BuildRecord), r.buffer.size(), r.file);
+		r.pos = 0;
+		if (r.size == 0)
+			return false;
+	}
+	out = r.buffer[r.pos++];
+	return true;
+}
+
+static bool write_all(FILE* f, const void* data, size_t size, size_t count) {
+	return fwrite(data, size, count, f) == count;
+}
+
+// Merges the runs into the index. Entries go straight to the output file,
+// postings to a temporary file that is appended once the entries are done.
+static bool merge_runs(const BuildState& state, const BuildConfig& cfg, const char* out_path) {
+	std::vector<RunReader> readers(state.runs.size());
+	auto close_runs = [&]() {
+		for (auto& r : readers) {
+			if (r.file)
+				fclose(r.file);
+		}
+	};
+	for (size_t i = 0; i < readers.size(); i++) {
+		readers[i].file = fopen(state.runs[i].c_str(), "rb");
+		readers[i].buffer.resize(1 << 16);
+		if (!readers[i].file) {
+			close_runs();
+			return false;
+		}
+	}
+	std::string postings_path = cfg.run_prefix + "postings";
+	FILE* out = fopen(out_path, "wb+");
+	FILE* postings = fopen(postings_path.c_str(), "wb+");
+	if (!out || !postings) {
+		if (out)
+			fclose(out);
+		if (postings) {
+			fclose(postings);
+			remove(postings_path.c_str());
+		}
+		close_runs();
+		return false;
+	}
+
+	// About four records per bucket, most positions only occur in a few games
+	ExplorerHeader header{};
+	header.magic = EXPLORER_MAGIC;
+	header.version = EXPLORER_VERSION;
+	header.games = state.games;
+	header.max_ply = cfg.max_ply;
+	header.bucket_bits = 1;
+	while (header.bucket_bits < 28 && (4ull << header.bucket_bits) < state.records)
+		header.bucket_bits++;
+	header.entries_offset = sizeof(ExplorerHeader);
+	std::vector<uint64_t> buckets((1ull << header.bucket_bits) + 1, 0);
+	uint64_t next_bucket = 0;
+	bool ok = write_all(out, &header, sizeof(header), 1);
+
+	using HeapItem = std::pair<BuildRecord, size_t>;
+	auto heap_greater = [](const HeapItem& a, const HeapItem& b) { return record_less(b.first, a.first); };
+	std::priority_queue<HeapItem, std::vector<HeapItem>, decltype(heap_greater)> heap(heap_greater);
+	for (size_t i = 0; i < readers.size(); i++) {
+		BuildRecord r;
+		if (next_record(readers[i], r))
+			heap.push({ r, i });
+	}
+
+	std::vector<uint64_t> offsets;
+	offsets.reserve(1 << 16);
+	ExplorerEntry entry{};
+	bool open = false;
+	auto flush_entry = [&]() {
+		if (!open)
+			return;
+		ok &= write_all(out, &entry, sizeof(entry), 1);
+		header.entry_count++;
+	};
+	while (!heap.empty()) {
+		auto [r, run] = heap.top();
+		heap.pop();
+		BuildRecord next;
+		if (next_record(readers[run], next))
+			heap.push({ next, run });
+
+		if (!open || r.key != entry.key || r.move != entry.move) {
+			flush_entry();
+			uint64_t bucket = r.key >> (64 - header.bucket_bits);
+			while (next_bucket <= bucket)
+				buckets[next_bucket++] = header.entry_count;
+			entry = ExplorerEntry{};
+			entry.key = r.key;
+			entry.move = r.move;
+			entry.first_posting = header.posting_count;
+			open = true;
+		}
+		(r.result == 2 ? entry.white : r.result == 1 ? entry.draws : entry.black)++;
+		offsets.push_back(r.offset);
+		header.posting_count++;
+		if (offsets.size() == offsets.capacity()) {
+			ok &= write_all(postings, offsets.data(), sizeof(uint64_t), offsets.size());
+			offsets.clear();
+		}
+	}
+	flush_entry();
+	while (next_bucket < buckets.size())
+		buckets[next_bucket++] = header.entry_count;
+	ok &= write_all(postings, offsets.data(), sizeof(uint64_t), offsets.size());
+
+	header.postings_offset = header.entries_offset + header.entry_count * sizeof(ExplorerEntry);
+	header.buckets_offset = header.postings_offset + header.posting_count * sizeof(uint64_t);
+	rewind(postings);
+	std::vector<char> copy(1 << 20);
+	size_t n;
+	while ((n = fread(copy.data(), 1, copy.size(), postings)) > 0)
+		ok &= write_all(out, copy.data(), 1, n);
+	ok &= write_all(out, buckets.data(), sizeof(uint64_t), buckets.size());
+	rewind(out);
+	ok &= write_all(out, &header, sizeof(header), 1);
+	ok &= fclose(out) == 0;
+	fclose(postings);
+	remove(postings_path.c_str());
+	close_runs();
+	return ok;
+}
+
+static int build(int argc, char** argv) {
+	const char* pgn_path = nullptr;
+	std::string out_path;
+	int memory_mb = 1024;
+	BuildConfig cfg{};
+	cfg.threads = (int)std::thread::hardware_concurrency();
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_path = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			cfg.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-ply") == 0 && i + 1 < argc)
+			cfg.max_ply = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+			memory_mb = std::max(16, atoi(argv[++i]));
+		else
+			pgn_path = argv[i];
+	}
+	if (!pgn_path) {
+		std::cout << "usage: explorer build games.pgn [--out games.idx] [--threads n] [--max-ply n] [--memory mb]" << std::endl;
+		return 1;
+	}
+	cfg.threads = std::max(1, cfg.threads);
+	if (out_path.empty())
+		out_path = std::string(pgn_path) + ".idx";
+	cfg.run_prefix = out_path + ".run";
+	cfg.run_records = std::max<size_t>((size_t)memory_mb * 1024 * 1024 / sizeof(BuildRecord) / cfg.threads, 4 * cfg.max_ply);
+
+	MappedFile pgn;
+	if (!map_file(pgn, pgn_path)) {
+		std::cout << "Failed to open " << pgn_path << std::endl;
+		return 1;
+	}
+	auto start = std::chrono::steady_clock::now();
+	BuildState state;
+	state.pgn = &pgn;
+	// Several chunks per thread so one slow chunk doesn't hold up the rest
+	state.chunk_size = std::max<size_t>(pgn.size / (cfg.threads * 8) + 1, 1 << 20);
+	std::vector<std::thread> pool;
+	for (int t = 0; t < cfg.threads; t++)
+		pool.emplace_back(parse_chunks, std::cref(cfg), std::ref(state));
+	for (auto& t : pool)
+		t.join();
+	double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("parsed %llu games (%llu skipped), %llu positions in %zu runs, %.2f s\n",
+		(unsigned long long)state.games, (unsigned long long)state.skipped, (unsigned long long)state.records,
+		state.runs.size(), parse_seconds);
+
+	bool ok = !state.failed && merge_runs(state, cfg, out_path.c_str());
+	for (auto& run : state.runs)
+		remove(run.c_str());
+	unmap_file(pgn);
+	if (!ok) {
+		std::cout << "Writing " << out_path << " failed" << std::endl;
+		return 1;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	ExplorerIndex index;
+	if (!open_explorer(index, out_path.c_str())) {
+		std::cout << "Reading back " << out_path << " failed" << std::endl;
+		return 1;
+	}
+	printf("%llu entries, %llu postings written to %s, %.2f s, %.0f games/s\n",
+		(unsigned long long)index.header->entry_count, (unsigned long long)index.header->posting_count,
+		out_path.c_str(), seconds, seconds > 0 ? state.games / seconds : 0.0);
+	close_explorer(index);
+	return 0;
+}
+
+// Prints the tag lines of the game at offset
+static void print_game(const MappedFile& pgn, uint64_t offset) {
+	if (offset >= pgn.size)
+		return;
+	const char* p = (const char*)pgn.data + offset;
+	const char* end = (const char*)pgn.data + pgn.size;
+	std::string line = "  ";
+	for (const char* tag : { "[White ", "[Black ", "[Result ", "[Date " }) {
+		for (const char* q = p; q < end && *q == '['; q = next_line(q, end)) {
+			if (starts_with(q, end, tag)) {
+				line += tag_value(q, next_line(q, end)) + "  ";
+				break;
+			}
+		}
+	}
+	std::cout << line << std::endl;
+}
+
+static int query(int argc, char** argv) {
+	const char* index_path = nullptr;
+	const char* fen = start_fen;
+	const char* pgn_path = nullptr;
+	std::string moves;
+	int max_games = 10;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--fen") == 0 && i + 1 < argc)
+			fen = argv[++i];
+		else if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc)
+			moves = argv[++i];
+		else if (strcmp(argv[i], "--pgn") == 0 && i + 1 < argc)
+			pgn_path = argv[++i];
+		else if (strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+			max_games = atoi(argv[++i]);
+		else
+			index_path = argv[i];
+	}
+	if (!index_path) {
+		std::cout << "usage: explorer query games.idx [--fen fen] [--moves \"e4 e5 Nf3\"] [--pgn games.pgn] [--games n]" << std::endl;
+		return 1;
+	}
+	ChessBoard brd{};
+	if (!is_valid_fen(fen)) {
+		std::cout << "Invalid FEN " << fen << std::endl;
+		return 1;
+	}
+	init_fen(brd, fen);
+	if (!settle_position(brd)) {
+		std::cout << "Illegal position " << fen << std::endl;
+		return 1;
+	}
+	ExplorerIndex index;
+	if (!open_explorer(index, index_path)) {
+		std::cout << "Failed to open " << index_path << std::endl;
+		return 1;
+	}
+	std::istringstream move_list(moves);
+	std::string san;
+	while (move_list >> san) {
+		Move mv;
+		if (!parse_san(brd, san.c_str(), mv)) {
+			std::cout << "Illegal move " << san << std::endl;
+			return 1;
+		}
+		make_move(brd, mv);
+	}
+
+	uint64_t key = position_hash(brd);
+	const ExplorerEntry* first = nullptr;
+	auto start = std::chrono::steady_clock::now();
+	size_t count = explorer_lookup(index, key, first);
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	// Most played first
+	std::vector<const ExplorerEntry*> sorted;
+	for (size_t i = 0; i < count; i++)
+		sorted.push_back(first + i);
+	auto games = [](const ExplorerEntry* e) { return (uint64_t)e->white + e->draws + e->black; };
+	std::stable_sort(sorted.begin(), sorted.end(), [&](auto a, auto b) { return games(a) > games(b); });
+	printf("%zu moves, lookup %.1f us\n", count, us);
+	printf("move          games  white / draw  / black\n");
+	for (auto e : sorted) {
+		char line[96];
+		format_explorer_entry(brd, *e, line, sizeof(line));
+		printf("%s\n", line);
+	}
+
+	MappedFile pgn;
+	if (pgn_path && max_games > 0 && map_file(pgn, pgn_path)) {
+		// Postings of the position, merged across its moves in file order
+		std::vector<uint64_t> offsets;
+		for (auto e : sorted) {
+			const uint64_t* postings;
+			size_t n = explorer_postings(index, *e, postings);
+			offsets.insert(offsets.end(), postings, postings + n);
+		}
+		std::sort(offsets.begin(), offsets.end());
+		offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+		printf("%zu games reached the position\n", offsets.size());
+		for (size_t i = 0; i < offsets.size() && (int)i < max_games; i++)
+			print_game(pgn, offsets[i]);
+		unmap_file(pgn);
+	}
+	close_explorer(index);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc >= 2 && strcmp(argv[1], "build") == 0)
+		return build(argc, argv);
+	if (argc >= 2 && strcmp(argv[1], "query") == 0)
+		return query(argc, argv);
+	std::cout << "usage: explorer build games.pgn [options] | explorer query games.idx [options]" << std::endl;
+	return 1;
+}
@@ -0,0 +1,249 @@
+// Load test for tools/server. Opens --connections connections, each on its
+// own thread, and spreads --sessions games over them. Every connection cycles
+// through its games asking for the legal moves and playing a random one, one
+// request at a time, and starts a new game when one ends. The clock starts
+// once every connection has created its games and stops when they leave the
+// move loop. Prints moves per second and the latency percentiles of legal and
+// move requests, with new and close requests apart.
+//
+//   loadtest [--port n] [--host address] [--unix path] [--sessions n]
+//            [--connections n] [--seconds n]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+struct LoadConfig {
+	const char* host{ "127.0.0.1" };
+	const char* unix_path{};
+	int port{ 7000 };
+	int sessions{ 10000 };
+	int connections{ 64 };
+	double seconds{ 10 };
+};
+
+struct Client {
+	int fd{ -1 };
+	std::string in;
+};
+
+struct ConnectionStats {
+	uint64_t moves{}, games{}, errors{};
+	// Round trips in microseconds, legal and move requests
+	std::vector<uint32_t> move_latencies;
+	// new and close requests
+	std::vector<uint32_t> session_latencies;
+	std::chrono::steady_clock::time_point stop;
+};
+
+// Connections wait for go after creating their games, main sets deadline first
+struct StartSignal {
+	std::atomic<int> ready{};
+	std::atomic<bool> go{};
+	std::chrono::steady_clock::time_point deadline;
+};
+
+static uint64_t next_random(uint64_t& state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static bool connect_client(Client& c, const LoadConfig& cfg) {
+	if (cfg.unix_path) {
+		c.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, cfg.unix_path, sizeof(addr.sun_path) - 1);
+		return c.fd >= 0 && connect(c.fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+	}
+	c.fd = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)cfg.port);
+	return c.fd >= 0 && inet_pton(AF_INET, cfg.host, &addr.sin_addr) == 1 && connect(c.fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+// Sends one request line and waits for its reply, false if the connection failed
+static bool request(Client& c, const std::string& line, std::string& reply, ConnectionStats& stats, std::vector<uint32_t>& latencies) {
+	auto start = std::chrono::steady_clock::now();
+	size_t sent = 0;
+	while (sent < line.size()) {
+		ssize_t n = write(c.fd, line.data() + sent, line.size() - sent);
+		if (n <= 0 && errno != EINTR)
+			return false;
+		sent += std::max<ssize_t>(n, 0);
+	}
+	size_t end;
+	while ((end = c.in.find('\n')) == std::string::npos) {
+		char buf[4096];
+		ssize_t n = read(c.fd, buf, sizeof(buf));
+		if (n <= 0 && errno != EINTR)
+			return false;
+		if (n > 0)
+			c.in.append(buf, n);
+	}
+	reply.assign(c.in, 0, end);
+	c.in.erase(0, end + 1);
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	latencies.push_back((uint32_t)std::min<int64_t>(us, UINT32_MAX));
+	if (reply.compare(0, 3, "ok ") != 0 && reply != "ok")
+		stats.errors++;
+	return true;
+}
+
+static bool new_game(Client& c, std::string& id, ConnectionStats& stats) {
+	std::string reply;
+	if (!request(c, "new 300000 2000\n", reply, stats, stats.session_latencies) || reply.compare(0, 3, "ok ") != 0)
+		return false;
+	id = reply.substr(3);
+	stats.games++;
+	return true;
+}
+
+static void run_connection(const LoadConfig& cfg, int index, int sessions, StartSignal& start_signal, ConnectionStats& stats, std::atomic<bool>& failed) {
+	Client c;
+	std::vector<std::string> ids(sessions);
+	bool ok = connect_client(c, cfg);
+	for (size_t i = 0; ok && i < ids.size(); i++)
+		ok = new_game(c, ids[i], stats);
+	start_signal.ready++;
+	if (!ok) {
+		failed = true;
+		if (c.fd >= 0)
+			close(c.fd);
+		return;
+	}
+	while (!start_signal.go)
+		std::this_thread::yield();
+
+	uint64_t rng = 0x9E3779B97F4A7C15ull * (index + 1);
+	std::string reply;
+	for (size_t next = 0; !ids.empty() && std::chrono::steady_clock::now() < start_signal.deadline; next = (next + 1) % ids.size()) {
+		std::string& id = ids[next];
+		if (!request(c, "legal " + id + "\n", reply, stats, stats.move_latencies))
+			break;
+		// Pick a random move from "ok e2e4 d2d4 ..."
+		std::vector<std::string> moves;
+		for (size_t p = 3; p < reply.size();) {
+			size_t space = reply.find(' ', p);
+			if (space == std::string::npos)
+				space = reply.size();
+			moves.push_back(reply.substr(p, space - p));
+			p = space + 1;
+		}
+		bool over = moves.empty();
+		if (!over) {
+			if (!request(c, "move " + id + " " + moves[next_random(rng) % moves.size()] + "\n", reply, stats, stats.move_latencies))
+				break;
+			stats.moves++;
+			over = reply.compare(0, 4, "ok *") != 0;
+		}
+		if (over) {
+			if (!request(c, "close " + id + "\n", reply, stats, stats.session_latencies) || !new_game(c, id, stats))
+				break;
+		}
+	}
+	stats.stop = std::chrono::steady_clock::now();
+	for (auto& id : ids)
+		request(c, "close " + id + "\n", reply, stats, stats.session_latencies);
+	close(c.fd);
+}
+
+int main(int argc, char** argv) {
+	LoadConfig cfg{};
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			cfg.port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+			cfg.host = argv[++i];
+		else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc)
+			cfg.unix_path = argv[++i];
+		else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc)
+			cfg.sessions = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+			cfg.connections = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+			cfg.seconds = atof(argv[++i]);
+	}
+	cfg.connections = std::min(cfg.connections, cfg.sessions);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::vector<ConnectionStats> stats(cfg.connections);
+	std::atomic<bool> failed{ false };
+	StartSignal start_signal;
+	std::vector<std::thread> pool;
+	for (int i = 0; i < cfg.connections; i++) {
+		int sessions = cfg.sessions / cfg.connections + (i < cfg.sessions % cfg.connections ? 1 : 0);
+		pool.emplace_back(run_connection, std::cref(cfg), i, sessions, std::ref(start_signal), std::ref(stats[i]), std::ref(failed));
+	}
+	auto setup_start = std::chrono::steady_clock::now();
+	while (start_signal.ready < cfg.connections)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	auto start = std::chrono::steady_clock::now();
+	start_signal.deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(cfg.seconds));
+	start_signal.go = true;
+	for (auto& t : pool)
+		t.join();
+	double setup_seconds = std::chrono::duration<double>(start - setup_start).count();
+	auto stop = start;
+	for (auto& s : stats)
+		stop = std::max(stop, s.stop);
+	double seconds = std::chrono::duration<double>(stop - start).count();
+
+	ConnectionStats total;
+	for (auto& s : stats) {
+		total.moves += s.moves;
+		total.games += s.games;
+		total.errors += s.errors;
+		total.move_latencies.insert(total.move_latencies.end(), s.move_latencies.begin(), s.move_latencies.end());
+		total.session_latencies.insert(total.session_latencies.end(), s.session_latencies.begin(), s.session_latencies.end());
+	}
+	if (failed)
+		std::cout << "Some connections failed" << std::endl;
+	if (total.move_latencies.empty())
+		return 1;
+	auto print_latencies = [](const char* name, std::vector<uint32_t>& latencies) {
+		if (latencies.empty())
+			return;
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&](double p) { return latencies[(size_t)(p * (latencies.size() - 1))]; };
+		printf("%s latency us: p50 %u  p90 %u  p99 %u  max %u\n",
+			name, percentile(0.5), percentile(0.9), percentile(0.99), latencies.back());
+	};
+	printf("%d sessions over %d connections, set up in %.1f s, played for %.1f s\n", cfg.sessions, cfg.connections, setup_seconds, seconds);
+	printf("%llu moves, %.0f moves/s, %llu games started, %llu requests, %llu errors\n",
+		(unsigned long long)total.moves, seconds > 0 ? total.moves / seconds : 0.0, (unsigned long long)total.games,
+		(unsigned long long)(total.move_latencies.size() + total.session_latencies.size()), (unsigned long long)total.errors);
+	print_latencies("legal/move", total.move_latencies);
+	print_latencies("new/close ", total.session_latencies);
+	return failed ? 1 : 0;
+}
+
+#else
+
+int main(int argc, char** argv) {
+	std::cout << "The load test only runs on Linux" << std::endl;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,399 @@
+// Engine vs engine match runner. Plays two search configurations against
+// each other from a set of openings, every opening once with each color.
+// Games run concurrently, each owning its boards and hash tables. Finished
+// games are appended to a PGN file and the Elo estimate and SPRT state are
+// printed after every game. The match stops early once the SPRT decides.
+//
+//   match [--engine name=a,depth=n,nodes=n,hash=mb] [--engine ...] [--openings file.epd]
+//         [--games n] [--concurrency n] [--pgn out.pgn] [--max-plies n]
+//         [--sprt elo0 elo1 alpha beta] [--resign cp moves] [--draw cp moves ply]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "search.h"
+#include "game.h"
+
+const char* default_openings[]{
+	"rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",
+	"rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",
+	"rnbqkbnr/pppp1ppp/4p3/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",
+	"rnbqkbnr/pp1ppppp/2p5/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",
+	"rnbqkbnr/ppp1pppp/8/3p4/3P4/8/PPP1PPPP/RNBQKBNR w KQkq -",
+	"rnbqkb1r/pppppppp/5n2/8/3P4/8/PPP1PPPP/RNBQKBNR w KQkq -",
+	"rnbqkbnr/pppppppp/8/8/2P5/8/PP1PPPPP/RNBQKBNR b KQkq -",
+	"rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b KQkq -",
+};
+
+struct EngineConfig {
+	std::string name;
+	SearchLimits limits{};
+	// Hash table size per game, 0 searches without one
+	int hash_mb{ 16 };
+};
+
+struct Adjudication {
+	int max_plies{ 400 };
+	// Win once both sides agreed on a score beyond resign_cp for resign_moves moves each
+	int resign_cp{ 1000 }, resign_moves{ 4 };
+	// Draw once both sides scored within draw_cp for draw_moves moves each, from ply draw_ply on
+	int draw_cp{ 10 }, draw_moves{ 8 }, draw_ply{ 80 };
+};
+
+struct SprtConfig {
+	double elo0{ 0 }, elo1{ 5 }, alpha{ 0.05 }, beta{ 0.05 };
+};
+
+struct GameRecord {
+	int round{};
+	bool a_white{};
+	// White's result, 2 = win, 1 = draw, 0 = loss
+	int white_points{};
+	const char* reason{};
+	bool adjudicated{};
+	std::string pgn;
+};
+
+static void append_movetext(std::string& text, int& line_len, const std::string& token) {
+	if (line_len + 1 + (int)token.size() > 79) {
+		text += '\n';
+		line_len = 0;
+	}
+	else if (line_len > 0) {
+		text += ' ';
+		line_len++;
+	}
+	text += token;
+	line_len += (int)token.size();
+}
+
+static GameRecord play_game(const EngineConfig (&engines)[2], const Adjudication& adj, const std::string& opening, int round, bool a_white, const char* date) {
+	GameRecord rec{ round, a_white };
+	Game game;
+	start_game(game, opening.c_str());
+	const ChessBoard& brd = game.brd;
+	char start_fen[MAX_FEN];
+	board_to_fen(brd, start_fen);
+
+	// Each game owns its hash tables so games never share search state
+	TranspositionTable tables[2];
+	SearchLimits limits[2];
+	for (int e = 0; e < 2; e++) {
+		limits[e] = engines[e].limits;
+		limits[e].tt = nullptr;
+		if (engines[e].hash_mb > 0) {
+			tt_resize(tables[e], engines[e].hash_mb);
+			limits[e].tt = &tables[e];
+		}
+	}
+	std::atomic<bool> stop{ false };
+
+	std::string movetext;
+	int line_len = 0;
+	int move_number = 1;
+	// Scores from white's point of view, one per ply
+	std::vector<int> scores;
+	for (int ply = 0;; ply++) {
+		if ((rec.reason = game_result(game, rec.white_points)))
+			break;
+		if (ply >= adj.max_plies) {
+			rec.white_points = 1;
+			rec.reason = "move limit";
+			rec.adjudicated = true;
+			break;
+		}
+
+		bool white = brd.current_turn == ChessBoard::White;
+		int e = (white == a_white) ? 0 : 1;
+		SearchInfo info = search(brd, limits[e], stop);
+		Move mv = info.pv[0];
+		if (info.pv_length == 0) {
+			// The node budget ran out before depth 1 finished
+			Move moves[MAX_MOVES];
+			get_all_valid_moves(brd, moves);
+			mv = moves[0];
+		}
+		scores.push_back(white ? info.score : -info.score);
+
+		char san[MAX_SAN];
+		move_to_san(brd, mv, san);
+		if (white || ply == 0)
+			append_movetext(movetext, line_len, std::to_string(move_number) + (white ? "." : "..."));
+		append_movetext(movetext, line_len, san);
+		if (!white)
+			move_number++;
+
+		play_move(game, mv);
+
+		// Score adjudication needs both engines to agree over their last moves
+		int n = (int)scores.size();
+		if (adj.resign_moves > 0 && n >= adj.resign_moves * 2) {
+			bool white_wins = true, black_wins = true;
+			for (int i = n - adj.resign_moves * 2; i < n; i++) {
+				white_wins &= scores[i] >= adj.resign_cp;
+				black_wins &= scores[i] <= -adj.resign_cp;
+			}
+			if (white_wins || black_wins) {
+				rec.white_points = white_wins ? 2 : 0;
+				rec.reason = "score adjudication";
+				rec.adjudicated = true;
+				break;
+			}
+		}
+		if (adj.draw_moves > 0 && ply + 1 >= adj.draw_ply && n >= adj.draw_moves * 2) {
+			bool drawn = true;
+			for (int i = n - adj.draw_moves * 2; i < n; i++)
+				drawn &= std::abs(scores[i]) <= adj.draw_cp;
+			if (drawn) {
+				rec.white_points = 1;
+				rec.reason = "draw adjudication";
+				rec.adjudicated = true;
+				break;
+			}
+		}
+	}
+
+	const char* result = rec.white_points == 2 ? "1-0" : rec.white_points == 0 ? "0-1" : "1/2-1/2";
+	std::ostringstream pgn;
+	pgn << "[Event \"match\"]\n"
+		<< "[Site \"?\"]\n"
+		<< "[Date \"" << date << "\"]\n"
+		<< "[Round \"" << round << "\"]\n"
+		<< "[White \"" << engines[a_white ? 0 : 1].name << "\"]\n"
+		<< "[Black \"" << engines[a_white ? 1 : 0].name << "\"]\n"
+		<< "[Result \"" << result << "\"]\n"
+		<< "[FEN \"" << start_fen << "\"]\n"
+		<< "[SetUp \"1\"]\n"
+		<< "[Termination \"" << (rec.adjudicated ? "adjudication" : "normal") << "\"]\n\n";
+	append_movetext(movetext, line_len, std::string("{") + rec.reason + "}");
+	append_movetext(movetext, line_len, result);
+	pgn << movetext << "\n\n";
+	rec.pgn = pgn.str();
+	return rec;
+}
+
+static double elo_from_score(double score) {
+	score = std::clamp(score, 1e-6, 1.0 - 1e-6);
+	return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+static double score_from_elo(double elo) {
+	return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+struct MatchStats {
+	// From engine a's point of view
+	int wins{}, draws{}, losses{};
+};
+
+// Elo of a against b with a 95% interval half width
+static void elo_estimate(const MatchStats& s, double& elo, double& margin) {
+	int n = s.wins + s.draws + s.losses;
+	double score = (s.wins + 0.5 * s.draws) / n;
+	double var = (s.wins * std::pow(1 - score, 2) + s.draws * std::pow(0.5 - score, 2) + s.losses * std::pow(score, 2)) / n;
+	double dev = 1.96 * std::sqrt(var / n);
+	elo = elo_from_score(score);
+	margin = (elo_from_score(score + dev) - elo_from_score(score - dev)) / 2;
+}
+
+// Log likelihood ratio of elo1 against elo0 with the normal approximation of the trinomial model
+static double sprt_llr(const MatchStats& s, const SprtConfig& cfg) {
+	int n = s.wins + s.draws + s.losses;
+	if (n == 0 || s.wins + s.losses == 0)
+		return 0.0;
+	double score = (s.wins + 0.5 * s.draws) / n;
+	double var = (s.wins * std::pow(1 - score, 2) + s.draws * std::pow(0.5 - score, 2) + s.losses * std::pow(score, 2)) / n;
+	if (var <= 0)
+		return 0.0;
+	double s0 = score_from_elo(cfg.elo0), s1 = score_from_elo(cfg.elo1);
+	return n * (s1 - s0) * (2 * score - s0 - s1) / (2 * var);
+}
+
+static bool parse_engine(const char* arg, EngineConfig& cfg) {
+	std::stringstream ss(arg);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		size_t eq = item.find('=');
+		if (eq == std::string::npos)
+			return false;
+		std::string key = item.substr(0, eq), value = item.substr(eq + 1);
+		if (key == "name")
+			cfg.name = value;
+		else if (key == "depth")
+			cfg.limits.depth = std::clamp(atoi(value.c_str()), 1, MAX_PLY - 1);
+		else if (key == "nodes")
+			cfg.limits.nodes = strtoull(value.c_str(), nullptr, 10);
+		else if (key == "hash")
+			cfg.hash_mb = std::max(0, atoi(value.c_str()));
+		else
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	EngineConfig engines[2];
+	engines[0].name = "a";
+	engines[1].name = "b";
+	for (EngineConfig& e : engines)
+		e.limits.nodes = 20000;
+	int engine_count = 0;
+	const char* openings_path = nullptr;
+	const char* pgn_path = "match.pgn";
+	int games = 0;
+	int concurrency = (int)std::thread::hardware_concurrency();
+	Adjudication adj{};
+	SprtConfig sprt{};
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc && engine_count < 2) {
+			if (!parse_engine(argv[++i], engines[engine_count++])) {
+				std::cout << "Bad engine description " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--openings") == 0 && i + 1 < argc)
+			openings_path = argv[++i];
+		else if (strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+			games = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc)
+			concurrency = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--pgn") == 0 && i + 1 < argc)
+			pgn_path = argv[++i];
+		else if (strcmp(argv[i], "--max-plies") == 0 && i + 1 < argc)
+			adj.max_plies = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--sprt") == 0 && i + 4 < argc) {
+			sprt.elo0 = atof(argv[++i]);
+			sprt.elo1 = atof(argv[++i]);
+			sprt.alpha = atof(argv[++i]);
+			sprt.beta = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--resign") == 0 && i + 2 < argc) {
+			adj.resign_cp = atoi(argv[++i]);
+			adj.resign_moves = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--draw") == 0 && i + 3 < argc) {
+			adj.draw_cp = atoi(argv[++i]);
+			adj.draw_moves = atoi(argv[++i]);
+			adj.draw_ply = atoi(argv[++i]);
+		}
+	}
+	concurrency = std::max(1, concurrency);
+	for (const EngineConfig& e : engines) {
+		if (e.limits.nodes == 0 && e.limits.depth == MAX_PLY - 1) {
+			std::cout << "Engine " << e.name << " needs a depth or node limit" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<std::string> openings;
+	if (openings_path) {
+		std::ifstream in(openings_path);
+		std::string line;
+		int dropped = 0;
+		while (std::getline(in, line)) {
+			if (line.empty() || line[0] == '#')
+				continue;
+			// start_game trusts its fen, a bad line would stop the whole match
+			ChessBoard brd{};
+			bool valid = is_valid_fen(line.c_str());
+			if (valid) {
+				init_fen(brd, line.c_str());
+				valid = settle_position(brd);
+			}
+			if (valid)
+				openings.push_back(line);
+			else
+				dropped++;
+		}
+		if (dropped)
+			std::cout << "Dropped " << dropped << " invalid openings from " << openings_path << std::endl;
+	}
+	else {
+		openings.assign(std::begin(default_openings), std::end(default_openings));
+	}
+	if (openings.empty()) {
+		std::cout << "No openings" << std::endl;
+		return 1;
+	}
+	if (games <= 0)
+		games = (int)openings.size() * 2;
+
+	FILE* pgn = fopen(pgn_path, "w");
+	if (!pgn) {
+		std::cout << "Failed to open " << pgn_path << std::endl;
+		return 1;
+	}
+
+	double lower = std::log(sprt.beta / (1 - sprt.alpha));
+	double upper = std::log((1 - sprt.beta) / sprt.alpha);
+	std::cout << engines[0].name << " vs " << engines[1].name << ", " << games << " games on "
+		<< concurrency << " threads, SPRT elo0 " << sprt.elo0 << " elo1 " << sprt.elo1
+		<< " bounds [" << lower << ", " << upper << "]" << std::endl;
+
+	char date[16];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<int> next{ 0 };
+	std::atomic<bool> decided{ false };
+	std::mutex results_mutex;
+	MatchStats stats{};
+	int finished = 0;
+	std::vector<std::thread> pool;
+	for (int t = 0; t < concurrency; t++) {
+		pool.emplace_back([&]() {
+			for (int i = next++; i < games && !decided; i = next++) {
+				// Consecutive games share an opening with colors swapped
+				const std::string& opening = openings[(i / 2) % openings.size()];
+				GameRecord rec = play_game(engines, adj, opening, i + 1, i % 2 == 0, date);
+
+				std::lock_guard<std::mutex> lock(results_mutex);
+				fputs(rec.pgn.c_str(), pgn);
+				fflush(pgn);
+				int a_points = rec.a_white ? rec.white_points : 2 - rec.white_points;
+				(a_points == 2 ? stats.wins : a_points == 1 ? stats.draws : stats.losses)++;
+				finished++;
+
+				double elo, margin;
+				elo_estimate(stats, elo, margin);
+				double llr = sprt_llr(stats, sprt);
+				printf("game %4d %-7s (%s) | +%d =%d -%d | elo %+.1f +/- %.1f | llr %.2f\n",
+					rec.round, rec.white_points == 2 ? "1-0" : rec.white_points == 0 ? "0-1" : "1/2-1/2", rec.reason,
+					stats.wins, stats.draws, stats.losses, elo, margin, llr);
+				fflush(stdout);
+				if (!decided && (llr <= lower || llr >= upper)) {
+					decided = true;
+					printf("SPRT: %s\n", llr >= upper ? "H1 accepted, pass" : "H0 accepted, fail");
+				}
+			}
+		});
+	}
+	for (auto& t : pool) {
+		t.join();
+	}
+	fclose(pgn);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double elo, margin;
+	elo_estimate(stats, elo, margin);
+	double llr = sprt_llr(stats, sprt);
+	printf("%d games in %.1f s (%.2f games/s)\n", finished, seconds, seconds > 0 ? finished / seconds : 0.0);
+	printf("%s vs %s: +%d =%d -%d, elo %+.1f +/- %.1f, llr %.2f [%.2f, %.2f] %s\n",
+		engines[0].name.c_str(), engines[1].name.c_str(), stats.wins, stats.draws, stats.losses, elo, margin, llr, lower, upper,
+		llr >= upper ? "pass" : llr <= lower ? "fail" : "inconclusive");
+	return 0;
+}
@@ -0,0 +1,215 @@
+// Mate solver for puzzle batches. Proves or disproves a mate in at most N
+// moves with proof number search (src/mate.h) and prints the mating line.
+// With --epd every line of the file is a puzzle, "dm n" overrides --moves for
+// that line. Puzzles are spread over --threads threads, each with its own
+// table, and the summary reports the solve rate, nodes/s and solve times.
+//
+//   mate --fen "fen" [--moves n] [--nodes n] [--hash mb]
+//   mate --epd file.epd [--moves n] [--nodes n] [--hash mb] [--threads n]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "mate.h"
+
+struct Puzzle {
+	std::string fen, id;
+	// Mate length from the "dm" opcode, 0 uses --moves
+	int moves{};
+	// The fen passes is_valid_fen and settle_position
+	bool valid{};
+};
+
+struct Solved {
+	MateInfo info;
+	bool done{};
+};
+
+static bool load_puzzle(const Puzzle& puzzle, ChessBoard& brd) {
+	brd = ChessBoard{};
+	if (!is_valid_fen(puzzle.fen.c_str()))
+		return false;
+	init_fen(brd, puzzle.fen.c_str());
+	return settle_position(brd);
+}
+
+// "fen ops;" where the fen has four fields and ops are "opcode operand;"
+static bool parse_epd_line(const std::string& line, Puzzle& puzzle) {
+	std::istringstream in(line);
+	std::string field;
+	for (int i = 0; i < 4; i++) {
+		if (!(in >> field))
+			return false;
+		puzzle.fen += (i ? " " : "") + field;
+	}
+	std::string rest;
+	std::getline(in, rest);
+	std::istringstream ops(rest);
+	std::string op;
+	while (std::getline(ops, op, ';')) {
+		std::istringstream words(op);
+		std::string code, operand;
+		words >> code;
+		std::getline(words >> std::ws, operand);
+		if (code == "dm")
+			puzzle.moves = atoi(operand.c_str());
+		else if (code == "id")
+			puzzle.id = operand;
+	}
+	ChessBoard brd{};
+	puzzle.valid = load_puzzle(puzzle, brd);
+	return true;
+}
+
+static std::string line_to_san(const ChessBoard& start, const MateInfo& info) {
+	ChessBoard brd = start;
+	std::string text;
+	for (int i = 0; i < info.line_length; i++) {
+		char buf[16];
+		move_to_san(brd, info.line[i], buf);
+		text += (i ? " " : "") + std::string(buf);
+		make_move(brd, info.line[i]);
+	}
+	return text;
+}
+
+static void print_result(const Puzzle& puzzle, int index, const MateInfo& info) {
+	if (!puzzle.valid) {
+		printf("%4d invalid   %s\n", index + 1, puzzle.fen.c_str());
+		return;
+	}
+	ChessBoard brd{};
+	load_puzzle(puzzle, brd);
+	const char* result = info.result == MateProven ? "mate" : info.result == MateDisproven ? "no mate" : "unknown";
+	printf("%4d %-8s", index + 1, result);
+	if (info.result == MateProven)
+		printf(" in %d  %s", info.mate_in, line_to_san(brd, info).c_str());
+	printf("  | nodes %llu proof %llu%s %.3f s", (unsigned long long)info.nodes, (unsigned long long)info.proof_size,
+		info.proof_size >= MAX_PROOF_SIZE ? "+" : "", info.seconds);
+	if (!puzzle.id.empty())
+		printf("  %s", puzzle.id.c_str());
+	printf("\n");
+}
+
+int main(int argc, char** argv) {
+	const char* fen = nullptr;
+	const char* epd_path = nullptr;
+	MateLimits limits{};
+	int hash_mb = 64;
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--fen") == 0 && i + 1 < argc)
+			fen = argv[++i];
+		else if (strcmp(argv[i], "--epd") == 0 && i + 1 < argc)
+			epd_path = argv[++i];
+		else if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc)
+			limits.moves = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc)
+			limits.nodes = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+			hash_mb = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+	}
+
+	std::vector<Puzzle> puzzles;
+	if (fen) {
+		Puzzle p;
+		if (!parse_epd_line(fen, p) || !p.valid) {
+			std::cout << "Bad fen" << std::endl;
+			return 1;
+		}
+		puzzles.push_back(p);
+	}
+	else if (epd_path) {
+		std::ifstream in(epd_path);
+		if (!in) {
+			std::cout << "Failed to open " << epd_path << std::endl;
+			return 1;
+		}
+		std::string line;
+		while (std::getline(in, line)) {
+			Puzzle p;
+			if (!line.empty() && line[0] != '#' && parse_epd_line(line, p))
+				puzzles.push_back(p);
+		}
+	}
+	else {
+		std::cout << "Usage: mate --fen \"fen\" | --epd file [--moves n] [--nodes n] [--hash mb] [--threads n]" << std::endl;
+		return 1;
+	}
+	threads = std::min<int>(threads, (int)puzzles.size());
+
+	// Results are printed in file order as soon as all earlier ones are in
+	std::vector<Solved> solved(puzzles.size());
+	std::mutex print_mutex;
+	size_t printed = 0;
+	std::atomic<size_t> next{ 0 };
+	std::atomic<bool> stop{ false };
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&]() {
+			MateTable table;
+			mate_table_resize(table, hash_mb);
+			for (size_t i = next++; i < puzzles.size(); i = next++) {
+				ChessBoard brd{};
+				MateInfo info{};
+				if (load_puzzle(puzzles[i], brd)) {
+					MateLimits puzzle_limits = limits;
+					if (puzzles[i].moves > 0)
+						puzzle_limits.moves = puzzles[i].moves;
+					mate_table_clear(table);
+					info = solve_mate(brd, puzzle_limits, table, stop);
+				}
+
+				std::lock_guard<std::mutex> lock(print_mutex);
+				solved[i] = { info, true };
+				for (; printed < solved.size() && solved[printed].done; printed++)
+					print_result(puzzles[printed], (int)printed, solved[printed].info);
+				fflush(stdout);
+			}
+		});
+	}
+	for (auto& t : pool)
+		t.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int proven = 0, disproven = 0, wrong = 0, invalid = 0;
+	uint64_t nodes = 0;
+	std::vector<double> times;
+	for (size_t i = 0; i < puzzles.size(); i++) {
+		const MateInfo& info = solved[i].info;
+		if (!puzzles[i].valid) {
+			invalid++;
+			continue;
+		}
+		nodes += info.nodes;
+		if (info.result == MateProven) {
+			proven++;
+			times.push_back(info.seconds);
+		}
+		disproven += info.result == MateDisproven;
+		// A "dm" puzzle solved with a different length
+		wrong += puzzles[i].moves > 0 && (info.result != MateProven || info.mate_in != puzzles[i].moves);
+	}
+	std::sort(times.begin(), times.end());
+	auto percentile = [&](double p) { return times.empty() ? 0.0 : times[(size_t)(p * (times.size() - 1))]; };
+	printf("%d positions on %d threads in %.2f s: %d mate, %d no mate, %d unknown, %d not matching dm, %d invalid\n",
+		(int)puzzles.size(), threads, seconds, proven, disproven, (int)puzzles.size() - proven - disproven - invalid, wrong, invalid);
+	printf("%llu nodes, %.0f nodes/s\n", (unsigned long long)nodes, seconds > 0 ? nodes / seconds : 0.0);
+	if (!times.empty())
+		printf("solve time s: p50 %.4f  p90 %.4f  max %.4f\n", percentile(0.5), percentile(0.9), times.back());
+	return 0;
+}
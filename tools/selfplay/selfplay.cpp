@@ -0,0 +1,272 @@
+// Self-play training data generator. Every thread plays games from the start
+// position after a few random moves, searching each move to a fixed node
+// count or depth, and keeps (position, score, result) samples of quiet
+// positions. Samples are written as PackedSample records (training_data.h)
+// by a writer thread, game threads only hand over full blocks.
+//
+//   selfplay [--out data.bin] [--games n] [--threads n] [--nodes n] [--depth n]
+//            [--random-plies n] [--max-plies n] [--hash mb] [--seed n]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "search.h"
+#include "game.h"
+#include "training_data.h"
+
+constexpr size_t BLOCK_SAMPLES = 4096;
+
+// Full blocks queue up here and are written on a separate thread. With
+// max_pending blocks waiting the producers block, so memory stays bounded
+// when the disk can't keep up.
+struct AsyncWriter {
+	FILE* file{};
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable ready, space;
+	std::deque<std::vector<PackedSample>> pending;
+	size_t max_pending{ 16 };
+	bool done{ false };
+	bool failed{ false };
+	uint64_t written{};
+};
+
+static void writer_loop(AsyncWriter& w) {
+	for (;;) {
+		std::vector<PackedSample> block;
+		{
+			std::unique_lock<std::mutex> lock(w.mutex);
+			w.ready.wait(lock, [&]() { return w.done || !w.pending.empty(); });
+			if (w.pending.empty())
+				return;
+			block = std::move(w.pending.front());
+			w.pending.pop_front();
+		}
+		w.space.notify_one();
+		size_t n = fwrite(block.data(), sizeof(PackedSample), block.size(), w.file);
+		std::lock_guard<std::mutex> lock(w.mutex);
+		w.written += n;
+		w.failed |= n != block.size();
+	}
+}
+
+static void submit_block(AsyncWriter& w, std::vector<PackedSample>& block) {
+	if (block.empty())
+		return;
+	{
+		std::unique_lock<std::mutex> lock(w.mutex);
+		w.space.wait(lock, [&]() { return w.pending.size() < w.max_pending; });
+		w.pending.push_back(std::move(block));
+	}
+	w.ready.notify_one();
+	block.clear();
+	block.reserve(BLOCK_SAMPLES);
+}
+
+static void finish_writer(AsyncWriter& w) {
+	{
+		std::lock_guard<std::mutex> lock(w.mutex);
+		w.done = true;
+	}
+	w.ready.notify_one();
+	w.thread.join();
+	fclose(w.file);
+}
+
+struct SelfplayConfig {
+	SearchLimits limits{};
+	int random_plies{ 8 };
+	int max_plies{ 300 };
+	int hash_mb{ 8 };
+	// Adjudicate a win once every score of the last resign_plies plies is beyond resign_cp
+	int resign_cp{ 1500 }, resign_plies{ 8 };
+};
+
+struct SelfplayStats {
+	std::atomic<uint64_t> games{ 0 };
+	std::atomic<uint64_t> positions{ 0 };
+	std::atomic<uint64_t> samples{ 0 };
+};
+
+static uint64_t next_random(uint64_t& state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static bool is_tactical(const ChessBoard& brd, Move mv) {
+	if (mv.promotion != ChessBoard::None || !is_empty(brd, mv.to))
+		return true;
+	return get_type(brd, mv.from) == ChessBoard::Pawn && mv.from % 8 != mv.to % 8;
+}
+
+// Plays out random moves from the start position, false if the game ended on the way
+static bool random_opening(Game& game, int plies, uint64_t& rng) {
+	start_game(game, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+	for (int i = 0; i < plies; i++) {
+		Move moves[MAX_MOVES];
+		int count = get_all_valid_moves(game.brd, moves);
+		if (count == 0)
+			return false;
+		play_move(game, moves[next_random(rng) % count]);
+	}
+	int white_points;
+	return game_result(game, white_points) == nullptr;
+}
+
+static void play_game(const SelfplayConfig& cfg, TranspositionTable& tt, uint64_t& rng, std::vector<PackedSample>& samples, SelfplayStats& stats) {
+	Game game;
+	while (!random_opening(game, cfg.random_plies, rng)) {}
+	tt_clear(tt);
+	SearchLimits limits = cfg.limits;
+	limits.tt = tt.entries.empty() ? nullptr : &tt;
+	std::atomic<bool> stop{ false };
+
+	size_t first = samples.size();
+	int white_points = 1;
+	int decisive_plies = 0, last_sign = 0;
+	for (int ply = cfg.random_plies;; ply++) {
+		if (game_result(game, white_points))
+			break;
+		if (ply >= cfg.max_plies) {
+			white_points = 1;
+			break;
+		}
+		SearchInfo info = search(game.brd, limits, stop);
+		if (info.pv_length == 0) {
+			// The node budget ran out before depth 1 finished, the game goes on
+			// with a legal move and the position gives no sample
+			Move moves[MAX_MOVES];
+			get_all_valid_moves(game.brd, moves);
+			play_move(game, moves[0]);
+			continue;
+		}
+		Move mv = info.pv[0];
+		int white_score = game.brd.current_turn == ChessBoard::White ? info.score : -info.score;
+		stats.positions++;
+
+		// Only quiet positions, their score is what a static evaluation can learn
+		if (!game.brd.is_check && !is_tactical(game.brd, mv) && !is_mate_score(info.score)) {
+			PackedSample s;
+			pack_sample(game.brd, white_score, 1, ply, s);
+			samples.push_back(s);
+		}
+
+		int sign = white_score >= cfg.resign_cp ? 1 : white_score <= -cfg.resign_cp ? -1 : 0;
+		decisive_plies = (sign != 0 && sign == last_sign) ? decisive_plies + 1 : (sign != 0 ? 1 : 0);
+		last_sign = sign;
+		if (decisive_plies >= cfg.resign_plies) {
+			white_points = sign > 0 ? 2 : 0;
+			break;
+		}
+		play_move(game, mv);
+	}
+	for (size_t i = first; i < samples.size(); i++)
+		samples[i].result = (uint8_t)white_points;
+	stats.samples += samples.size() - first;
+	stats.games++;
+}
+
+int main(int argc, char** argv) {
+	const char* out_path = "selfplay.bin";
+	int games = 100;
+	int threads = (int)std::thread::hardware_concurrency();
+	uint64_t seed = 0x2545F4914F6CDD1Dull;
+	SelfplayConfig cfg{};
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_path = argv[++i];
+		else if (strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+			games = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc)
+			cfg.limits.nodes = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+			cfg.limits.depth = std::clamp(atoi(argv[++i]), 1, MAX_PLY - 1);
+		else if (strcmp(argv[i], "--random-plies") == 0 && i + 1 < argc)
+			cfg.random_plies = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--max-plies") == 0 && i + 1 < argc)
+			cfg.max_plies = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+			cfg.hash_mb = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], nullptr, 10) | 1;
+	}
+	threads = std::max(1, threads);
+	// Fixed node searches unless a depth was given
+	if (cfg.limits.nodes == 0 && cfg.limits.depth == MAX_PLY - 1)
+		cfg.limits.nodes = 5000;
+
+	AsyncWriter writer;
+	writer.file = fopen(out_path, "wb");
+	if (!writer.file) {
+		std::cout << "Failed to open " << out_path << std::endl;
+		return 1;
+	}
+	writer.thread = std::thread(writer_loop, std::ref(writer));
+
+	auto start = std::chrono::steady_clock::now();
+	SelfplayStats stats;
+	std::atomic<int> next{ 0 };
+	std::atomic<int> running{ threads };
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&, t]() {
+			uint64_t rng = seed + 0x9E3779B97F4A7C15ull * (t + 1);
+			TranspositionTable tt;
+			if (cfg.hash_mb > 0)
+				tt_resize(tt, cfg.hash_mb);
+			std::vector<PackedSample> block;
+			block.reserve(BLOCK_SAMPLES);
+			while (next++ < games) {
+				play_game(cfg, tt, rng, block, stats);
+				if (block.size() >= BLOCK_SAMPLES)
+					submit_block(writer, block);
+			}
+			submit_block(writer, block);
+			running--;
+		});
+	}
+
+	auto report = [&](bool final) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rate = seconds > 0 ? stats.samples / seconds : 0.0;
+		printf("%s%llu games, %llu positions, %llu samples, %.0f samples/s, %.0f samples/s per core\n",
+			final ? "done: " : "",
+			(unsigned long long)stats.games, (unsigned long long)stats.positions, (unsigned long long)stats.samples,
+			rate, rate / threads);
+		fflush(stdout);
+	};
+	auto last_report = start;
+	while (running > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (std::chrono::steady_clock::now() - last_report > std::chrono::seconds(5)) {
+			last_report = std::chrono::steady_clock::now();
+			report(false);
+		}
+	}
+	for (auto& t : pool) {
+		t.join();
+	}
+	finish_writer(writer);
+	report(true);
+	if (writer.failed) {
+		std::cout << "Writing " << out_path << " failed" << std::endl;
+		return 1;
+	}
+	printf("%llu records written to %s\n", (unsigned long long)writer.written, out_path);
+	return 0;
+}
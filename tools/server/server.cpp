@@ -0,0 +1,382 @@
+// Game server. Hosts many games in one process behind a line protocol over
+// TCP or a Unix socket. One thread waits on epoll and hands connections with
+// input to a small worker pool, which runs the commands against the session
+// store and writes the replies. Every request line gets one reply line,
+// "ok ..." or "err <reason>", in request order.
+//
+//   new [base_ms [increment_ms]] [fen <fen>]   ok <id>
+//   move <id> <move>                           ok <result> [reason]
+//   state <id>                                 ok <result> <white_ms> <black_ms> <plies> <fen>
+//   legal <id>                                 ok <move> ...
+//   history <id>                               ok <move> ...
+//   close <id>                                 ok
+//   stats                                      ok <sessions> <commands>
+//
+// Moves are in coordinate notation ("e2e4", "e7e8q"), results are "*",
+// "1-0", "0-1" or "1/2-1/2".
+//
+//   server [--port n] [--host address] [--unix path] [--workers n]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "sessions.h"
+
+#if defined(__linux__)
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+const char* start_fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+struct Connection {
+	int fd{ -1 };
+	std::string in, out;
+};
+
+struct Server {
+	SessionStore store;
+	int epoll_fd{ -1 };
+	int listen_fd{ -1 };
+	std::mutex mutex;
+	std::condition_variable wake;
+	// Connections with events, guarded by mutex. Each is armed with
+	// EPOLLONESHOT so at most one worker owns a connection at a time.
+	std::deque<Connection*> ready;
+	bool quit{ false };
+	std::atomic<uint64_t> commands{ 0 };
+	std::chrono::steady_clock::time_point start{ std::chrono::steady_clock::now() };
+};
+
+std::atomic<bool> interrupted{ false };
+
+static int64_t now_ms(const Server& server) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - server.start).count();
+}
+
+static void append_moves(std::string& reply, const Move* moves, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		char buf[6];
+		move_to_string(moves[i], buf);
+		reply += ' ';
+		reply += buf;
+	}
+}
+
+// Runs one request line and appends the reply line
+static void run_command(Server& server, char* line, std::string& reply) {
+	char* args[8]{};
+	int argc = 0;
+	// The fen of "new" is passed on in one piece
+	char* fen = strstr(line, " fen ");
+	if (fen) {
+		*fen = 0;
+		fen += 5;
+	}
+	for (char* p = line; *p && argc < 8;) {
+		while (*p == ' ')
+			p++;
+		if (!*p)
+			break;
+		args[argc++] = p;
+		while (*p && *p != ' ')
+			p++;
+		if (*p)
+			*p++ = 0;
+	}
+	server.commands++;
+	if (argc == 0) {
+		reply += "err empty command\n";
+		return;
+	}
+	const char* cmd = args[0];
+	uint64_t id = argc > 1 ? strtoull(args[1], nullptr, 10) : 0;
+	int64_t now = now_ms(server);
+	char buf[256];
+	SessionState state;
+	if (strcmp(cmd, "new") == 0) {
+		int base_ms = argc > 1 ? atoi(args[1]) : 0;
+		int increment_ms = argc > 2 ? atoi(args[2]) : 0;
+		id = create_session(server.store, fen ? fen : start_fen, std::max(0, base_ms), std::max(0, increment_ms), now);
+		if (id == 0)
+			reply += "err invalid position\n";
+		else
+			reply += "ok " + std::to_string(id) + "\n";
+	}
+	else if (strcmp(cmd, "move") == 0 && argc > 2) {
+		const char* error = session_move(server.store, id, args[2], now, state);
+		if (error)
+			snprintf(buf, sizeof(buf), "err %s\n", error);
+		else
+			snprintf(buf, sizeof(buf), "ok %s%s%s\n", status_result(state.status), *state.reason ? " " : "", state.reason);
+		reply += buf;
+	}
+	else if (strcmp(cmd, "state") == 0 && argc > 1) {
+		if (!session_state(server.store, id, now, state))
+			reply += "err unknown session\n";
+		else {
+			snprintf(buf, sizeof(buf), "ok %s %d %d %d %s\n", status_result(state.status),
+				state.clock_ms[1], state.clock_ms[0], state.plies, state.fen);
+			reply += buf;
+		}
+	}
+	else if (strcmp(cmd, "legal") == 0 && argc > 1) {
+		Move moves[MAX_MOVES];
+		int count = session_legal_moves(server.store, id, moves);
+		if (count < 0)
+			reply += "err unknown session\n";
+		else {
+			reply += "ok";
+			append_moves(reply, moves, count);
+			reply += '\n';
+		}
+	}
+	else if (strcmp(cmd, "history") == 0 && argc > 1) {
+		std::vector<Move> moves;
+		if (!session_history(server.store, id, moves))
+			reply += "err unknown session\n";
+		else {
+			reply += "ok";
+			append_moves(reply, moves.data(), moves.size());
+			reply += '\n';
+		}
+	}
+	else if (strcmp(cmd, "close") == 0 && argc > 1) {
+		reply += close_session(server.store, id) ? "ok\n" : "err unknown session\n";
+	}
+	else if (strcmp(cmd, "stats") == 0) {
+		snprintf(buf, sizeof(buf), "ok %llu %llu\n",
+			(unsigned long long)session_count(server.store), (unsigned long long)server.commands.load());
+		reply += buf;
+	}
+	else
+		reply += "err unknown command\n";
+}
+
+static void rearm(Server& server, Connection* conn) {
+	epoll_event ev{};
+	ev.events = EPOLLIN | EPOLLONESHOT | (conn->out.empty() ? 0 : EPOLLOUT);
+	ev.data.ptr = conn;
+	epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Reads what arrived, answers every complete line and writes as much of the
+// replies as the socket takes. Returns false once the connection is gone.
+static bool service(Server& server, Connection* conn) {
+	char buf[16384];
+	bool open = true;
+	for (;;) {
+		ssize_t n = read(conn->fd, buf, sizeof(buf));
+		if (n > 0)
+			conn->in.append(buf, n);
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else {
+			open = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+			break;
+		}
+	}
+	size_t begin = 0;
+	for (;;) {
+		size_t end = conn->in.find('\n', begin);
+		if (end == std::string::npos)
+			break;
+		std::string line = conn->in.substr(begin, end - begin);
+		begin = end + 1;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line == "quit") {
+			open = false;
+			break;
+		}
+		run_command(server, line.data(), conn->out);
+	}
+	conn->in.erase(0, begin);
+	// A client that never ends its lines is cut off
+	if (conn->in.size() > 65536)
+		open = false;
+
+	size_t written = 0;
+	while (written < conn->out.size()) {
+		ssize_t n = write(conn->fd, conn->out.data() + written, conn->out.size() - written);
+		if (n > 0)
+			written += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else {
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+				open = false;
+			break;
+		}
+	}
+	conn->out.erase(0, written);
+	return open;
+}
+
+static void worker_loop(Server& server) {
+	for (;;) {
+		Connection* conn = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(server.mutex);
+			server.wake.wait(lock, [&]() { return server.quit || !server.ready.empty(); });
+			if (server.ready.empty())
+				return;
+			conn = server.ready.front();
+			server.ready.pop_front();
+		}
+		if (service(server, conn))
+			rearm(server, conn);
+		else {
+			close(conn->fd);
+			delete conn;
+		}
+	}
+}
+
+static bool set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int open_listener(const char* host, int port, const char* unix_path) {
+	int fd = -1;
+	if (unix_path) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, unix_path, sizeof(addr.sun_path) - 1);
+		unlink(unix_path);
+		if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+			return -1;
+	}
+	else {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((uint16_t)port);
+		if (fd < 0 || inet_pton(AF_INET, host, &addr.sin_addr) != 1 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+			return -1;
+	}
+	if (listen(fd, 1024) != 0 || !set_nonblocking(fd))
+		return -1;
+	return fd;
+}
+
+static void accept_all(Server& server, bool tcp) {
+	for (;;) {
+		int fd = accept(server.listen_fd, nullptr, nullptr);
+		if (fd < 0)
+			return;
+		set_nonblocking(fd);
+		if (tcp) {
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		}
+		Connection* conn = new Connection{ fd };
+		epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLONESHOT;
+		ev.data.ptr = conn;
+		if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			close(fd);
+			delete conn;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	const char* host = "127.0.0.1";
+	const char* unix_path = nullptr;
+	int port = 7000;
+	int workers = 4;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+			host = argv[++i];
+		else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc)
+			unix_path = argv[++i];
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+			workers = std::max(1, atoi(argv[++i]));
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, [](int) { interrupted = true; });
+	signal(SIGTERM, [](int) { interrupted = true; });
+
+	Server server;
+	server.listen_fd = open_listener(host, port, unix_path);
+	if (server.listen_fd < 0) {
+		std::cout << "Failed to listen on " << (unix_path ? unix_path : host) << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+	server.epoll_fd = epoll_create1(0);
+	epoll_event listen_ev{};
+	listen_ev.events = EPOLLIN;
+	listen_ev.data.ptr = nullptr;
+	epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_ev);
+
+	std::vector<std::thread> pool;
+	for (int i = 0; i < workers; i++)
+		pool.emplace_back(worker_loop, std::ref(server));
+	if (unix_path)
+		printf("listening on %s with %d workers\n", unix_path, workers);
+	else
+		printf("listening on %s:%d with %d workers\n", host, port, workers);
+	fflush(stdout);
+
+	epoll_event events[256];
+	while (!interrupted) {
+		int n = epoll_wait(server.epoll_fd, events, 256, 200);
+		std::lock_guard<std::mutex> lock(server.mutex);
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == nullptr)
+				accept_all(server, unix_path == nullptr);
+			else
+				server.ready.push_back((Connection*)events[i].data.ptr);
+		}
+		if (n > 0)
+			server.wake.notify_all();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(server.mutex);
+		server.quit = true;
+	}
+	server.wake.notify_all();
+	for (auto& t : pool)
+		t.join();
+	close(server.listen_fd);
+	if (unix_path)
+		unlink(unix_path);
+	printf("%llu commands, %llu sessions open at exit\n",
+		(unsigned long long)server.commands.load(), (unsigned long long)session_count(server.store));
+	return 0;
+}
+
+#else
+
+int main(int argc, char** argv) {
+	std::cout << "The game server needs epoll and only runs on Linux" << std::endl;
+	return 1;
+}
+
+#endif
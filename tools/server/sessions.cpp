@@ -0,0 +1,224 @@
+#include "sessions.h"
+#include "game.h"
+#include "explorer.h"
+#include <cstring>
+
+static const char* reasons[]{ "", "checkmate", "stalemate", "fifty move rule", "insufficient material", "time forfeit" };
+
+struct SessionRef {
+	SessionShard* shard{};
+	Session* session{};
+};
+
+// Finds a live session and locks its shard, session is nullptr for unknown ids
+static SessionRef find_session(SessionStore& store, uint64_t id, std::unique_lock<std::mutex>& lock) {
+	SessionShard& shard = store.shards[id % SESSION_SHARDS];
+	uint32_t slot = (uint32_t)(id >> 6) & ((1u << 26) - 1);
+	lock = std::unique_lock<std::mutex>(shard.mutex);
+	if (!shard.sessions.contains(slot))
+		return { &shard, nullptr };
+	Session& s = shard.sessions[slot];
+	if (s.status == SessionFree || s.generation != (uint32_t)(id >> 32))
+		return { &shard, nullptr };
+	return { &shard, &s };
+}
+
+static void end_game(Session& s, SessionStatus status, const char* reason) {
+	s.status = status;
+	s.reason = 0;
+	for (uint8_t i = 0; i < sizeof(reasons) / sizeof(reasons[0]); i++) {
+		if (strcmp(reasons[i], reason) == 0)
+			s.reason = i;
+	}
+}
+
+// Flag fall of the side to move
+static void update_clock(Session& s, int64_t now_ms) {
+	if (s.base_ms == 0 || s.status != SessionPlaying)
+		return;
+	int white = s.position.flags & 1;
+	if (s.clock_ms[white] - (now_ms - s.turn_started_ms) <= 0) {
+		s.clock_ms[white] = 0;
+		end_game(s, white ? SessionBlackWon : SessionWhiteWon, "time forfeit");
+	}
+}
+
+static void fill_state(const Session& s, int64_t now_ms, SessionState& state) {
+	ChessBoard brd;
+	unpack_sample(s.position, brd);
+	board_to_fen(brd, state.fen);
+	state.clock_ms[0] = s.clock_ms[0];
+	state.clock_ms[1] = s.clock_ms[1];
+	// The running clock is shown as of now
+	if (s.base_ms != 0 && s.status == SessionPlaying)
+		state.clock_ms[s.position.flags & 1] -= (int32_t)(now_ms - s.turn_started_ms);
+	state.plies = s.plies;
+	state.status = s.status;
+	state.reason = reasons[s.reason];
+}
+
+static void append_history(SessionShard& shard, Session& s, Move mv) {
+	int slot = s.plies % 30;
+	if (slot == 0) {
+		uint32_t chunk = shard.history.allocate();
+		shard.history[chunk] = HistoryChunk{};
+		if (s.history_tail == NO_CHUNK)
+			s.history_head = chunk;
+		else
+			shard.history[s.history_tail].next = chunk;
+		s.history_tail = chunk;
+	}
+	shard.history[s.history_tail].moves[slot] = pack_explorer_move(mv);
+}
+
+uint64_t create_session(SessionStore& store, const char* fen, int base_ms, int increment_ms, int64_t now_ms) {
+	if (!is_valid_fen(fen))
+		return 0;
+	ChessBoard brd{};
+	init_fen(brd, fen);
+	if (!settle_position(brd))
+		return 0;
+
+	uint32_t shard_index = store.next_shard++ % SESSION_SHARDS;
+	SessionShard& shard = store.shards[shard_index];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	uint32_t slot = shard.sessions.allocate();
+	if (slot >= (1u << 26)) {
+		shard.sessions.release(slot);
+		return 0;
+	}
+	Session& s = shard.sessions[slot];
+	uint32_t generation = s.generation + 1;
+	s = Session{};
+	s.generation = generation;
+	pack_sample(brd, 0, 1, 0, s.position);
+	s.base_ms = base_ms;
+	s.increment_ms = increment_ms;
+	s.clock_ms[0] = s.clock_ms[1] = base_ms;
+	s.turn_started_ms = now_ms;
+	s.status = SessionPlaying;
+	shard.live++;
+	return (uint64_t)generation << 32 | (uint64_t)slot << 6 | shard_index;
+}
+
+bool close_session(SessionStore& store, uint64_t id) {
+	std::unique_lock<std::mutex> lock;
+	SessionRef ref = find_session(store, id, lock);
+	if (!ref.session)
+		return false;
+	for (uint32_t chunk = ref.session->history_head; chunk != NO_CHUNK;) {
+		uint32_t next = ref.shard->history[chunk].next;
+		ref.shard->history.release(chunk);
+		chunk = next;
+	}
+	ref.session->status = SessionFree;
+	ref.shard->sessions.release((uint32_t)(id >> 6) & ((1u << 26) - 1));
+	ref.shard->live--;
+	return true;
+}
+
+const char* session_move(SessionStore& store, uint64_t id, const char* move, int64_t now_ms, SessionState& state) {
+	std::unique_lock<std::mutex> lock;
+	SessionRef ref = find_session(store, id, lock);
+	if (!ref.session)
+		return "unknown session";
+	Session& s = *ref.session;
+	update_clock(s, now_ms);
+	if (s.status != SessionPlaying) {
+		fill_state(s, now_ms, state);
+		return "game over";
+	}
+
+	Game game;
+	unpack_sample(s.position, game.brd);
+	Move moves[MAX_MOVES];
+	int count = get_all_valid_moves(game.brd, moves);
+	Move mv{};
+	for (int i = 0; i < count; i++) {
+		char buf[6];
+		move_to_string(moves[i], buf);
+		if (strcmp(buf, move) == 0) {
+			mv = moves[i];
+			break;
+		}
+	}
+	if (mv.from == -1)
+		return "illegal move";
+
+	int white = s.position.flags & 1;
+	if (s.base_ms != 0) {
+		s.clock_ms[white] -= (int32_t)(now_ms - s.turn_started_ms);
+		s.clock_ms[white] += s.increment_ms;
+	}
+	s.turn_started_ms = now_ms;
+
+	game.halfmove_clock = s.halfmove_clock;
+	play_move(game, mv);
+	append_history(*ref.shard, s, mv);
+	s.plies++;
+	s.halfmove_clock = (uint16_t)game.halfmove_clock;
+	pack_sample(game.brd, 0, 1, s.plies, s.position);
+
+	// Only the current position is kept, so repetitions are not detected
+	int white_points;
+	if (const char* reason = game_result(game, white_points))
+		end_game(s, white_points == 2 ? SessionWhiteWon : white_points == 0 ? SessionBlackWon : SessionDrawn, reason);
+	fill_state(s, now_ms, state);
+	return nullptr;
+}
+
+bool session_state(SessionStore& store, uint64_t id, int64_t now_ms, SessionState& state) {
+	std::unique_lock<std::mutex> lock;
+	SessionRef ref = find_session(store, id, lock);
+	if (!ref.session)
+		return false;
+	update_clock(*ref.session, now_ms);
+	fill_state(*ref.session, now_ms, state);
+	return true;
+}
+
+int session_legal_moves(SessionStore& store, uint64_t id, Move* moves) {
+	std::unique_lock<std::mutex> lock;
+	SessionRef ref = find_session(store, id, lock);
+	if (!ref.session)
+		return -1;
+	if (ref.session->status != SessionPlaying)
+		return 0;
+	ChessBoard brd;
+	unpack_sample(ref.session->position, brd);
+	lock.unlock();
+	return get_all_valid_moves(brd, moves);
+}
+
+bool session_history(SessionStore& store, uint64_t id, std::vector<Move>& moves) {
+	std::unique_lock<std::mutex> lock;
+	SessionRef ref = find_session(store, id, lock);
+	if (!ref.session)
+		return false;
+	moves.clear();
+	uint32_t chunk = ref.session->history_head;
+	for (int i = 0; i < ref.session->plies; i++) {
+		if (i > 0 && i % 30 == 0)
+			chunk = ref.shard->history[chunk].next;
+		moves.push_back(unpack_explorer_move(ref.shard->history[chunk].moves[i % 30]));
+	}
+	return true;
+}
+
+uint64_t session_count(SessionStore& store) {
+	uint64_t count = 0;
+	for (auto& shard : store.shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		count += shard.live;
+	}
+	return count;
+}
+
+const char* status_result(SessionStatus status) {
+	switch (status) {
+	case SessionWhiteWon: return "1-0";
+	case SessionDrawn: return "1/2-1/2";
+	case SessionBlackWon: return "0-1";
+	default: return "*";
+	}
+}
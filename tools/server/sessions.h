@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "chess.h"
+#include "training_data.h"
+
+// Fixed size objects in slabs of SLAB_SIZE. Objects never move, freed slots
+// are reused before the pool grows.
+template <typename T>
+struct SlabPool {
+	constexpr static uint32_t SLAB_SIZE = 1024;
+	std::vector<std::unique_ptr<T[]>> slabs;
+	std::vector<uint32_t> free_list;
+	uint32_t used{};
+
+	uint32_t allocate() {
+		if (!free_list.empty()) {
+			uint32_t index = free_list.back();
+			free_list.pop_back();
+			return index;
+		}
+		if (used == slabs.size() * SLAB_SIZE)
+			slabs.emplace_back(new T[SLAB_SIZE]{});
+		return used++;
+	}
+	void release(uint32_t index) { free_list.push_back(index); }
+	T& operator[](uint32_t index) { return slabs[index / SLAB_SIZE][index % SLAB_SIZE]; }
+	bool contains(uint32_t index) const { return index < used; }
+};
+
+enum SessionStatus : uint8_t {
+	SessionFree,
+	SessionPlaying,
+	SessionWhiteWon,
+	SessionDrawn,
+	SessionBlackWon,
+};
+
+constexpr uint32_t NO_CHUNK = ~0u;
+
+// Moves of a session in chunks from the history pool, packed like the explorer
+// index: from | to << 6 | promotion << 12
+struct HistoryChunk {
+	uint32_t next{ NO_CHUNK };
+	uint16_t moves[30]{};
+};
+
+// One live game
+struct Session {
+	PackedSample position{};
+	// Milliseconds left, [0] black and [1] white. Untimed games have base_ms 0.
+	int32_t clock_ms[2]{};
+	int32_t base_ms{}, increment_ms{};
+	// When the side to move started thinking
+	int64_t turn_started_ms{};
+	uint32_t history_head{ NO_CHUNK }, history_tail{ NO_CHUNK };
+	// Bumped whenever the slot is reused so stale ids are refused
+	uint32_t generation{};
+	uint16_t plies{};
+	uint16_t halfmove_clock{};
+	SessionStatus status{ SessionFree };
+	// Why the game ended, an index into the reasons in sessions.cpp
+	uint8_t reason{};
+};
+static_assert(sizeof(Session) == 80, "sessions are 80 bytes");
+
+// Sessions are spread over shards by id, each with its own lock and pools,
+// so worker threads rarely wait on each other.
+constexpr uint32_t SESSION_SHARDS = 64;
+
+struct SessionShard {
+	std::mutex mutex;
+	SlabPool<Session> sessions;
+	SlabPool<HistoryChunk> history;
+	uint32_t live{};
+};
+
+struct SessionStore {
+	SessionShard shards[SESSION_SHARDS];
+	std::atomic<uint32_t> next_shard{ 0 };
+};
+
+// Snapshot of a session for replies
+struct SessionState {
+	char fen[MAX_FEN]{};
+	int32_t clock_ms[2]{};
+	uint16_t plies{};
+	SessionStatus status{};
+	const char* reason{};
+};
+
+// Ids are generation << 32 | slot << 6 | shard. Returns 0 for an invalid fen.
+uint64_t create_session(SessionStore& store, const char* fen, int base_ms, int increment_ms, int64_t now_ms);
+bool close_session(SessionStore& store, uint64_t id);
+// Plays a move in coordinate notation ("e2e4", "e7e8q"). Returns nullptr when
+// it was played, else why it was refused.
+const char* session_move(SessionStore& store, uint64_t id, const char* move, int64_t now_ms, SessionState& state);
+bool session_state(SessionStore& store, uint64_t id, int64_t now_ms, SessionState& state);
+// Legal moves for the side to move, none once the game is over. -1 for an unknown id.
+int session_legal_moves(SessionStore& store, uint64_t id, Move* moves);
+bool session_history(SessionStore& store, uint64_t id, std::vector<Move>& moves);
+uint64_t session_count(SessionStore& store);
+// "1-0", "0-1", "1/2-1/2" or "*"
+const char* status_result(SessionStatus status);
@@ -0,0 +1,378 @@
+// Texel tuner for the evaluation in src/eval_params.h. Loads labelled
+// positions into a sparse feature matrix, fits the sigmoid scale K once and
+// then minimizes the mean squared error between the game result and the
+// sigmoid of the evaluation with Adam over mini-batches. Every batch is split
+// across threads with a private gradient each, the gradients are summed
+// with SSE2 before the Adam step. Writes a new eval_params.h.
+//
+// Input files ending in .bin are PackedSample records from selfplay, other
+// files are EPD/FEN lines with the result as "1-0", "0-1", "1/2-1/2" or
+// [1.0], [0.5], [0.0] somewhere after the position.
+//
+//   tune <files...> [--out eval_params.h] [--epochs n] [--batch n] [--lr x]
+//        [--lambda x] [--threads n]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <barrier>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TUNE_SSE2 1
+#endif
+
+#include "chess.h"
+#include "eval_params.h"
+#include "training_data.h"
+
+// Square table entries first (type * 64 + square), then the piece values
+constexpr int VALUE_BASE = 7 * 64;
+constexpr int PARAM_COUNT = VALUE_BASE + 7;
+// Set on features of black pieces, which count negatively
+constexpr uint16_t BLACK_FEATURE = 0x8000;
+
+// Positions in compressed sparse row layout. The evaluation is linear, so a
+// position is just its pieces: one square table index per piece, and the
+// piece value is found from the index.
+struct Dataset {
+	std::vector<uint32_t> offsets{ 0 };
+	std::vector<uint16_t> features;
+	// Expected score for white, 0 to 1
+	std::vector<float> targets;
+};
+
+static void add_position(Dataset& data, const ChessBoard& brd, float target) {
+	for (int i = 0; i < 64; i++) {
+		int type = get_type(brd, i);
+		if (type == ChessBoard::None)
+			continue;
+		// Same mirroring as evaluate()
+		if (get_color(brd, i) == ChessBoard::White)
+			data.features.push_back((uint16_t)(type * 64 + i));
+		else
+			data.features.push_back((uint16_t)(type * 64 + (i ^ 56)) | BLACK_FEATURE);
+	}
+	data.offsets.push_back((uint32_t)data.features.size());
+	data.targets.push_back(target);
+}
+
+static double sigmoid(double eval, double k) {
+	return 1.0 / (1.0 + std::pow(10.0, -k * eval / 400.0));
+}
+
+static bool load_samples(Dataset& data, const char* path, double lambda, double k) {
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return false;
+	PackedSample s;
+	ChessBoard brd{};
+	size_t skipped = 0;
+	while (fread(&s, sizeof(s), 1, f) == 1) {
+		if (!is_valid_sample(s)) {
+			skipped++;
+			continue;
+		}
+		unpack_sample(s, brd);
+		// Blend the game result with the search score
+		float target = (float)(lambda * s.result / 2.0 + (1.0 - lambda) * sigmoid(s.score, k));
+		add_position(data, brd, target);
+	}
+	fclose(f);
+	if (skipped)
+		printf("%s: skipped %zu invalid records\n", path, skipped);
+	return true;
+}
+
+static bool load_epd(Dataset& data, const char* path) {
+	std::ifstream in(path);
+	if (!in)
+		return false;
+	std::string line;
+	size_t skipped = 0;
+	while (std::getline(in, line)) {
+		float target;
+		if (line.find("1/2-1/2") != std::string::npos || line.find("[0.5]") != std::string::npos)
+			target = 0.5f;
+		else if (line.find("1-0") != std::string::npos || line.find("[1.0]") != std::string::npos)
+			target = 1.0f;
+		else if (line.find("0-1") != std::string::npos || line.find("[0.0]") != std::string::npos)
+			target = 0.0f;
+		else
+			continue;
+		if (!is_valid_fen(line.c_str())) {
+			skipped++;
+			continue;
+		}
+		ChessBoard brd{};
+		init_fen(brd, line.c_str());
+		if (!settle_position(brd)) {
+			skipped++;
+			continue;
+		}
+		add_position(data, brd, target);
+	}
+	if (skipped)
+		printf("%s: skipped %zu lines with an invalid position\n", path, skipped);
+	return true;
+}
+
+// White's point of view
+static double evaluate_features(const Dataset& data, size_t i, const double* params) {
+	double eval = 0;
+	for (uint32_t f = data.offsets[i]; f < data.offsets[i + 1]; f++) {
+		uint16_t feature = data.features[f];
+		int index = feature & ~BLACK_FEATURE;
+		double v = params[index] + params[VALUE_BASE + index / 64];
+		eval += (feature & BLACK_FEATURE) ? -v : v;
+	}
+	return eval;
+}
+
+static double mean_loss(const Dataset& data, const double* params, double k, int threads) {
+	size_t n = data.targets.size();
+	std::vector<double> partial(threads);
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&, t]() {
+			double sum = 0;
+			for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+				double e = data.targets[i] - sigmoid(evaluate_features(data, i, params), k);
+				sum += e * e;
+			}
+			partial[t] = sum;
+		});
+	}
+	for (auto& t : pool) {
+		t.join();
+	}
+	double sum = 0;
+	for (double p : partial)
+		sum += p;
+	return sum / std::max<size_t>(1, n);
+}
+
+// Sums every thread's gradient into the first one and clears the others
+static void reduce_gradients(std::vector<std::vector<double>>& grads) {
+	double* dst = grads[0].data();
+	for (size_t t = 1; t < grads.size(); t++) {
+		double* src = grads[t].data();
+		int i = 0;
+#if TUNE_SSE2
+		for (; i + 2 <= PARAM_COUNT; i += 2) {
+			_mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(dst + i), _mm_loadu_pd(src + i)));
+			_mm_storeu_pd(src + i, _mm_setzero_pd());
+		}
+#endif
+		for (; i < PARAM_COUNT; i++) {
+			dst[i] += src[i];
+			src[i] = 0;
+		}
+	}
+}
+
+static void write_params(const char* path, const double* params, size_t positions, double loss) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		std::cout << "Failed to write " << path << std::endl;
+		return;
+	}
+	const char* names[7]{ "None", "King", "Queen", "Bishop", "Knight", "Rook", "Pawn" };
+	fprintf(f, "#pragma once\n\n");
+	fprintf(f, "// Evaluation parameters in centipawns, indexed by ChessBoard::PieceType.\n");
+	fprintf(f, "// Square tables are from white's point of view with a8 first.\n");
+	fprintf(f, "// Generated by tools/tune from %zu positions, loss %.6f.\n", positions, loss);
+	fprintf(f, "constexpr int piece_value[7]{ ");
+	for (int t = 0; t < 7; t++)
+		fprintf(f, "%d%s", (int)std::lround(params[VALUE_BASE + t]), t < 6 ? ", " : " };\n\n");
+	fprintf(f, "constexpr int piece_square[7][64]{\n\t// None\n\t{},\n");
+	for (int t = 1; t < 7; t++) {
+		fprintf(f, "\t// %s\n\t{\n", names[t]);
+		for (int y = 0; y < 8; y++) {
+			fprintf(f, "\t\t");
+			for (int x = 0; x < 8; x++)
+				fprintf(f, "%3d,%s", (int)std::lround(params[t * 64 + y * 8 + x]), x < 7 ? "" : "\n");
+		}
+		fprintf(f, "\t},\n");
+	}
+	fprintf(f, "};\n");
+	fclose(f);
+}
+
+int main(int argc, char** argv) {
+	std::vector<const char*> inputs;
+	const char* out_path = "eval_params.h";
+	int epochs = 50;
+	size_t batch = 16384;
+	double lr = 1.0;
+	double lambda = 1.0;
+	int threads = (int)std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_path = argv[++i];
+		else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc)
+			epochs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+			batch = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--lr") == 0 && i + 1 < argc)
+			lr = atof(argv[++i]);
+		else if (strcmp(argv[i], "--lambda") == 0 && i + 1 < argc)
+			lambda = std::clamp(atof(argv[++i]), 0.0, 1.0);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else
+			inputs.push_back(argv[i]);
+	}
+	threads = std::max(1, threads);
+	if (inputs.empty()) {
+		std::cout << "usage: tune <files...> [--out eval_params.h] [--epochs n] [--batch n] [--lr x] [--lambda x] [--threads n]" << std::endl;
+		return 1;
+	}
+
+	// Start from the compiled in parameters
+	std::vector<double> params(PARAM_COUNT);
+	for (int t = 0; t < 7; t++) {
+		params[VALUE_BASE + t] = piece_value[t];
+		for (int sq = 0; sq < 64; sq++)
+			params[t * 64 + sq] = piece_square[t][sq];
+	}
+	// The king value never changes the evaluation and the pawn value anchors the scale
+	std::vector<bool> frozen(PARAM_COUNT, false);
+	frozen[VALUE_BASE + ChessBoard::None] = true;
+	frozen[VALUE_BASE + ChessBoard::King] = true;
+	frozen[VALUE_BASE + ChessBoard::Pawn] = true;
+
+	auto load_start = std::chrono::steady_clock::now();
+	Dataset data;
+	// Search scores are blended in with the usual K before K is fitted to the data
+	for (const char* path : inputs) {
+		size_t len = strlen(path);
+		bool ok = (len > 4 && strcmp(path + len - 4, ".bin") == 0) ? load_samples(data, path, lambda, 1.0) : load_epd(data, path);
+		if (!ok) {
+			std::cout << "Failed to read " << path << std::endl;
+			return 1;
+		}
+	}
+	size_t n = data.targets.size();
+	if (n == 0) {
+		std::cout << "No positions" << std::endl;
+		return 1;
+	}
+	double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+	printf("%zu positions, %zu features (%.1f MB) loaded in %.2f s\n", n, data.features.size(),
+		(data.features.size() * sizeof(uint16_t) + n * (sizeof(uint32_t) + sizeof(float))) / 1048576.0, load_seconds);
+
+	// K maps centipawns to an expected score, fitted to the starting parameters by ternary search
+	double lo = 0.1, hi = 3.0;
+	for (int i = 0; i < 30; i++) {
+		double m1 = lo + (hi - lo) / 3, m2 = hi - (hi - lo) / 3;
+		if (mean_loss(data, params.data(), m1, threads) < mean_loss(data, params.data(), m2, threads))
+			hi = m2;
+		else
+			lo = m1;
+	}
+	double k = (lo + hi) / 2;
+	double start_loss = mean_loss(data, params.data(), k, threads);
+	printf("K %.4f, starting loss %.6f\n", k, start_loss);
+
+	// Adam state
+	const double beta1 = 0.9, beta2 = 0.999, eps = 1e-8;
+	std::vector<double> m(PARAM_COUNT), v(PARAM_COUNT);
+	int step = 0;
+
+	std::vector<uint32_t> order(n);
+	for (size_t i = 0; i < n; i++)
+		order[i] = (uint32_t)i;
+	std::mt19937_64 rng(12345);
+	std::shuffle(order.begin(), order.end(), rng);
+
+	std::vector<std::vector<double>> grads(threads, std::vector<double>(PARAM_COUNT));
+	std::vector<double> losses(threads);
+	size_t batch_start = 0;
+	int epoch = 0;
+	double epoch_loss = 0;
+	bool done = epochs <= 0;
+	auto epoch_start = std::chrono::steady_clock::now();
+
+	// Runs on one thread after every thread finished its part of the batch
+	auto apply_step = [&]() noexcept {
+		size_t batch_end = std::min(n, batch_start + batch);
+		size_t count = batch_end - batch_start;
+		reduce_gradients(grads);
+		step++;
+		double c1 = 1 - std::pow(beta1, step), c2 = 1 - std::pow(beta2, step);
+		for (int p = 0; p < PARAM_COUNT; p++) {
+			double g = grads[0][p] / count;
+			grads[0][p] = 0;
+			if (frozen[p])
+				continue;
+			m[p] = beta1 * m[p] + (1 - beta1) * g;
+			v[p] = beta2 * v[p] + (1 - beta2) * g * g;
+			params[p] -= lr * (m[p] / c1) / (std::sqrt(v[p] / c2) + eps);
+		}
+		for (double& l : losses) {
+			epoch_loss += l;
+			l = 0;
+		}
+
+		batch_start = batch_end;
+		if (batch_start == n) {
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch_start).count();
+			epoch++;
+			printf("epoch %3d  loss %.6f  %.3f s  %.0f positions/s\n", epoch, epoch_loss / n, seconds, n / seconds);
+			fflush(stdout);
+			epoch_loss = 0;
+			batch_start = 0;
+			std::shuffle(order.begin(), order.end(), rng);
+			done = epoch >= epochs;
+			epoch_start = std::chrono::steady_clock::now();
+		}
+	};
+	std::barrier sync(threads, apply_step);
+
+	const double dsig = k * std::log(10.0) / 400.0;
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&, t]() {
+			while (!done) {
+				size_t begin = batch_start, end = std::min(n, batch_start + batch);
+				double* grad = grads[t].data();
+				double loss = 0;
+				for (size_t j = begin + (end - begin) * t / threads; j < begin + (end - begin) * (t + 1) / threads; j++) {
+					size_t i = order[j];
+					double s = sigmoid(evaluate_features(data, i, params.data()), k);
+					double e = data.targets[i] - s;
+					loss += e * e;
+					// d(e^2)/d(eval)
+					double g = -2 * e * s * (1 - s) * dsig;
+					for (uint32_t f = data.offsets[i]; f < data.offsets[i + 1]; f++) {
+						uint16_t feature = data.features[f];
+						int index = feature & ~BLACK_FEATURE;
+						double signed_g = (feature & BLACK_FEATURE) ? -g : g;
+						grad[index] += signed_g;
+						grad[VALUE_BASE + index / 64] += signed_g;
+					}
+				}
+				losses[t] = loss;
+				sync.arrive_and_wait();
+			}
+		});
+	}
+	for (auto& t : pool) {
+		t.join();
+	}
+
+	double final_loss = mean_loss(data, params.data(), k, threads);
+	printf("final loss %.6f (start %.6f)\n", final_loss, start_loss);
+	write_params(out_path, params.data(), n, final_loss);
+	printf("written to %s\n", out_path);
+	return 0;
+}
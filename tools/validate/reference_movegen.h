@@ -0,0 +1,32 @@
+#pragma once
+#include "chess.h"
+
+// The mailbox move generator as it was before any optimization, used by
+// validate to check the generator in src/chess.cpp move by move.
+
+ChessBoard::Color ref_get_color(const ChessBoard& brd, Position p);
+ChessBoard::PieceType ref_get_type(const ChessBoard& brd, Position p);
+int ref_get_piece(const ChessBoard& brd, Position p);
+
+bool ref_is_empty(const ChessBoard& brd, Position p);
+bool ref_is_enemy(const ChessBoard& brd, Position self, Position p);
+bool ref_is_enemy_or_empty(const ChessBoard& brd, int self, int p);
+bool ref_is_own(const ChessBoard& brd, int self, int p);
+
+bool ref_resolves_check(const ChessBoard& brd, Position pos, Position target);
+bool ref_causes_check_on_self(const ChessBoard& brd, Position pos, Position target);
+
+void ref_get_pawn_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_knight_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_bishop_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_queen_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_rook_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_king_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+void ref_get_valid_moves(const ChessBoard& brd, int* move_list, int& move_count, Position p);
+
+bool ref_is_in_check(const ChessBoard& brd, ChessBoard::Color c);
+void ref_do_move(ChessBoard& brd, Position from_pos, Position to_pos);
+
+int ref_get_all_valid_moves(const ChessBoard& brd, Move* moves);
+void ref_make_move(ChessBoard& brd, Move mv);
@@ -0,0 +1,300 @@
+// Differential checker between the move generator in src/chess.cpp and the
+// reference mailbox generator in reference_movegen.cpp. Every visited node
+// compares the legal move sets, the check state and the position after each
+// move. The first divergence is printed as FEN + move and the tool fails.
+// Positions seen in the playouts also go through every batch path in batch.h.
+//
+//   validate [--perft depth] [--playouts n] [--plies n] [--seed n] [--fens file] [--out file]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include "chess.h"
+#include "tables.h"
+#include "batch.h"
+#include "reference_movegen.h"
+
+const char* default_positions[]{
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	// En passant and castling corner cases
+	"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+	"rnbqkbnr/pppp1ppp/8/8/3Pp3/8/PPP1PPPP/RNBQKBNR b KQkq d3 0 3",
+	"8/8/8/K2pP2r/8/8/8/7k w - d6 0 1",
+	"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1",
+	"r3k2r/8/8/8/4r3/8/8/R3K2R w KQkq - 0 1",
+	"4k3/1P6/8/8/8/8/6p1/4K3 w - - 0 1",
+};
+
+struct Divergence {
+	bool found{ false };
+	char fen[MAX_FEN]{};
+	char move[8]{};
+	std::string what;
+};
+
+struct Stats {
+	uint64_t nodes{};
+	uint64_t moves{};
+};
+
+static bool move_less(Move a, Move b) {
+	if (a.from != b.from) return a.from < b.from;
+	if (a.to != b.to) return a.to < b.to;
+	return a.promotion < b.promotion;
+}
+
+// Everything make_move is allowed to change
+static bool same_result(const ChessBoard& a, const ChessBoard& b) {
+	return same_position(a, b) &&
+		a.white_king_position == b.white_king_position &&
+		a.black_king_position == b.black_king_position &&
+		a.is_check == b.is_check;
+}
+
+static void report(Divergence& d, const ChessBoard& brd, const Move* mv, const std::string& what) {
+	d.found = true;
+	board_to_fen(brd, d.fen);
+	if (mv)
+		move_to_string(*mv, d.move);
+	d.what = what;
+}
+
+// Compares both generators on brd and on every child. Returns false on divergence.
+static bool check_node(const ChessBoard& brd, Divergence& d, Stats& stats, std::vector<ChessBoard>* children) {
+	stats.nodes++;
+	Move moves[MAX_MOVES], ref_moves[MAX_MOVES];
+	int count = get_all_valid_moves(brd, moves);
+	int ref_count = ref_get_all_valid_moves(brd, ref_moves);
+
+	for (ChessBoard::Color c : { ChessBoard::White, ChessBoard::Black }) {
+		if (is_in_check(brd, c) != ref_is_in_check(brd, c)) {
+			report(d, brd, nullptr, c == ChessBoard::White ? "is_in_check(white) differs" : "is_in_check(black) differs");
+			return false;
+		}
+	}
+
+	std::sort(moves, moves + count, move_less);
+	std::sort(ref_moves, ref_moves + ref_count, move_less);
+	for (int i = 0, j = 0; i < count || j < ref_count;) {
+		if (j == ref_count || (i < count && move_less(moves[i], ref_moves[j]))) {
+			report(d, brd, &moves[i], "move generated only by the optimized generator");
+			return false;
+		}
+		if (i == count || move_less(ref_moves[j], moves[i])) {
+			report(d, brd, &ref_moves[j], "move generated only by the reference generator");
+			return false;
+		}
+		i++;
+		j++;
+	}
+
+	for (int i = 0; i < count; i++) {
+		ChessBoard child = brd;
+		ChessBoard ref_child = brd;
+		make_move(child, moves[i]);
+		ref_make_move(ref_child, moves[i]);
+		if (!same_result(child, ref_child)) {
+			report(d, brd, &moves[i], "position after the move differs");
+			return false;
+		}
+		stats.moves++;
+		if (children)
+			children->push_back(child);
+	}
+	return true;
+}
+
+static bool perft(const ChessBoard& brd, int depth, Divergence& d, Stats& stats, uint64_t& leaves) {
+	if (depth == 0) {
+		leaves++;
+		return true;
+	}
+	std::vector<ChessBoard> children;
+	if (!check_node(brd, d, stats, &children))
+		return false;
+	for (const ChessBoard& child : children) {
+		if (!perft(child, depth - 1, d, stats, leaves))
+			return false;
+	}
+	return true;
+}
+
+static uint64_t next_random(uint64_t& state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static bool playout(const ChessBoard& start, int max_plies, uint64_t& rng, Divergence& d, Stats& stats, std::vector<ChessBoard>& visited) {
+	ChessBoard brd = start;
+	brd.is_check = is_in_check(brd, brd.current_turn);
+	std::vector<ChessBoard> children;
+	for (int ply = 0; ply < max_plies; ply++) {
+		visited.push_back(brd);
+		children.clear();
+		if (!check_node(brd, d, stats, &children))
+			return false;
+		if (children.empty())
+			break;
+		brd = children[next_random(rng) % children.size()];
+	}
+	return true;
+}
+
+// Attacked squares of one side, square by square from the lookup tables
+static uint64_t attacked_squares(const ChessBoard& brd, ChessBoard::Color c) {
+	uint64_t attacks = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		if (is_empty(brd, sq) || get_color(brd, sq) != c)
+			continue;
+		switch (get_type(brd, sq)) {
+		case ChessBoard::Pawn: attacks |= pawn_attacks[c == ChessBoard::White][sq]; break;
+		case ChessBoard::Knight: attacks |= knight_attacks[sq]; break;
+		case ChessBoard::King: attacks |= king_attacks[sq]; break;
+		default: {
+			int type = get_type(brd, sq);
+			int first = type == ChessBoard::Rook ? DirLeft : DirLeftUp;
+			int end = type == ChessBoard::Bishop ? DirLeft : DirDown + 1;
+			for (int d = first; d < end; d++) {
+				int to = sq;
+				for (int dist = edge_distance[sq][d]; dist > 0; dist--) {
+					to += direction_offset[d];
+					attacks |= 1ull << to;
+					if (!is_empty(brd, to))
+						break;
+				}
+			}
+		}
+		}
+	}
+	return attacks;
+}
+
+// Every batch path against attack maps built square by square, against
+// is_in_check and against the move count of the reference generator
+static bool check_batch(const std::vector<ChessBoard>& boards, Divergence& d) {
+	PositionBatch batch;
+	load_batch(batch, boards.data(), boards.size());
+	BatchResult result;
+	for (BatchPath path : { BatchScalar, BatchAVX2, BatchAVX512 }) {
+		if (!batch_path_supported(path))
+			continue;
+		compute_attacks(batch, result, path);
+		for (size_t i = 0; i < boards.size(); i++) {
+			const ChessBoard& brd = boards[i];
+			std::string where = std::string(" (") + batch_path_name(path) + " batch)";
+			for (ChessBoard::Color c : { ChessBoard::White, ChessBoard::Black }) {
+				int white = c == ChessBoard::White;
+				if (result.attacks[white][i] != attacked_squares(brd, c)) {
+					report(d, brd, nullptr, "attack map differs" + where);
+					return false;
+				}
+				int king = white ? brd.white_king_position : brd.black_king_position;
+				bool has_king = get_piece(brd, king) == (ChessBoard::King | c);
+				if (has_king && result.in_check[white][i] != is_in_check(brd, c)) {
+					report(d, brd, nullptr, "check status differs" + where);
+					return false;
+				}
+			}
+		}
+		count_legal_moves(batch, boards.data(), result, path);
+		for (size_t i = 0; i < boards.size(); i++) {
+			Move moves[MAX_MOVES];
+			if (result.legal_moves[i] != ref_get_all_valid_moves(boards[i], moves)) {
+				report(d, boards[i], nullptr, std::string("legal move count differs (") + batch_path_name(path) + " batch)");
+				return false;
+			}
+		}
+		printf("batch %-7s %zu positions agree\n", batch_path_name(path), boards.size());
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	int perft_depth = 3;
+	int playouts = 200;
+	int max_plies = 200;
+	uint64_t seed = 0x9E3779B97F4A7C15ull;
+	const char* fens_path = nullptr;
+	const char* out_path = "divergence.txt";
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--perft") == 0 && i + 1 < argc)
+			perft_depth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--playouts") == 0 && i + 1 < argc)
+			playouts = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--plies") == 0 && i + 1 < argc)
+			max_plies = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], nullptr, 10) | 1;
+		else if (strcmp(argv[i], "--fens") == 0 && i + 1 < argc)
+			fens_path = argv[++i];
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_path = argv[++i];
+	}
+
+	std::vector<std::string> fens;
+	if (fens_path) {
+		std::ifstream in(fens_path);
+		std::string line;
+		while (std::getline(in, line)) {
+			if (!line.empty() && line[0] != '#')
+				fens.push_back(line);
+		}
+	}
+	else {
+		fens.assign(std::begin(default_positions), std::end(default_positions));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Divergence d{};
+	Stats stats{};
+	uint64_t rng = seed;
+	// Playout positions, checked against the batch paths at the end
+	std::vector<ChessBoard> visited;
+	for (const std::string& fen : fens) {
+		ChessBoard brd{};
+		init_fen(brd, fen.c_str());
+		brd.is_check = is_in_check(brd, brd.current_turn);
+
+		uint64_t leaves = 0;
+		if (perft_depth > 0 && !perft(brd, perft_depth, d, stats, leaves))
+			break;
+		if (perft_depth > 0)
+			printf("perft %d %12llu  %s\n", perft_depth, (unsigned long long)leaves, fen.c_str());
+
+		bool ok = true;
+		for (int p = 0; p < playouts && ok; p++)
+			ok = playout(brd, max_plies, rng, d, stats, visited);
+		if (!ok)
+			break;
+	}
+	if (!d.found)
+		check_batch(visited, d);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%llu nodes, %llu moves compared in %.2f s\n", (unsigned long long)stats.nodes, (unsigned long long)stats.moves, seconds);
+	if (d.found) {
+		printf("DIVERGENCE: %s\nfen: %s\nmove: %s\n", d.what.c_str(), d.fen, d.move[0] ? d.move : "-");
+		FILE* f = fopen(out_path, "w");
+		if (f) {
+			fprintf(f, "%s\n%s\n%s\n", d.fen, d.move[0] ? d.move : "-", d.what.c_str());
+			fclose(f);
+			printf("written to %s\n", out_path);
+		}
+		return 1;
+	}
+	printf("no divergence\n");
+	return 0;
+}